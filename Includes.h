@@ -27,11 +27,33 @@
 
 #include "headers/TXLib.h"
 
+#include "headers/system/AllocationTracker.h"
+#include "headers/system/Trace.h"
+#include "headers/system/ThreadPool.h"
+#include "headers/system/MappedFile.h"
+#include "headers/system/TextReader.h"
+#include "headers/system/FileStream.h"
+#include "headers/system/AssetCache.h"
+
 #include "headers/mechanics/Matrix.h"
 #include "headers/mechanics/Vector.h"
+#include "headers/mechanics/Quaternion.h"
+#include "headers/mechanics/Transform.h"
+#include "headers/mechanics/Triangle.h"
+#include "headers/mechanics/BoundingHierarchy.h"
+#include "headers/mechanics/MeshHierarchy.h"
+#include "headers/mechanics/MeshSimplifier.h"
 
 #include "headers/graphics/Rendering.h"
 #include "headers/graphics/Model.h"
+#include "headers/graphics/ModelImport.h"
+#include "headers/graphics/ModelCache.h"
+#include "headers/graphics/ModelReloader.h"
+#include "headers/graphics/Occlusion.h"
+#include "headers/graphics/Scene.h"
+#include "headers/graphics/SceneGraph.h"
+#include "headers/graphics/Picking.h"
+#include "headers/graphics/GoldenImage.h"
 
 //}
 //----------------------------------------------------------------------------
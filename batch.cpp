@@ -0,0 +1,318 @@
+#include "Includes.h"
+
+#ifdef _WIN32
+	#include <io.h>
+	#include <fcntl.h>
+#endif
+
+//----------------------------------------------------------------------------
+//{ Static class members initialization
+//----------------------------------------------------------------------------
+
+bool Matrix::check = false;
+bool Vector::check = false;
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Camera path
+//----------------------------------------------------------------------------
+
+	/*
+		Text file of keyframes, one per line, '#' starts a comment:
+
+			# seconds  position x y z  angles x y z (as rotationMatrix() takes them)
+			0		   0 0 -300		   0 0 0
+			2.5		   300 0 0		   0 1.57 0
+
+		Positions are interpolated linearly and orientations along the shorter
+		arc between keyframes, the camera holds still before the first and
+		after the last one.
+	*/
+	struct CameraKeyframe
+	{
+		double time;
+
+		Vector position;
+		Quaternion orientation;
+	};
+
+	bool keyframeEarlier(const CameraKeyframe& keyframe0, const CameraKeyframe& keyframe1)
+	{
+		return keyframe0.time < keyframe1.time;
+	}
+
+	bool readCameraPath(const char* filename, std::vector<CameraKeyframe>* keyframes)
+	{
+		assert(filename && keyframes);
+
+		FileStream file(filename, 1 << 16);
+
+		if (!file.ok())
+		{
+			printf("batch: cannot open %s\n", filename);
+			return false;
+		}
+
+		const char* begin = NULL;
+		const char* end	  = NULL;
+
+		while (file.readLine(&begin, &end))
+		{
+			TextReader reader = TextReader(begin, end, file.getLine());
+
+			if (reader.atLineEnd()) continue;
+
+			double values[7] = {};
+
+			for (size_t i = 0; i < 7; i++)
+			{
+				if (!reader.readDouble(&values[i]))
+				{
+					printf("batch: %s:%u: expected a time, a position and three angles\n", filename, (unsigned int) file.getLine());
+					return false;
+				}
+			}
+
+			CameraKeyframe keyframe = { values[0], Vector(values[1], values[2], values[3]), Quaternion::fromAngles(values[4], values[5], values[6]) };
+			keyframes->push_back(keyframe);
+		}
+
+		if (keyframes->empty())
+		{
+			printf("batch: %s has no keyframes\n", filename);
+			return false;
+		}
+
+		std::stable_sort(keyframes->begin(), keyframes->end(), keyframeEarlier);
+
+		return true;
+	}
+
+	void cameraAt(const std::vector<CameraKeyframe>& keyframes, double time, Vector* position, Quaternion* orientation)
+	{
+		assert(!keyframes.empty() && position && orientation);
+
+		size_t next = 0;
+		while (next < keyframes.size() && keyframes[next].time <= time) next++;
+
+		if (next == 0 || next == keyframes.size())
+		{
+			const CameraKeyframe& held = keyframes[next == 0 ? 0 : next - 1];
+
+			*position	 = held.position;
+			*orientation = held.orientation;
+
+			return;
+		}
+
+		const CameraKeyframe& previous = keyframes[next - 1];
+		const CameraKeyframe& following = keyframes[next];
+
+		double t = (time - previous.time) / (following.time - previous.time);
+
+		*position	 = previous.position * (1 - t) + following.position * t;
+		*orientation = Quaternion::slerp(previous.orientation, following.orientation, t);
+	}
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Output
+//----------------------------------------------------------------------------
+
+	// Rows of 8 bit red, green and blue from the top, what ffmpeg reads as -f rawvideo -pix_fmt rgb24:
+	bool writeRawFrame(FILE* file, const unsigned int* pixels, unsigned int width, unsigned int height, std::vector<unsigned char>* row)
+	{
+		assert(file && pixels && row);
+
+		row->resize((size_t) width * 3);
+
+		for (unsigned int y = 0; y < height; y++)
+		{
+			const unsigned int* source = pixels + (size_t) y * width;
+
+			for (unsigned int x = 0; x < width; x++)
+			{
+				(*row)[x * 3]	  = static_cast<unsigned char>(source[x] >> 16);
+				(*row)[x * 3 + 1] = static_cast<unsigned char>(source[x] >> 8);
+				(*row)[x * 3 + 2] = static_cast<unsigned char>(source[x]);
+			}
+
+			if (fwrite(row->data(), 1, row->size(), file) != row->size()) return false;
+		}
+
+		return true;
+	}
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Main
+//----------------------------------------------------------------------------
+
+	void printUsage()
+	{
+		puts("batch model path output [-w width] [-h height] [-fps rate] [-parallax value] [-threads count] [-msaa] [-raw]\n"
+			 "\n"
+			 "Renders the model at the origin along the camera path, offscreen, a frame per thread at once.\n"
+			 "output is a printf pattern of PPM files (frames/%05d.ppm), with -raw a file of rgb24 frames, - for stdout.");
+	}
+
+	int main(int argc, char* argv[])
+	{
+		// Arguments:
+
+			if (argc < 4)
+			{
+				printUsage();
+				return 1;
+			}
+
+			const char* modelFile  = argv[1];
+			const char* pathFile   = argv[2];
+			const char* outputName = argv[3];
+
+			unsigned int width = 1000, height = 800, threadCount = 0;
+			double fps = 30, parallax = 500;
+			bool multisampling = false, raw = false;
+
+			for (int i = 4; i < argc; i++)
+			{
+				bool hasValue = i + 1 < argc;
+
+				if		(strcmp(argv[i], "-w") == 0		   && hasValue) width		= static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-h") == 0		   && hasValue) height		= static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-fps") == 0	   && hasValue) fps			= atof(argv[++i]);
+				else if (strcmp(argv[i], "-parallax") == 0 && hasValue) parallax	= atof(argv[++i]);
+				else if (strcmp(argv[i], "-threads") == 0  && hasValue) threadCount = static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-msaa") == 0)					multisampling = true;
+				else if (strcmp(argv[i], "-raw") == 0)					raw = true;
+				else
+				{
+					printf("batch: unknown option %s\n", argv[i]);
+					printUsage();
+
+					return 1;
+				}
+			}
+
+			if (width == 0 || height == 0 || fps <= 0 || parallax <= 0)
+			{
+				puts("batch: the size, frame rate and parallax have to be positive");
+				return 1;
+			}
+
+		// Scene:
+
+			ThreadPoolSettings settings = { threadCount, false, 1000 };
+			ThreadPool threadPool(settings);
+
+			Model model = Model(modelFile, &threadPool);
+			if (model.getError())
+			{
+				printf("batch: %s:%u: %s\n", modelFile, (unsigned int) model.getErrorLine(), model.getError());
+				return 1;
+			}
+
+			std::vector<CameraKeyframe> keyframes;
+			if (!readCameraPath(pathFile, &keyframes)) return 1;
+
+			size_t frameCount = static_cast<size_t>(floor((keyframes.back().time - keyframes.front().time) * fps)) + 1;
+
+		// Output:
+
+			FILE* rawFile = NULL;
+
+			if (raw)
+			{
+				if (strcmp(outputName, "-") == 0)
+				{
+					#ifdef _WIN32
+						_setmode(_fileno(stdout), _O_BINARY);
+					#endif
+
+					rawFile = stdout;
+				}
+				else rawFile = fopen(outputName, "wb");
+
+				if (!rawFile)
+				{
+					printf("batch: cannot create %s\n", outputName);
+					return 1;
+				}
+			}
+
+		// Every thread renders whole frames with its own renderer, frames are written in order after each round:
+
+			std::vector<Renderer*> renderers = std::vector<Renderer*>(threadPool.getThreadCount());
+
+			for (size_t i = 0; i < renderers.size(); i++)
+			{
+				renderers[i] = new Renderer(width, height, RGB(0, 0, 0), identityMatrix(4), Vector(width / 2.0, height / 2.0), parallax, true);
+				renderers[i]->setMultisampling(multisampling);
+			}
+
+			Matrix modelTransformation = transformationMatrix();
+
+			std::vector<unsigned char> row;
+			char filename[1024] = "";
+
+			bool written = true;
+
+			for (size_t first = 0; first < frameCount && written; first += renderers.size())
+			{
+				size_t count = std::min(renderers.size(), frameCount - first);
+
+				threadPool.parallelFor(0, count, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						Vector position;
+						Quaternion orientation;
+
+						cameraAt(keyframes, keyframes.front().time + (first + i) / fps, &position, &orientation);
+
+						Renderer* renderer = renderers[i];
+
+						renderer->setCamera(orientation, position);
+
+						renderer->clear();
+						renderer->startRendering();
+
+						model.render(renderer, modelTransformation);
+
+						renderer->finishRendering();
+					}
+				});
+
+				for (size_t i = 0; i < count && written; i++)
+				{
+					if (raw) written = writeRawFrame(rawFile, renderers[i]->getColorBuffer(), width, height, &row);
+					else
+					{
+						snprintf(filename, sizeof(filename), outputName, static_cast<int>(first + i));
+
+						written = saveImage(filename, renderers[i]->getColorBuffer(), width, height);
+					}
+				}
+
+				fprintf(stderr, "\rbatch: %u / %u frames", static_cast<unsigned int>(first + count), static_cast<unsigned int>(frameCount));
+			}
+
+			fprintf(stderr, "\n");
+
+			if (!written) fprintf(stderr, "batch: cannot write %s\n", raw ? outputName : filename);
+
+			if (rawFile && rawFile != stdout && fclose(rawFile) != 0) written = false;
+
+			for (size_t i = 0; i < renderers.size(); i++) delete renderers[i];
+
+		return written ? 0 : 1;
+	}
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,164 @@
+//----------------------------------------------------------------------------
+//{ Allocation counting
+//----------------------------------------------------------------------------
+
+	// Every Matrix (and so every Vector) allocation is counted, see Matrix.h:
+
+		unsigned long long allocatedBlocks = 0;
+
+		#define MATRIX_ALLOCATED(blocks) (allocatedBlocks += (blocks))
+
+//}
+//----------------------------------------------------------------------------
+
+#include "Includes.h"
+
+#include <chrono>
+#include <algorithm>
+
+//----------------------------------------------------------------------------
+//{ Static class members initialization
+//----------------------------------------------------------------------------
+
+bool Matrix::check = true;
+bool Vector::check = true;
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Benchmarks
+//----------------------------------------------------------------------------
+
+	// Results are summed into it, so the compiler keeps the work:
+	volatile double sink = 0;
+
+	/*
+		Runs the operation iterations times per round, ns/op is the median
+		round and allocations are counted over the same round. Prints one
+		JSON object per line.
+	*/
+	template <typename Operation>
+	void measure(const char* name, size_t iterations, const Operation& operation)
+	{
+		const size_t ROUNDS = 7;
+
+		// Warming up caches and the allocator:
+		for (size_t i = 0; i < iterations / 10 + 1; i++) operation();
+
+		double times[ROUNDS] = {};
+
+		unsigned long long blocks = 0;
+
+		for (size_t round = 0; round < ROUNDS; round++)
+		{
+			unsigned long long blocksBefore = allocatedBlocks;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			for (size_t i = 0; i < iterations; i++) operation();
+
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+			times[round] = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+
+			blocks = allocatedBlocks - blocksBefore;
+		}
+
+		std::sort(times, times + ROUNDS);
+
+		printf("{\"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.2f, \"ns_per_op_min\": %.2f, \"allocations_per_op\": %.2f}\n",
+			   name, static_cast<unsigned int>(iterations), times[ROUNDS / 2], times[0], static_cast<double>(blocks) / iterations);
+
+		fflush(stdout);
+	}
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Main
+//----------------------------------------------------------------------------
+
+	/*
+		benchmark [iterations], 100000 by default. Allocations are the blocks
+		calloc() gives, a 4x4 Matrix takes 5 of them and a Vector 2.
+	*/
+	int main(int argc, char* argv[])
+	{
+		size_t iterations = (argc > 1) ? static_cast<size_t>(atol(argv[1])) : 100000;
+		if (iterations == 0) iterations = 1;
+
+		// ok() is what assert() checks, here the operations themselves are measured:
+
+			Matrix::check = false;
+			Vector::check = false;
+
+		const Matrix transformation = transformationMatrix(0.3, 0.2, 0.1, Vector(10, 20, 300), Vector(1, 2, 1));
+		const Matrix rotation		= rotationMatrix(0.1, 0.2, 0.3);
+
+		const Vector vector0 = Vector(1, 2, 3);
+		const Vector vector1 = Vector(-4, 5, 0.5);
+
+		measure("Matrix(4, 4, ...)", iterations, [&]()
+		{
+			Matrix matrix = Matrix(4, 4, 1.0, 0.0, 0.0, 1.0,
+										 0.0, 1.0, 0.0, 2.0,
+										 0.0, 0.0, 1.0, 3.0,
+										 0.0, 0.0, 0.0, 1.0);
+			sink = sink + matrix[3][0];
+		});
+
+		measure("Matrix copy", iterations, [&]()
+		{
+			Matrix matrix = transformation;
+			sink = sink + matrix[3][0];
+		});
+
+		measure("Matrix * Matrix", iterations, [&]()
+		{
+			Matrix product = transformation * transformation;
+			sink = sink + product[3][0];
+		});
+
+		measure("Vector * Matrix (4x4)", iterations, [&]()
+		{
+			Vector product = vector0 * transformation;
+			sink = sink + product.x();
+		});
+
+		measure("Vector * Matrix (3x3)", iterations, [&]()
+		{
+			Vector product = vector0 * rotation;
+			sink = sink + product.x();
+		});
+
+		measure("Vector ^ Vector", iterations, [&]()
+		{
+			Vector cross = vector0 ^ vector1;
+			sink = sink + cross.x();
+		});
+
+		measure("Vector::normalize", iterations, [&]()
+		{
+			Vector normal = vector1;
+			sink = sink + normal.normalize().x();
+		});
+
+		measure("Vector::perspectived", iterations, [&]()
+		{
+			Vector projected = vector0.perspectived(200);
+			sink = sink + projected.x();
+		});
+
+		measure("transformationMatrix", iterations, [&]()
+		{
+			Matrix matrix = transformationMatrix(0.3, 0.2, 0.1, Vector(10, 20, 300), Vector(1, 2, 1));
+			sink = sink + matrix[3][0];
+		});
+
+		return 0;
+	}
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,340 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Golden images
+//----------------------------------------------------------------------------
+
+	/*
+		Frames of an offscreen renderer checked against reference images, so a
+		change of the rasterizer that moves covered pixels shows up:
+
+			Renderer renderer(320, 240, RGB(0, 0, 0), identityMatrix(4), Vector(160, 120), 200, true);
+
+			renderer.clear();
+			renderer.startRendering();
+			cube.render(&renderer, transformation);
+			renderer.finishRendering();
+
+			ImageDifference difference = {};
+			if (!checkReference(renderer, "resources/golden/cube.ppm", 0, &difference)) ...
+
+		References are binary PPM files. A missing one is written from the frame
+		and the check fails, so a reference only appears after someone deleted it
+		on purpose, and is trusted once it was looked at and the check run again.
+		tests/golden.cpp checks fixed scenes against those in resources/golden.
+	*/
+
+	struct ImageDifference
+	{
+		// Pixels with some channel differing by more than the tolerance:
+		size_t differentPixels;
+
+		unsigned int maxChannelDifference;
+
+		// First different pixel in row order, -1 if there is none:
+		int firstX, firstY;
+	};
+
+	struct CoverageStats
+	{
+		size_t coveredPixels;
+
+		// Pixels written by more than one triangle:
+		size_t overdrawnPixels;
+
+		// Uncovered pixels between covered ones on both sides, horizontally or vertically:
+		size_t holes;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Files
+	//----------------------------------------------------------------------------
+
+		// Rows of 0x00RRGGBB pixels from top to bottom, like the color buffer:
+		bool saveImage(const char* filename, const unsigned int* pixels, unsigned int width, unsigned int height)
+		{
+			assert(filename && pixels);
+
+			FILE* file = fopen(filename, "wb");
+			if (!file) return false;
+
+			fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+			std::vector<unsigned char> row = std::vector<unsigned char>((size_t) width * 3);
+
+			bool written = true;
+
+			for (unsigned int y = 0; y < height && written; y++)
+			{
+				const unsigned int* source = pixels + (size_t) y * width;
+
+				for (unsigned int x = 0; x < width; x++)
+				{
+					row[x * 3]	   = static_cast<unsigned char>(source[x] >> 16);
+					row[x * 3 + 1] = static_cast<unsigned char>(source[x] >> 8);
+					row[x * 3 + 2] = static_cast<unsigned char>(source[x]);
+				}
+
+				written = fwrite(row.data(), 1, row.size(), file) == row.size();
+			}
+
+			return fclose(file) == 0 && written;
+		}
+
+		bool loadImage(const char* filename, std::vector<unsigned int>* pixels, unsigned int* width, unsigned int* height)
+		{
+			assert(filename && pixels && width && height);
+
+			FileStream file(filename, 1 << 16);
+			if (!file.ok()) return false;
+
+			// The header is "P6", width, height and 255, separated by whitespace, then a single whitespace byte:
+
+				unsigned int values[3] = {};
+				char magic[2] = {};
+
+				if (!file.read(magic, 2) || magic[0] != 'P' || magic[1] != '6') return false;
+
+				char current = 0;
+
+				for (size_t i = 0; i < 3; i++)
+				{
+					do
+					{
+						if (!file.read(&current, 1)) return false;
+					}
+					while (isspace(static_cast<unsigned char>(current)));
+
+					while (isdigit(static_cast<unsigned char>(current)))
+					{
+						values[i] = values[i] * 10 + (current - '0');
+
+						if (!file.read(&current, 1)) return false;
+					}
+				}
+
+				if (values[2] != 255 || !isspace(static_cast<unsigned char>(current))) return false;
+
+			*width	= values[0];
+			*height = values[1];
+
+			pixels->resize((size_t) values[0] * values[1]);
+
+			std::vector<unsigned char> row = std::vector<unsigned char>((size_t) values[0] * 3);
+
+			for (unsigned int y = 0; y < values[1]; y++)
+			{
+				if (!file.read(row.data(), row.size())) return false;
+
+				unsigned int* destination = pixels->data() + (size_t) y * values[0];
+
+				for (unsigned int x = 0; x < values[0]; x++) destination[x] = row[x * 3] << 16 | row[x * 3 + 1] << 8 | row[x * 3 + 2];
+			}
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Comparison
+	//----------------------------------------------------------------------------
+
+		// Tolerance 0 is an exact comparison:
+		ImageDifference compareImages(const unsigned int* image0, const unsigned int* image1, unsigned int width, unsigned int height, unsigned int tolerance = 0)
+		{
+			assert(image0 && image1);
+
+			ImageDifference difference = { 0, 0, -1, -1 };
+
+			for (unsigned int y = 0; y < height; y++)
+			{
+				for (unsigned int x = 0; x < width; x++)
+				{
+					unsigned int pixel0 = image0[(size_t) y * width + x];
+					unsigned int pixel1 = image1[(size_t) y * width + x];
+
+					if (pixel0 == pixel1) continue;
+
+					unsigned int maxChannel = 0;
+
+					for (unsigned int shift = 0; shift < 24; shift += 8)
+					{
+						int channel0 = (pixel0 >> shift) & 0xFF;
+						int channel1 = (pixel1 >> shift) & 0xFF;
+
+						maxChannel = std::max(maxChannel, static_cast<unsigned int>(abs(channel0 - channel1)));
+					}
+
+					difference.maxChannelDifference = std::max(difference.maxChannelDifference, maxChannel);
+
+					if (maxChannel <= tolerance) continue;
+
+					if (difference.differentPixels++ == 0)
+					{
+						difference.firstX = static_cast<int>(x);
+						difference.firstY = static_cast<int>(y);
+					}
+				}
+			}
+
+			return difference;
+		}
+
+		// The finished frame against the reference file. A missing one is written from the frame, which still fails:
+		bool checkReference(const Renderer& renderer, const char* filename, unsigned int tolerance, ImageDifference* difference)
+		{
+			assert(filename && difference);
+
+			unsigned int width	= renderer.getWindowWidth();
+			unsigned int height = renderer.getWindowHeight();
+
+			*difference = ImageDifference();
+			difference->firstX = difference->firstY = -1;
+
+			FILE* existing = fopen(filename, "rb");
+
+			if (!existing)
+			{
+				if (saveImage(filename, renderer.getColorBuffer(), width, height))
+					printf("checkReference(): %s was missing, wrote the current frame, check it and run again\n", filename);
+				else
+					printf("checkReference(): %s is missing and cannot be written\n", filename);
+
+				return false;
+			}
+
+			fclose(existing);
+
+			std::vector<unsigned int> reference;
+			unsigned int referenceWidth = 0, referenceHeight = 0;
+
+			if (!loadImage(filename, &reference, &referenceWidth, &referenceHeight))
+			{
+				printf("checkReference(): %s is not a binary PPM file\n", filename);
+				return false;
+			}
+
+			if (referenceWidth != width || referenceHeight != height)
+			{
+				printf("checkReference(): %s is %ux%u, the frame is %ux%u\n", filename, referenceWidth, referenceHeight, width, height);
+				return false;
+			}
+
+			*difference = compareImages(renderer.getColorBuffer(), reference.data(), width, height, tolerance);
+
+			if (difference->differentPixels)
+			{
+				printf("checkReference(): %s differs in %u pixels, first at (%d, %d), by up to %u\n", filename,
+					   static_cast<unsigned int>(difference->differentPixels), difference->firstX, difference->firstY, difference->maxChannelDifference);
+			}
+
+			return difference->differentPixels == 0;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Coverage
+	//----------------------------------------------------------------------------
+
+		/*
+			Draws the triangles of a mesh one by one and counts how often every
+			pixel was written. Triangles sharing edges should cover their union
+			without holes, and every pixel of it once, so overdraw is a bug.
+			points are x, y pairs, every triangle is three indices of them. The
+			renderer's frame is cleared.
+		*/
+		CoverageStats checkCoverage(const Renderer& renderer, const int* points, const unsigned int* indices, size_t triangleCount)
+		{
+			assert(points && indices);
+
+			// Multisampled triangles only reach the color buffer when the frame is resolved:
+			assert(!renderer.getMultisampling());
+
+			unsigned int width	= renderer.getWindowWidth();
+			unsigned int height = renderer.getWindowHeight();
+
+			renderer.clear();
+
+			const unsigned int* colors = renderer.getColorBuffer();
+
+			// Drawn in the background's complement, so every written pixel changes:
+
+				unsigned int background = colors[0];
+				COLORREF color = RGB(~background >> 16 & 0xFF, ~background >> 8 & 0xFF, ~background & 0xFF);
+
+			std::vector<unsigned char> counts = std::vector<unsigned char>((size_t) width * height);
+
+			for (size_t i = 0; i < triangleCount; i++)
+			{
+				const int* point0 = points + 2 * indices[3 * i];
+				const int* point1 = points + 2 * indices[3 * i + 1];
+				const int* point2 = points + 2 * indices[3 * i + 2];
+
+				renderer.triangle(point0[0], point0[1], point1[0], point1[1], point2[0], point2[1], color);
+
+				// Counted and cleared back pixel by pixel, whole frames would be cleared once per triangle:
+
+					int minY = std::max(std::min(std::min(point0[1], point1[1]), point2[1]), 0);
+					int maxY = std::min(std::max(std::max(point0[1], point1[1]), point2[1]), static_cast<int>(height) - 1);
+
+					for (int y = minY; y <= maxY; y++)
+					{
+						for (unsigned int x = 0; x < width; x++)
+						{
+							size_t index = (size_t) y * width + x;
+
+							if (colors[index] == background) continue;
+
+							if (counts[index] < 255) counts[index]++;
+
+							renderer.pixel(static_cast<int>(x), y, RGB(background >> 16 & 0xFF, background >> 8 & 0xFF, background & 0xFF));
+						}
+					}
+			}
+
+			CoverageStats stats = {};
+
+			for (unsigned int y = 0; y < height; y++)
+			{
+				for (unsigned int x = 0; x < width; x++)
+				{
+					size_t index = (size_t) y * width + x;
+
+					if (counts[index])
+					{
+						stats.coveredPixels++;
+
+						if (counts[index] > 1) stats.overdrawnPixels++;
+
+						continue;
+					}
+
+					bool betweenX = x > 0 && x + 1 < width	&& counts[index - 1]	 && counts[index + 1];
+					bool betweenY = y > 0 && y + 1 < height && counts[index - width] && counts[index + width];
+
+					if (betweenX || betweenY) stats.holes++;
+				}
+			}
+
+			return stats;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
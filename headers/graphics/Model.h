@@ -1,20 +1,10 @@
 #pragma once
 
 //----------------------------------------------------------------------------
-//{ Triangle
+//{ Includes
 //----------------------------------------------------------------------------
 
-	struct Triangle
-	{
-		public:
-			
-			// These are just numbers of points in vertecies array
-			unsigned int point0, point1, point2;
-
-			COLORREF color;
-
-			Vector normal;
-	};
+	#include <emmintrin.h>
 
 //}
 //----------------------------------------------------------------------------
@@ -24,21 +14,77 @@
 //{ Model
 //----------------------------------------------------------------------------
 
+	// Layout of cache entries, see ModelCache.h:
+	struct ModelCacheHeader;
+
 	class Model
 	{
 		public:
 
+			// Color of imported triangles without one:
+			static const COLORREF DEFAULT_COLOR = 0xFFFFFF;
+
 			// Constructor && destructor:
 
-				Model(const char* filename);
+				// Wavefront .obj, .stl, .ply or the text model: "N M", N lines of "x y z", M lines of "i j k 0xBBGGRR" color (0xTTBBGGRR with transparency TT).
+				// With a cache the processed model and its levels of detail are read from it when the file's content was seen before:
+				Model(const char* filename, ThreadPool* threadPool = NULL, AssetCache* cache = NULL);
 				~Model();
 
+			// Getters:
+
+				size_t getPointCount() const;
+				const Vector& getPoint(size_t index) const;
+
+				size_t getTriangleCount() const;
+				const Triangle& getTriangle(size_t index) const;
+
+				// Axis-aligned bounding box in model space:
+				const Vector& getBoundsMin() const;
+				const Vector& getBoundsMax() const;
+
+				// Ray query hierarchy, built by the first call:
+				const MeshHierarchy& getHierarchy() const;
+
+				// Loading error and its line in the file, NULL if the model was loaded. Nothing is printed:
+				const char* getError() const;
+				size_t getErrorLine() const;
+
+				// Levels of detail, level 0 is the model itself:
+				size_t getLodCount() const;
+				size_t getLodTriangleCount(size_t level) const;
+				double getLodThreshold(size_t level) const;
+
+				// What buildLods() was last called with, no levels if it wasn't:
+				size_t getRequestedLodCount() const;
+				double getLodReduction() const;
+
+				// Edges shared by triangles are counted once:
+				size_t getEdgeCount() const;
+
+			// Setters:
+
+				// Level is drawn while the bounding sphere is projected smaller than diameter pixels:
+				Model& setLodThreshold(size_t level, double diameter);
+
 			// Functions:
 
 				bool ok() const;
 
+				// Simplified copies, level i keeps about reduction^i of the triangles:
+				void buildLods(size_t levelCount, double reduction = 0.5);
+
+				// Exchanges everything loaded and derived with the other model, pointers to both stay valid:
+				void swap(Model& other);
+
+				// Level render() draws with the transformation:
+				size_t selectLod(const Renderer* renderer, const Matrix& transformation) const;
+
 				void render(const Renderer* renderer, const Matrix& transformation) const;
 
+				// Edges of triangles facing the camera, depth tested, so drawn after render() they outline the visible ones:
+				void renderWireframe(const Renderer* renderer, const Matrix& transformation, COLORREF color) const;
+
 		private:
 
             size_t pointCount_;
@@ -46,90 +92,223 @@
 
 			size_t triangleCount_;
 			Triangle* triangles_;
+
+			Vector boundsMin_;
+			Vector boundsMax_;
+
+			mutable MeshHierarchy* hierarchy_;
+
+			const char* error_;
+			size_t errorLine_;
+
+			// Wireframe:
+
+				// Triangles on both sides of an edge, the same one twice on a border, NO_TRIANGLE if there are more than two:
+				struct Edge
+				{
+					unsigned int point0, point1;
+					unsigned int triangle0, triangle1;
+				};
+
+				static const unsigned int NO_TRIANGLE = ~0u;
+
+				std::vector<Edge> edges_;
+
+				static void buildEdges(const Triangle* triangles, size_t triangleCount, std::vector<Edge>* edges);
+
+				void renderEdges(const Renderer* renderer, const Matrix& transformation, const Vector* points, size_t pointCount,
+								 const Triangle* triangles, size_t triangleCount, const std::vector<Edge>& edges, COLORREF color) const;
+
+			// Levels of detail:
+
+				struct Lod
+				{
+					Vector* points;
+					size_t pointCount;
+
+					Triangle* triangles;
+					size_t triangleCount;
+
+					std::vector<Edge> edges;
+
+					double maxDiameter;
+				};
+
+				// Diameter of level 1, every next level halves the triangle density per pixel:
+				static const unsigned int DEFAULT_LOD_DIAMETER = 256;
+
+				std::vector<Lod> lods_;
+
+				size_t lodRequestCount_;
+				double lodReduction_;
+
+				void freeLods();
+
+				void renderMesh(const Renderer* renderer, const Matrix& transformation,
+								const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount) const;
+
+			// Loading:
+
+				// Text between line boundaries, parsed by one job:
+				struct ParseChunk
+				{
+					const char* begin;
+					const char* end;
+
+					size_t firstLine, lineCount;
+
+					// Non-blank lines, the first N are points and the next M triangles:
+					size_t firstRecord, recordCount;
+
+					const char* error;
+					size_t errorLine;
+				};
+
+				static const size_t MIN_CHUNK_SIZE = 1 << 16;
+
+				bool fail(size_t line, const char* error);
+
+				bool parse(const char* begin, const char* end, ThreadPool* threadPool);
+				void parseChunk(ParseChunk* chunk, double* coordinates);
+
+				void computeNormals(ThreadPool* threadPool);
+
+				// Importers of other formats (ModelImport.h):
+
+					bool importObj(const char* filename);
+					bool importStl(const char* filename);
+					bool importStlText(const char* filename);
+					bool importPly(const char* filename);
+
+					void addTriangle(unsigned int point0, unsigned int point1, unsigned int point2, COLORREF color, size_t* triangleCapacity);
+
+					// Ear clipping in the plane the polygon faces most:
+					void addPolygon(const unsigned int* polygon, size_t size, COLORREF color, size_t* triangleCapacity, std::vector<unsigned int>* scratch);
+
+					// Array with room for size elements, zeroed past the old capacity:
+					template <typename Type>
+					static Type* grow(Type* array, size_t* capacity, size_t size);
+
+			// Asset cache (ModelCache.h):
+
+				AssetCache* cache_;
+
+				// Of the source bytes and format, options are hashed on top of it for the keys:
+				unsigned long long sourceHash_;
+
+				bool hashSource(const char* filename, AssetCache* cache);
+
+				// Levels of detail are keyed by their options, the model itself by zeros:
+				unsigned long long cacheKey(size_t levelCount, double reduction) const;
+
+				static bool writeCachedMesh(FILE* file, const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount,
+											const std::vector<Edge>& edges, double maxDiameter);
+
+				void storeCached() const;
+				void storeCachedLods(size_t levelCount, double reduction) const;
+
+				MappedFile* openCached(unsigned long long key, const ModelCacheHeader** header) const;
+
+				static const char* readCachedMesh(const char* position, const char* end, ThreadPool* threadPool, Vector** points, size_t* pointCount,
+												  Triangle** triangles, size_t* triangleCount, std::vector<Edge>* edges, double* maxDiameter);
+
+				bool loadCached(ThreadPool* threadPool);
+				bool loadCachedLods(size_t levelCount, double reduction);
 	};
 
 	//----------------------------------------------------------------------------
     //{ Constructor && destructor
     //----------------------------------------------------------------------------
 
-        Model::Model(const char* filename) :
-            pointCount_    (0),
-            points_        (NULL),
-            triangleCount_ (0),
-            triangles_     (NULL)
+        Model::Model(const char* filename, ThreadPool* threadPool /*= NULL*/, AssetCache* cache /*= NULL*/) :
+            pointCount_      (0),
+            points_          (NULL),
+            triangleCount_   (0),
+            triangles_       (NULL),
+            boundsMin_       (),
+            boundsMax_       (),
+            hierarchy_       (NULL),
+            error_           (NULL),
+            errorLine_       (0),
+            edges_           (),
+            lods_            (),
+            lodRequestCount_ (0),
+            lodReduction_    (0),
+            cache_           (NULL),
+            sourceHash_      (0)
         {
+			ALLOCATION_STAGE(ALLOCATION_LOADING);
+
             // Checking input:
 
                 assert(filename);
 
-            // Opening file:
+            // Warm start, everything below is in the cache entry:
 
-				std::ifstream modelFile = std::ifstream(filename);
-				assert(modelFile.good());
+				if (cache && hashSource(filename, cache) && loadCached(threadPool))
+				{
+					assert(ok());
+					return;
+				}
 
-            // Getting arrays lengths:
+            // Loading by extension:
 
-				modelFile >> pointCount_;
-				modelFile >> triangleCount_;
-				
-            // Creating arrays:
+				const char* extension = strrchr(filename, '.');
 
-                points_ = (Vector*) calloc(pointCount_, sizeof(*points_));
-                assert(points_);
+				if		(extension && _stricmp(extension, ".obj") == 0) importObj(filename);
+				else if (extension && _stricmp(extension, ".stl") == 0) importStl(filename);
+				else if (extension && _stricmp(extension, ".ply") == 0) importPly(filename);
+				else
+				{
+					MappedFile modelFile(filename);
 
-                triangles_ = (Triangle*) calloc(triangleCount_, sizeof(*triangles_));
-                assert(triangles_);
+					if (!modelFile.ok()) fail(0, "cannot open the file");
+					else parse(modelFile.getData(), modelFile.getData() + modelFile.getSize(), threadPool);
+				}
 
-            // Filling point array:
+				if (error_ == NULL) computeNormals(threadPool);
 
-				double currentX = 0, currentY = 0, currentZ = 0;
-                for (size_t i = 0; i < pointCount_; i++)
-                {
-					assert(i < pointCount_);
+			// On errors the model is left empty, callers report getError() themselves:
 
-					modelFile >> currentX;
-					modelFile >> currentY;
-					modelFile >> currentZ;
+				if (error_)
+				{
+					trackedFree(points_);
+					trackedFree(triangles_);
 
-                    points_[i] = Vector(currentX, currentY, currentZ);
-                }
+					pointCount_	   = 0;
+					triangleCount_ = 0;
 
-            // Filling triangle array:
+					points_ = (Vector*) trackedCalloc(1, sizeof(*points_));
+					assert(points_);
 
-                unsigned int currentPoint0 = 0, currentPoint1 = 0, currentPoint2 = 0;
-				COLORREF color = 0;
-				for (size_t i = 0; i < triangleCount_; i++)
-				{
-					assert(i < triangleCount_);
+					triangles_ = (Triangle*) trackedCalloc(1, sizeof(*triangles_));
+					assert(triangles_);
+				}
 
-					std::dec(modelFile);
+            // Unique edges for the wireframe:
 
-					modelFile >> currentPoint0;
-					modelFile >> currentPoint1;
-					modelFile >> currentPoint2;
+				buildEdges(triangles_, triangleCount_, &edges_);
 
-					std::hex(modelFile);
+            // Computing bounds:
 
-					modelFile >> color;
-					
-					assert(currentPoint0 < pointCount_);
-					assert(currentPoint1 < pointCount_);
-					assert(currentPoint2 < pointCount_);
+                if (pointCount_ > 0)
+                {
+                    boundsMin_ = points_[0];
+                    boundsMax_ = points_[0];
+                }
 
-					triangles_[i] = 
-					{
-						currentPoint0,
-						currentPoint1,
-						currentPoint2,
-						color,
-						((points_[currentPoint1] - points_[currentPoint0]) ^
-						(points_[currentPoint2] - points_[currentPoint0])).normalize()
-					};
-				}
+                for (size_t i = 1; i < pointCount_; i++)
+                {
+                    boundsMin_.x() = std::min(boundsMin_.x(), points_[i].x());
+                    boundsMin_.y() = std::min(boundsMin_.y(), points_[i].y());
+                    boundsMin_.z() = std::min(boundsMin_.z(), points_[i].z());
 
-			// Closing file:
+                    boundsMax_.x() = std::max(boundsMax_.x(), points_[i].x());
+                    boundsMax_.y() = std::max(boundsMax_.y(), points_[i].y());
+                    boundsMax_.z() = std::max(boundsMax_.z(), points_[i].z());
+                }
 
-				modelFile.close();
+				if (cache_ && error_ == NULL) storeCached();
 
             // Checking output:
 
@@ -138,13 +317,368 @@
 
 		Model::~Model()
 		{
-			free(points_);
-			free(triangles_);
+			trackedFree(points_);
+			trackedFree(triangles_);
+
+			delete hierarchy_;
+
+			freeLods();
 		}
 
     //}
     //----------------------------------------------------------------------------
 
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		size_t Model::getPointCount() const
+		{
+			return pointCount_;
+		}
+
+		const Vector& Model::getPoint(size_t index) const
+		{
+			assert(index < pointCount_);
+
+			return points_[index];
+		}
+
+		size_t Model::getTriangleCount() const
+		{
+			return triangleCount_;
+		}
+
+		const Triangle& Model::getTriangle(size_t index) const
+		{
+			assert(index < triangleCount_);
+
+			return triangles_[index];
+		}
+
+		const Vector& Model::getBoundsMin() const
+		{
+			return boundsMin_;
+		}
+
+		const Vector& Model::getBoundsMax() const
+		{
+			return boundsMax_;
+		}
+
+		const MeshHierarchy& Model::getHierarchy() const
+		{
+			assert(ok());
+
+			if (hierarchy_ == NULL) hierarchy_ = new MeshHierarchy(points_, pointCount_, triangles_, triangleCount_);
+
+			return *hierarchy_;
+		}
+
+		const char* Model::getError() const
+		{
+			return error_;
+		}
+
+		size_t Model::getErrorLine() const
+		{
+			return errorLine_;
+		}
+
+		size_t Model::getLodCount() const
+		{
+			return lods_.size() + 1;
+		}
+
+		size_t Model::getLodTriangleCount(size_t level) const
+		{
+			assert(level <= lods_.size());
+
+			return level == 0 ? triangleCount_ : lods_[level - 1].triangleCount;
+		}
+
+		double Model::getLodThreshold(size_t level) const
+		{
+			assert(level >= 1 && level <= lods_.size());
+
+			return lods_[level - 1].maxDiameter;
+		}
+
+		size_t Model::getRequestedLodCount() const
+		{
+			return lodRequestCount_;
+		}
+
+		double Model::getLodReduction() const
+		{
+			return lodReduction_;
+		}
+
+		size_t Model::getEdgeCount() const
+		{
+			return edges_.size();
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Setters
+	//----------------------------------------------------------------------------
+
+		Model& Model::setLodThreshold(size_t level, double diameter)
+		{
+			assert(level >= 1 && level <= lods_.size());
+			assert(diameter >= 0);
+
+			lods_[level - 1].maxDiameter = diameter;
+
+			return *this;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Loading
+	//----------------------------------------------------------------------------
+
+		bool Model::fail(size_t line, const char* error)
+		{
+			error_	   = error;
+			errorLine_ = line;
+
+			return false;
+		}
+
+		bool Model::parse(const char* begin, const char* end, ThreadPool* threadPool)
+		{
+			// Header:
+
+				TextReader header = TextReader(begin, end);
+				while (!header.atEnd() && header.atLineEnd()) header.nextLine();
+
+				unsigned long long pointCount = 0, triangleCount = 0;
+
+				if (!header.readUnsigned(&pointCount) || !header.readUnsigned(&triangleCount) || !header.atLineEnd())
+				{
+					return fail(header.getLine(), "expected the point and triangle counts");
+				}
+
+				header.nextLine();
+
+			// Creating arrays:
+
+				pointCount_	   = static_cast<size_t>(pointCount);
+				triangleCount_ = static_cast<size_t>(triangleCount);
+
+				points_ = (Vector*) trackedCalloc(std::max<size_t>(pointCount_, 1), sizeof(*points_));
+				assert(points_);
+
+				triangles_ = (Triangle*) trackedCalloc(std::max<size_t>(triangleCount_, 1), sizeof(*triangles_));
+				assert(triangles_);
+
+				std::vector<double> coordinates = std::vector<double>(3 * pointCount_);
+
+			// Splitting the rest at line boundaries:
+
+				const char* body = header.getPosition();
+				size_t bodySize = end - body;
+
+				size_t chunkCount = threadPool ? std::min<size_t>(4 * threadPool->getThreadCount(), bodySize / MIN_CHUNK_SIZE + 1) : 1;
+
+				std::vector<ParseChunk> chunks = std::vector<ParseChunk>(chunkCount);
+
+				for (size_t i = 0; i < chunkCount; i++)
+				{
+					ParseChunk chunk = {};
+
+					chunk.begin = i == 0 ? body : chunks[i - 1].end;
+					chunk.end	= end;
+
+					if (i + 1 < chunkCount)
+					{
+						const char* split = std::max(body + bodySize / chunkCount * (i + 1), chunk.begin);
+						const char* lineEnd = static_cast<const char*>(memchr(split, '\n', end - split));
+
+						if (lineEnd) chunk.end = lineEnd + 1;
+					}
+
+					chunks[i] = chunk;
+				}
+
+			// Counting lines and records of every chunk, so all of them can be parsed at once:
+
+				parallelFor(threadPool, 0, chunkCount, 1, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						TextReader reader = TextReader(chunks[i].begin, chunks[i].end, 0);
+
+						for (; !reader.atEnd(); reader.nextLine())
+						{
+							if (!reader.atLineEnd()) chunks[i].recordCount++;
+						}
+
+						chunks[i].lineCount = reader.getLine();
+					}
+				});
+
+				size_t line = header.getLine(), record = 0;
+
+				for (size_t i = 0; i < chunkCount; i++)
+				{
+					chunks[i].firstLine	  = line;
+					chunks[i].firstRecord = record;
+
+					line   += chunks[i].lineCount;
+					record += chunks[i].recordCount;
+				}
+
+			// Parsing:
+
+				parallelFor(threadPool, 0, chunkCount, 1, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						parseChunk(&chunks[i], coordinates.data());
+					}
+				});
+
+				for (size_t i = 0; i < chunkCount; i++)
+				{
+					if (chunks[i].error) return fail(chunks[i].errorLine, chunks[i].error);
+				}
+
+				if (record < pointCount_ + triangleCount_) return fail(line, "the file ends before the last triangle");
+
+			// Creating points:
+
+				parallelFor(threadPool, 0, pointCount_, 0, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						points_[i] = Vector(coordinates[3 * i], coordinates[3 * i + 1], coordinates[3 * i + 2]);
+					}
+				});
+
+			return true;
+		}
+
+		void Model::parseChunk(ParseChunk* chunk, double* coordinates)
+		{
+			assert(chunk);
+			assert(coordinates || pointCount_ == 0);
+
+			TextReader reader = TextReader(chunk->begin, chunk->end, chunk->firstLine);
+
+			#define FAIL(message) { chunk->error = message; chunk->errorLine = reader.getLine(); return; }
+
+			size_t record = chunk->firstRecord;
+
+			for (; !reader.atEnd(); reader.nextLine())
+			{
+				if (reader.atLineEnd()) continue;
+
+				if (record < pointCount_)
+				{
+					double* point = coordinates + 3 * record;
+
+					if (!reader.readDouble(&point[0]) || !reader.readDouble(&point[1]) || !reader.readDouble(&point[2]))
+					{
+						FAIL("expected three point coordinates");
+					}
+				}
+				else if (record < pointCount_ + triangleCount_)
+				{
+					unsigned long long point0 = 0, point1 = 0, point2 = 0, color = 0;
+
+					if (!reader.readUnsigned(&point0) || !reader.readUnsigned(&point1) || !reader.readUnsigned(&point2) ||
+						!reader.readUnsigned(&color, 16))
+					{
+						FAIL("expected three point indices and a color");
+					}
+
+					if (point0 >= pointCount_ || point1 >= pointCount_ || point2 >= pointCount_) FAIL("point index out of range");
+
+					Triangle& triangle = triangles_[record - pointCount_];
+
+					triangle.point0 = static_cast<unsigned int>(point0);
+					triangle.point1 = static_cast<unsigned int>(point1);
+					triangle.point2 = static_cast<unsigned int>(point2);
+					triangle.color	= static_cast<COLORREF>(color);
+				}
+				else FAIL("unexpected data after the last triangle");
+
+				if (!reader.atLineEnd()) FAIL("unexpected characters at the end of the line");
+
+				record++;
+			}
+
+			#undef FAIL
+		}
+
+		// Two triangles at a time, the second lane repeats the first one at an odd end:
+
+			void Model::computeNormals(ThreadPool* threadPool)
+			{
+				parallelFor(threadPool, 0, triangleCount_, 0, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i += 2)
+					{
+						size_t second = std::min(i + 1, last - 1);
+
+						double points[2][3][3] = {};
+
+						for (size_t lane = 0; lane < 2; lane++)
+						{
+							const Triangle& triangle = triangles_[lane == 0 ? i : second];
+
+							const Vector* corners[3] = { &points_[triangle.point0], &points_[triangle.point1], &points_[triangle.point2] };
+
+							for (size_t corner = 0; corner < 3; corner++)
+							{
+								points[lane][corner][0] = corners[corner]->x();
+								points[lane][corner][1] = corners[corner]->y();
+								points[lane][corner][2] = corners[corner]->z();
+							}
+						}
+
+						__m128d edge1[3], edge2[3];
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							edge1[axis] = _mm_set_pd(points[1][1][axis] - points[1][0][axis], points[0][1][axis] - points[0][0][axis]);
+							edge2[axis] = _mm_set_pd(points[1][2][axis] - points[1][0][axis], points[0][2][axis] - points[0][0][axis]);
+						}
+
+						__m128d normal[3] = { _mm_sub_pd(_mm_mul_pd(edge1[1], edge2[2]), _mm_mul_pd(edge1[2], edge2[1])),
+											  _mm_sub_pd(_mm_mul_pd(edge1[2], edge2[0]), _mm_mul_pd(edge1[0], edge2[2])),
+											  _mm_sub_pd(_mm_mul_pd(edge1[0], edge2[1]), _mm_mul_pd(edge1[1], edge2[0])) };
+
+						// Degenerate triangles keep a zero normal:
+
+							__m128d length = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(normal[0], normal[0]), _mm_mul_pd(normal[1], normal[1])),
+																	_mm_mul_pd(normal[2], normal[2])));
+
+							length = _mm_max_pd(length, _mm_set1_pd(DBL_MIN));
+
+						double normals[3][2] = {};
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							_mm_storeu_pd(normals[axis], _mm_div_pd(normal[axis], length));
+						}
+
+						triangles_[i].normal = Vector(normals[0][0], normals[1][0], normals[2][0]);
+						if (second != i) triangles_[second].normal = Vector(normals[0][1], normals[1][1], normals[2][1]);
+					}
+				});
+			}
+
+	//}
+	//----------------------------------------------------------------------------
+
 	//----------------------------------------------------------------------------
 	//{ Functions
 	//----------------------------------------------------------------------------
@@ -168,29 +702,362 @@
 			return everythingOk;
 		}
 
+		void Model::buildLods(size_t levelCount, double reduction /*= 0.5*/)
+		{
+			ALLOCATION_STAGE(ALLOCATION_LOADING);
+
+			assert(ok());
+			assert(reduction > 0 && reduction < 1);
+
+			freeLods();
+
+			lodRequestCount_ = levelCount;
+			lodReduction_	 = reduction;
+
+			if (cache_ && loadCachedLods(levelCount, reduction)) return;
+
+			// One simplification run, stopped at every level's target:
+
+				MeshSimplifier simplifier = MeshSimplifier(points_, pointCount_, triangles_, triangleCount_);
+
+				for (size_t level = 1; level <= levelCount; level++)
+				{
+					size_t previousCount = simplifier.getTriangleCount();
+
+					simplifier.simplify(static_cast<size_t>(triangleCount_ * pow(reduction, static_cast<double>(level))));
+					if (simplifier.getTriangleCount() == previousCount) break;
+
+					Lod lod = {};
+					simplifier.extract(&lod.points, &lod.pointCount, &lod.triangles, &lod.triangleCount);
+					buildEdges(lod.triangles, lod.triangleCount, &lod.edges);
+
+					lod.maxDiameter = DEFAULT_LOD_DIAMETER * pow(sqrt(reduction), static_cast<double>(level - 1));
+
+					lods_.push_back(lod);
+				}
+
+			if (cache_) storeCachedLods(levelCount, reduction);
+		}
+
+		void Model::swap(Model& other)
+		{
+			std::swap(pointCount_,		other.pointCount_);
+			std::swap(points_,			other.points_);
+			std::swap(triangleCount_,	other.triangleCount_);
+			std::swap(triangles_,		other.triangles_);
+			std::swap(hierarchy_,		other.hierarchy_);
+			std::swap(error_,			other.error_);
+			std::swap(errorLine_,		other.errorLine_);
+			std::swap(lodRequestCount_, other.lodRequestCount_);
+			std::swap(lodReduction_,	other.lodReduction_);
+			std::swap(cache_,			other.cache_);
+			std::swap(sourceHash_,		other.sourceHash_);
+
+			edges_.swap(other.edges_);
+			lods_ .swap(other.lods_);
+
+			Vector boundsMin = boundsMin_;
+			Vector boundsMax = boundsMax_;
+
+			boundsMin_ = other.boundsMin_;
+			boundsMax_ = other.boundsMax_;
+
+			other.boundsMin_ = boundsMin;
+			other.boundsMax_ = boundsMax;
+		}
+
+		void Model::freeLods()
+		{
+			for (size_t i = 0; i < lods_.size(); i++)
+			{
+				trackedFree(lods_[i].points);
+				trackedFree(lods_[i].triangles);
+			}
+
+			lods_.clear();
+		}
+
+		size_t Model::selectLod(const Renderer* renderer, const Matrix& transformation) const
+		{
+			assert(renderer);
+
+			if (lods_.empty()) return 0;
+
+			// Bounding sphere in view space, scaled by the largest axis scale:
+
+				Transform toWorld = Transform(transformation);
+				Transform toView  = Transform(renderer->getCamera());
+
+				double center[3] = { (boundsMin_.x() + boundsMax_.x()) / 2, (boundsMin_.y() + boundsMax_.y()) / 2, (boundsMin_.z() + boundsMax_.z()) / 2 };
+				double halfSize[3] = { boundsMax_.x() - center[0], boundsMax_.y() - center[1], boundsMax_.z() - center[2] };
+
+				double worldCenter[3] = {}, viewCenter[3] = {};
+				toWorld.apply(center[0], center[1], center[2], worldCenter);
+				toView .apply(worldCenter[0], worldCenter[1], worldCenter[2], viewCenter);
+
+				double scale = 0;
+
+				for (size_t axis = 0; axis < 3; axis++)
+				{
+					double worldAxis[3] = {}, viewAxis[3] = {};
+					toWorld.applyDirection(axis == 0, axis == 1, axis == 2, worldAxis);
+					toView .applyDirection(worldAxis[0], worldAxis[1], worldAxis[2], viewAxis);
+
+					scale = std::max(scale, sqrt(viewAxis[0] * viewAxis[0] + viewAxis[1] * viewAxis[1] + viewAxis[2] * viewAxis[2]));
+				}
+
+				double radius = scale * sqrt(halfSize[0] * halfSize[0] + halfSize[1] * halfSize[1] + halfSize[2] * halfSize[2]);
+
+			// Spheres reaching the camera plane get full detail:
+
+				double nearest = viewCenter[2] - radius;
+				if (nearest <= 0) return 0;
+
+				double diameter = 2 * radius * fabs(renderer->getParallax()) / nearest;
+
+			size_t level = 0;
+			while (level < lods_.size() && diameter < lods_[level].maxDiameter) level++;
+
+			return level;
+		}
+
 		void Model::render(const Renderer* renderer, const Matrix& transformation) const
 		{
+			ALLOCATION_STAGE(ALLOCATION_MODEL);
+			TRACE_SCOPE("Model::render");
+
 			assert(ok());
 			assert(renderer->ok());
 			assert(transformation.ok());
 
 			assert(transformation.getSizeX() == 4 && transformation.getSizeY() == 4);
 
-			for (size_t currentTriangle = 0; currentTriangle < triangleCount_; currentTriangle++)
+			size_t level = selectLod(renderer, transformation);
+
+			if (level == 0) renderMesh(renderer, transformation, points_, pointCount_, triangles_, triangleCount_);
+			else
 			{
-				assert(currentTriangle < triangleCount_);
+				const Lod& lod = lods_[level - 1];
+
+				renderMesh(renderer, transformation, lod.points, lod.pointCount, lod.triangles, lod.triangleCount);
+			}
+		}
+
+		void Model::renderMesh(const Renderer* renderer, const Matrix& transformation,
+							   const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount) const
+		{
+			// Transparent triangles of the model are sorted together:
+			renderer->startObject();
+
+			// Flat copy, so neither points nor normals allocate Matrix products:
+			Transform toWorld = Transform(transformation);
+
+			// Transforming every point once, in parallel if the renderer has threads:
+
+				std::vector<Vector> transformedPoints = std::vector<Vector>(pointCount);
+
+				parallelFor(renderer->getThreadPool(), 0, pointCount, 0, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						double point[3] = {};
+						toWorld.apply(points[i], point);
+
+						transformedPoints[i] = Vector(point[0], point[1], point[2]);
+					}
+				});
+
+			for (size_t currentTriangle = 0; currentTriangle < triangleCount; currentTriangle++)
+			{
+				assert(currentTriangle < triangleCount);
+
+				const Vector& normal = triangles[currentTriangle].normal;
+
+				double worldNormal[3] = {};
+				toWorld.applyDirection(normal.x(), normal.y(), normal.z(), worldNormal);
 
 				renderer->triangle3d
 				(
-					points_[triangles_[currentTriangle].point0] * transformation,
-					points_[triangles_[currentTriangle].point1] * transformation,
-					points_[triangles_[currentTriangle].point2] * transformation,
-					triangles_[currentTriangle].normal * transformation - Vector(transformation[3][0], transformation[3][1], transformation[3][2]),
-					triangles_[currentTriangle].color
+					transformedPoints[triangles[currentTriangle].point0],
+					transformedPoints[triangles[currentTriangle].point1],
+					transformedPoints[triangles[currentTriangle].point2],
+					Vector(worldNormal[0], worldNormal[1], worldNormal[2]),
+					triangles[currentTriangle].color
 				);
 			}
 		}
 
+		void Model::renderWireframe(const Renderer* renderer, const Matrix& transformation, COLORREF color) const
+		{
+			assert(ok());
+			assert(renderer->ok());
+			assert(transformation.ok());
+
+			assert(transformation.getSizeX() == 4 && transformation.getSizeY() == 4);
+
+			size_t level = selectLod(renderer, transformation);
+
+			if (level == 0) renderEdges(renderer, transformation, points_, pointCount_, triangles_, triangleCount_, edges_, color);
+			else
+			{
+				const Lod& lod = lods_[level - 1];
+
+				renderEdges(renderer, transformation, lod.points, lod.pointCount, lod.triangles, lod.triangleCount, lod.edges, color);
+			}
+		}
+
+		void Model::buildEdges(const Triangle* triangles, size_t triangleCount, std::vector<Edge>* edges)
+		{
+			assert(triangles || triangleCount == 0);
+			assert(edges);
+
+			// Triangle sides keyed by their sorted points, so the sides of one edge end up together:
+
+				std::vector<std::pair<unsigned long long, unsigned int>> sides;
+				sides.reserve(3 * triangleCount);
+
+				for (size_t i = 0; i < triangleCount; i++)
+				{
+					unsigned int points[3] = { triangles[i].point0, triangles[i].point1, triangles[i].point2 };
+
+					for (size_t side = 0; side < 3; side++)
+					{
+						unsigned int point0 = points[side];
+						unsigned int point1 = points[(side + 1) % 3];
+
+						if (point0 == point1) continue;
+
+						unsigned long long key = static_cast<unsigned long long>(std::min(point0, point1)) << 32 | std::max(point0, point1);
+
+						sides.push_back(std::make_pair(key, static_cast<unsigned int>(i)));
+					}
+				}
+
+				std::sort(sides.begin(), sides.end());
+
+			edges->clear();
+
+			for (size_t begin = 0, end = 0; begin < sides.size(); begin = end)
+			{
+				while (end < sides.size() && sides[end].first == sides[begin].first) end++;
+
+				Edge edge = {};
+
+				edge.point0 = static_cast<unsigned int>(sides[begin].first >> 32);
+				edge.point1 = static_cast<unsigned int>(sides[begin].first);
+
+				edge.triangle0 = end - begin <= 2 ? sides[begin].second   : NO_TRIANGLE;
+				edge.triangle1 = end - begin <= 2 ? sides[end - 1].second : NO_TRIANGLE;
+
+				edges->push_back(edge);
+			}
+		}
+
+		void Model::renderEdges(const Renderer* renderer, const Matrix& transformation, const Vector* points, size_t pointCount,
+								const Triangle* triangles, size_t triangleCount, const std::vector<Edge>& edges, COLORREF color) const
+		{
+			Transform toWorld = Transform(transformation);
+			Transform toView  = Transform(renderer->getCamera());
+
+			double parallax = renderer->getParallax();
+			double shiftX = renderer->getShift().x();
+			double shiftY = renderer->getShift().y();
+
+			// Projecting every point once, rounded like Renderer::triangle3d() does, so lines meet the filled triangles:
+
+				struct ProjectedPoint
+				{
+					int x, y;
+
+					// View space, edges through the near plane are clipped from it:
+					double view[3];
+				};
+
+				std::vector<ProjectedPoint> projectedPoints = std::vector<ProjectedPoint>(pointCount);
+
+				parallelFor(renderer->getThreadPool(), 0, pointCount, 0, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						double worldPoint[3] = {}, viewPoint[3] = {};
+
+						toWorld.apply(points[i], worldPoint);
+						toView .apply(worldPoint[0], worldPoint[1], worldPoint[2], viewPoint);
+
+						ProjectedPoint& projected = projectedPoints[i];
+
+						projected.view[0] = viewPoint[0];
+						projected.view[1] = viewPoint[1];
+						projected.view[2] = viewPoint[2];
+
+						if (viewPoint[2] < Renderer::NEAR_PLANE_Z) continue;
+
+						projected.x = static_cast<int>(parallax * viewPoint[0] / viewPoint[2] + shiftX);
+						projected.y = static_cast<int>(parallax * viewPoint[1] / viewPoint[2] + shiftY);
+					}
+				});
+
+			// The back-face test of Renderer::triangle3d(), once per triangle:
+
+				std::vector<char> facing = std::vector<char>(triangleCount);
+
+				parallelFor(renderer->getThreadPool(), 0, triangleCount, 0, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						double worldNormal[3] = {}, viewNormal[3] = {};
+
+						toWorld.applyDirection(triangles[i].normal.x(), triangles[i].normal.y(), triangles[i].normal.z(), worldNormal);
+						toView .applyDirection(worldNormal[0], worldNormal[1], worldNormal[2], viewNormal);
+
+						facing[i] = viewNormal[2] > 0;
+					}
+				});
+
+			// Edges with a facing triangle on either side, clipped at the near plane like triangles:
+
+				std::vector<LineSegment> segments;
+				segments.reserve(edges.size());
+
+				for (size_t i = 0; i < edges.size(); i++)
+				{
+					const Edge& edge = edges[i];
+
+					if (edge.triangle0 != NO_TRIANGLE && !facing[edge.triangle0] && !facing[edge.triangle1]) continue;
+
+					ProjectedPoint point0 = projectedPoints[edge.point0];
+					ProjectedPoint point1 = projectedPoints[edge.point1];
+
+					bool inside0 = point0.view[2] >= Renderer::NEAR_PLANE_Z;
+					bool inside1 = point1.view[2] >= Renderer::NEAR_PLANE_Z;
+
+					if (!inside0 && !inside1) continue;
+
+					// The end behind the plane is moved onto it and projected:
+
+						if (!inside0 || !inside1)
+						{
+							ProjectedPoint& outside = inside0 ? point1 : point0;
+							const ProjectedPoint& inside = inside0 ? point0 : point1;
+
+							double t = (Renderer::NEAR_PLANE_Z - inside.view[2]) / (outside.view[2] - inside.view[2]);
+
+							for (size_t axis = 0; axis < 2; axis++) outside.view[axis] = inside.view[axis] + (outside.view[axis] - inside.view[axis]) * t;
+							outside.view[2] = Renderer::NEAR_PLANE_Z;
+
+							outside.x = static_cast<int>(parallax * outside.view[0] / outside.view[2] + shiftX);
+							outside.y = static_cast<int>(parallax * outside.view[1] / outside.view[2] + shiftY);
+						}
+
+					LineSegment segment = { static_cast<double>(point0.x), static_cast<double>(point0.y), point0.view[2],
+											static_cast<double>(point1.x), static_cast<double>(point1.y), point1.view[2] };
+
+					segments.push_back(segment);
+				}
+
+				renderer->lines(segments.data(), segments.size(), color, true);
+		}
+
 	//}
 	//----------------------------------------------------------------------------
 
@@ -0,0 +1,363 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Model cache
+//----------------------------------------------------------------------------
+
+	/*
+		Processed models in an AssetCache, an entry is a header and meshes:
+
+			ModelCacheHeader
+			per mesh: ModelCacheMesh, points as x y z doubles, CachedTriangles, Edges
+
+		The model's entry has one mesh, with the normals, edges and bounds the
+		constructor derives. The levels of detail of buildLods() are another
+		entry, keyed by the same source hash and the level count and reduction.
+		Everything is 8 byte aligned, so the mapped entry is read in place.
+	*/
+
+	const unsigned int MODEL_CACHE_MAGIC = 0x4D445352; // "RSDM"
+
+	// Raised whenever what is stored or how it is derived changes, so old entries are never read:
+	const unsigned int MODEL_CACHE_VERSION = 1;
+
+	struct ModelCacheHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+
+		unsigned long long key;
+		unsigned long long meshCount;
+
+		// Of the model, zero in level of detail entries:
+		double boundsMin[3];
+		double boundsMax[3];
+	};
+
+	struct ModelCacheMesh
+	{
+		unsigned long long pointCount;
+		unsigned long long triangleCount;
+		unsigned long long edgeCount;
+
+		// Level of detail threshold, zero for the model:
+		double maxDiameter;
+	};
+
+	struct CachedTriangle
+	{
+		unsigned int point0, point1, point2;
+
+		COLORREF color;
+
+		double normal[3];
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Keys
+	//----------------------------------------------------------------------------
+
+		bool Model::hashSource(const char* filename, AssetCache* cache)
+		{
+			assert(filename && cache);
+
+			MappedFile source(filename);
+			if (!source.ok()) return false;
+
+			// Importers are chosen by extension, so the same bytes under another one are another model:
+
+				const char* extension = strrchr(filename, '.');
+
+				std::string format = extension ? extension : "";
+				for (size_t i = 0; i < format.size(); i++) format[i] = static_cast<char>(tolower(format[i]));
+
+			cache_		= cache;
+			sourceHash_ = AssetCache::hash(source.getData(), source.getSize());
+			sourceHash_ = AssetCache::hash(format.data(), format.size(), sourceHash_);
+
+			return true;
+		}
+
+		unsigned long long Model::cacheKey(size_t levelCount, double reduction) const
+		{
+			struct Options
+			{
+				unsigned long long version;
+				unsigned long long levelCount;
+				double reduction;
+			};
+
+			Options options = { MODEL_CACHE_VERSION, levelCount, reduction };
+
+			return AssetCache::hash(&options, sizeof(options), sourceHash_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Writing
+	//----------------------------------------------------------------------------
+
+		bool Model::writeCachedMesh(FILE* file, const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount,
+									const std::vector<Edge>& edges, double maxDiameter)
+		{
+			assert(file);
+			assert(points || pointCount == 0);
+			assert(triangles || triangleCount == 0);
+
+			ModelCacheMesh mesh = { pointCount, triangleCount, edges.size(), maxDiameter };
+			if (fwrite(&mesh, sizeof(mesh), 1, file) != 1) return false;
+
+			// Through a small buffer, so large meshes aren't copied whole:
+
+				const size_t BATCH = 4096;
+
+				std::vector<double> coordinates;
+				coordinates.reserve(3 * BATCH);
+
+				for (size_t first = 0; first < pointCount; first += BATCH)
+				{
+					coordinates.clear();
+
+					for (size_t i = first; i < std::min(first + BATCH, pointCount); i++)
+					{
+						coordinates.push_back(points[i].x());
+						coordinates.push_back(points[i].y());
+						coordinates.push_back(points[i].z());
+					}
+
+					if (fwrite(coordinates.data(), sizeof(double), coordinates.size(), file) != coordinates.size()) return false;
+				}
+
+				std::vector<CachedTriangle> cached;
+				cached.reserve(BATCH);
+
+				for (size_t first = 0; first < triangleCount; first += BATCH)
+				{
+					cached.clear();
+
+					for (size_t i = first; i < std::min(first + BATCH, triangleCount); i++)
+					{
+						const Triangle& triangle = triangles[i];
+
+						CachedTriangle entry = { triangle.point0, triangle.point1, triangle.point2, triangle.color,
+												 { triangle.normal.x(), triangle.normal.y(), triangle.normal.z() } };
+
+						cached.push_back(entry);
+					}
+
+					if (fwrite(cached.data(), sizeof(CachedTriangle), cached.size(), file) != cached.size()) return false;
+				}
+
+			return edges.empty() || fwrite(edges.data(), sizeof(Edge), edges.size(), file) == edges.size();
+		}
+
+		void Model::storeCached() const
+		{
+			assert(cache_);
+
+			cache_->store(cacheKey(0, 0), [&](FILE* file)
+			{
+				ModelCacheHeader header = { MODEL_CACHE_MAGIC, MODEL_CACHE_VERSION, cacheKey(0, 0), 1,
+											{ boundsMin_.x(), boundsMin_.y(), boundsMin_.z() },
+											{ boundsMax_.x(), boundsMax_.y(), boundsMax_.z() } };
+
+				if (fwrite(&header, sizeof(header), 1, file) != 1) return false;
+
+				return writeCachedMesh(file, points_, pointCount_, triangles_, triangleCount_, edges_, 0);
+			});
+		}
+
+		void Model::storeCachedLods(size_t levelCount, double reduction) const
+		{
+			assert(cache_);
+
+			cache_->store(cacheKey(levelCount, reduction), [&](FILE* file)
+			{
+				ModelCacheHeader header = { MODEL_CACHE_MAGIC, MODEL_CACHE_VERSION, cacheKey(levelCount, reduction), lods_.size(), {}, {} };
+
+				if (fwrite(&header, sizeof(header), 1, file) != 1) return false;
+
+				for (size_t i = 0; i < lods_.size(); i++)
+				{
+					const Lod& lod = lods_[i];
+
+					if (!writeCachedMesh(file, lod.points, lod.pointCount, lod.triangles, lod.triangleCount, lod.edges, lod.maxDiameter)) return false;
+				}
+
+				return true;
+			});
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Reading
+	//----------------------------------------------------------------------------
+
+		// Entry with the key mapped and its header checked, NULL if there is none:
+
+			MappedFile* Model::openCached(unsigned long long key, const ModelCacheHeader** header) const
+			{
+				assert(cache_ && header);
+
+				MappedFile* entry = cache_->open(key);
+				if (!entry) return NULL;
+
+				*header = reinterpret_cast<const ModelCacheHeader*>(entry->getData());
+
+				if (entry->getSize() < sizeof(ModelCacheHeader) || (*header)->magic != MODEL_CACHE_MAGIC ||
+					(*header)->version != MODEL_CACHE_VERSION || (*header)->key != key)
+				{
+					delete entry;
+					return NULL;
+				}
+
+				return entry;
+			}
+
+		// Arrays allocated like the loaders do, NULL is returned if the entry is cut short or indices are out of range:
+
+			const char* Model::readCachedMesh(const char* position, const char* end, ThreadPool* threadPool, Vector** points, size_t* pointCount,
+											  Triangle** triangles, size_t* triangleCount, std::vector<Edge>* edges, double* maxDiameter)
+			{
+				assert(position && end && points && pointCount && triangles && triangleCount && edges && maxDiameter);
+
+				if (static_cast<size_t>(end - position) < sizeof(ModelCacheMesh)) return NULL;
+
+				const ModelCacheMesh* mesh = reinterpret_cast<const ModelCacheMesh*>(position);
+				position += sizeof(ModelCacheMesh);
+
+				unsigned long long available = end - position;
+
+				if (mesh->pointCount > available / (3 * sizeof(double)) || mesh->triangleCount > available / sizeof(CachedTriangle) ||
+					mesh->edgeCount > available / sizeof(Edge) ||
+					mesh->pointCount * 3 * sizeof(double) + mesh->triangleCount * sizeof(CachedTriangle) + mesh->edgeCount * sizeof(Edge) > available)
+				{
+					return NULL;
+				}
+
+				size_t meshPoints	 = static_cast<size_t>(mesh->pointCount);
+				size_t meshTriangles = static_cast<size_t>(mesh->triangleCount);
+
+				const double*		  coordinates = reinterpret_cast<const double*>(position);
+				const CachedTriangle* cached	  = reinterpret_cast<const CachedTriangle*>(position + meshPoints * 3 * sizeof(double));
+				const Edge*			  cachedEdges = reinterpret_cast<const Edge*>(reinterpret_cast<const char*>(cached + meshTriangles));
+
+				for (size_t i = 0; i < meshTriangles; i++)
+				{
+					if (cached[i].point0 >= meshPoints || cached[i].point1 >= meshPoints || cached[i].point2 >= meshPoints) return NULL;
+				}
+
+				for (size_t i = 0; i < mesh->edgeCount; i++)
+				{
+					const Edge& edge = cachedEdges[i];
+
+					if (edge.point0 >= meshPoints || edge.point1 >= meshPoints) return NULL;
+
+					if ((edge.triangle0 >= meshTriangles && edge.triangle0 != NO_TRIANGLE) ||
+						(edge.triangle1 >= meshTriangles && edge.triangle1 != NO_TRIANGLE)) return NULL;
+				}
+
+				*points = (Vector*) trackedCalloc(std::max<size_t>(meshPoints, 1), sizeof(**points));
+				assert(*points);
+
+				*triangles = (Triangle*) trackedCalloc(std::max<size_t>(meshTriangles, 1), sizeof(**triangles));
+				assert(*triangles);
+
+				Vector* meshPointArray = *points;
+				Triangle* meshTriangleArray = *triangles;
+
+				parallelFor(threadPool, 0, meshPoints, 0, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						meshPointArray[i] = Vector(coordinates[3 * i], coordinates[3 * i + 1], coordinates[3 * i + 2]);
+					}
+				});
+
+				parallelFor(threadPool, 0, meshTriangles, 0, [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+					{
+						Triangle& triangle = meshTriangleArray[i];
+
+						triangle.point0 = cached[i].point0;
+						triangle.point1 = cached[i].point1;
+						triangle.point2 = cached[i].point2;
+						triangle.color	= cached[i].color;
+						triangle.normal = Vector(cached[i].normal[0], cached[i].normal[1], cached[i].normal[2]);
+					}
+				});
+
+				edges->assign(cachedEdges, cachedEdges + mesh->edgeCount);
+
+				*pointCount	   = meshPoints;
+				*triangleCount = meshTriangles;
+				*maxDiameter   = mesh->maxDiameter;
+
+				return reinterpret_cast<const char*>(cachedEdges + mesh->edgeCount);
+			}
+
+		bool Model::loadCached(ThreadPool* threadPool)
+		{
+			const ModelCacheHeader* header = NULL;
+
+			MappedFile* entry = openCached(cacheKey(0, 0), &header);
+			if (!entry) return false;
+
+			double maxDiameter = 0;
+
+			const char* end = header->meshCount == 1 ? readCachedMesh(entry->getData() + sizeof(ModelCacheHeader), entry->getData() + entry->getSize(), threadPool,
+																	  &points_, &pointCount_, &triangles_, &triangleCount_, &edges_, &maxDiameter) : NULL;
+
+			if (end)
+			{
+				boundsMin_ = Vector(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+				boundsMax_ = Vector(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+			}
+
+			delete entry;
+
+			return end != NULL;
+		}
+
+		bool Model::loadCachedLods(size_t levelCount, double reduction)
+		{
+			const ModelCacheHeader* header = NULL;
+
+			MappedFile* entry = openCached(cacheKey(levelCount, reduction), &header);
+			if (!entry) return false;
+
+			const char* position = entry->getData() + sizeof(ModelCacheHeader);
+			const char* end		 = entry->getData() + entry->getSize();
+
+			for (unsigned long long i = 0; i < header->meshCount && position; i++)
+			{
+				Lod lod = {};
+
+				position = readCachedMesh(position, end, NULL, &lod.points, &lod.pointCount, &lod.triangles, &lod.triangleCount, &lod.edges, &lod.maxDiameter);
+
+				if (position) lods_.push_back(lod);
+			}
+
+			delete entry;
+
+			// Levels read before a damaged one are dropped too, they are built again:
+
+				if (!position)
+				{
+					freeLods();
+					return false;
+				}
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,871 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <string>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Point welder
+//----------------------------------------------------------------------------
+
+	/*
+		Open addressing hash of point positions, so equal positions get one
+		point. Only point indices are stored, positions are read from the
+		points array itself.
+	*/
+	class PointWelder
+	{
+		public:
+
+			// Constructor:
+
+				PointWelder();
+
+			// Functions:
+
+				// Index of the point at (x, y, z) among points[0, count), count if it is new and has to be added there:
+				size_t weld(const Vector* points, size_t count, double x, double y, double z);
+
+		private:
+
+			// Point index + 1, 0 for empty slots:
+			std::vector<unsigned int> slots_;
+
+			size_t used_;
+
+			static size_t hash(double x, double y, double z);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		PointWelder::PointWelder() :
+			slots_ (1024),
+			used_  (0)
+		{
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		size_t PointWelder::hash(double x, double y, double z)
+		{
+			double coordinates[3] = { x + 0.0, y + 0.0, z + 0.0 }; // -0 and 0 are the same position
+
+			unsigned long long result = 14695981039346656037ull;
+
+			for (size_t axis = 0; axis < 3; axis++)
+			{
+				unsigned long long bits = 0;
+				memcpy(&bits, &coordinates[axis], sizeof(bits));
+
+				result = (result ^ bits) * 1099511628211ull;
+				result ^= result >> 29;
+			}
+
+			return static_cast<size_t>(result);
+		}
+
+		size_t PointWelder::weld(const Vector* points, size_t count, double x, double y, double z)
+		{
+			assert(points || count == 0);
+
+			// Keeping at most half of the slots used:
+
+				if (2 * (used_ + 1) > slots_.size())
+				{
+					std::vector<unsigned int> oldSlots = std::vector<unsigned int>(2 * slots_.size());
+					oldSlots.swap(slots_);
+
+					for (size_t i = 0; i < oldSlots.size(); i++)
+					{
+						if (oldSlots[i] == 0) continue;
+
+						const Vector& point = points[oldSlots[i] - 1];
+
+						size_t slot = hash(point.x(), point.y(), point.z()) & (slots_.size() - 1);
+						while (slots_[slot] != 0) slot = (slot + 1) & (slots_.size() - 1);
+
+						slots_[slot] = oldSlots[i];
+					}
+				}
+
+			size_t slot = hash(x, y, z) & (slots_.size() - 1);
+
+			for (; slots_[slot] != 0; slot = (slot + 1) & (slots_.size() - 1))
+			{
+				const Vector& point = points[slots_[slot] - 1];
+
+				if (point.x() == x && point.y() == y && point.z() == z) return slots_[slot] - 1;
+			}
+
+			slots_[slot] = static_cast<unsigned int>(count + 1);
+			used_++;
+
+			return count;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Model importers
+//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Building
+	//----------------------------------------------------------------------------
+
+		template <typename Type>
+		Type* Model::grow(Type* array, size_t* capacity, size_t size)
+		{
+			assert(capacity);
+
+			if (size <= *capacity) return array;
+
+			size_t newCapacity = std::max<size_t>(std::max<size_t>(size, 2 * *capacity), 64);
+
+			array = (Type*) trackedRealloc((void*) array, newCapacity * sizeof(*array));
+			assert(array);
+
+			memset((void*) (array + *capacity), 0, (newCapacity - *capacity) * sizeof(*array));
+			*capacity = newCapacity;
+
+			return array;
+		}
+
+		void Model::addTriangle(unsigned int point0, unsigned int point1, unsigned int point2, COLORREF color, size_t* triangleCapacity)
+		{
+			assert(point0 < pointCount_ && point1 < pointCount_ && point2 < pointCount_);
+
+			triangles_ = grow(triangles_, triangleCapacity, triangleCount_ + 1);
+
+			Triangle& triangle = triangles_[triangleCount_++];
+
+			triangle.point0 = point0;
+			triangle.point1 = point1;
+			triangle.point2 = point2;
+			triangle.color	= color;
+		}
+
+		void Model::addPolygon(const unsigned int* polygon, size_t size, COLORREF color, size_t* triangleCapacity, std::vector<unsigned int>* scratch)
+		{
+			assert(polygon);
+			assert(size >= 3);
+			assert(scratch);
+
+			if (size == 3)
+			{
+				addTriangle(polygon[0], polygon[1], polygon[2], color, triangleCapacity);
+				return;
+			}
+
+			// Newell normal, its largest axis is dropped to get 2d coordinates:
+
+				double normal[3] = {};
+
+				for (size_t i = 0; i < size; i++)
+				{
+					const Vector& current = points_[polygon[i]];
+					const Vector& next	  = points_[polygon[(i + 1) % size]];
+
+					normal[0] += (current.y() - next.y()) * (current.z() + next.z());
+					normal[1] += (current.z() - next.z()) * (current.x() + next.x());
+					normal[2] += (current.x() - next.x()) * (current.y() + next.y());
+				}
+
+				size_t dropped = 0;
+				if (fabs(normal[1]) > fabs(normal[dropped])) dropped = 1;
+				if (fabs(normal[2]) > fabs(normal[dropped])) dropped = 2;
+
+				size_t axisU = (dropped + 1) % 3, axisV = (dropped + 2) % 3;
+				double orientation = normal[dropped] >= 0 ? 1 : -1;
+
+				#define COORDINATE(index, axis) (axis == 0 ? points_[index].x() : axis == 1 ? points_[index].y() : points_[index].z())
+				#define CROSS(a, b, c) ((COORDINATE(b, axisU) - COORDINATE(a, axisU)) * (COORDINATE(c, axisV) - COORDINATE(a, axisV)) - \
+										(COORDINATE(b, axisV) - COORDINATE(a, axisV)) * (COORDINATE(c, axisU) - COORDINATE(a, axisU)))
+
+			// Clipping convex corners without other corners inside, a fan is left if none is found:
+
+				std::vector<unsigned int>& remaining = *scratch;
+				remaining.assign(polygon, polygon + size);
+
+				while (remaining.size() > 3)
+				{
+					size_t count = remaining.size();
+					size_t ear = count;
+
+					for (size_t i = 0; i < count && ear == count; i++)
+					{
+						unsigned int previous = remaining[(i + count - 1) % count], current = remaining[i], next = remaining[(i + 1) % count];
+
+						if (CROSS(previous, current, next) * orientation <= 0) continue;
+
+						bool empty = true;
+
+						for (size_t j = 0; j < count && empty; j++)
+						{
+							unsigned int other = remaining[j];
+							if (other == previous || other == current || other == next) continue;
+
+							empty = !(CROSS(previous, current, other) * orientation >= 0 &&
+									  CROSS(current,  next,	   other) * orientation >= 0 &&
+									  CROSS(next,	  previous, other) * orientation >= 0);
+						}
+
+						if (empty) ear = i;
+					}
+
+					if (ear == count) break;
+
+					addTriangle(remaining[(ear + count - 1) % count], remaining[ear], remaining[(ear + 1) % count], color, triangleCapacity);
+					remaining.erase(remaining.begin() + ear);
+				}
+
+				#undef COORDINATE
+				#undef CROSS
+
+				for (size_t i = 1; i + 1 < remaining.size(); i++)
+				{
+					addTriangle(remaining[0], remaining[i], remaining[i + 1], color, triangleCapacity);
+				}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Wavefront OBJ
+	//----------------------------------------------------------------------------
+
+		// Diffuse colors of an .mtl file, missing files leave the default color:
+
+			void readMaterials(const std::string& filename, std::vector<std::pair<std::string, COLORREF> >* materials)
+			{
+				assert(materials);
+
+				FileStream file(filename.c_str(), 1 << 16);
+
+				const char* begin = NULL;
+				const char* end	  = NULL;
+
+				while (file.readLine(&begin, &end))
+				{
+					TextReader reader = TextReader(begin, end, file.getLine());
+
+					const char* keyword = NULL;
+					size_t length = 0;
+
+					if (reader.atLineEnd() || !reader.readWord(&keyword, &length)) continue;
+
+					std::string word = std::string(keyword, length);
+
+					double red = 0, green = 0, blue = 0, opacity = 0;
+
+					if (word == "newmtl" && reader.readWord(&keyword, &length))
+					{
+						materials->push_back(std::make_pair(std::string(keyword, length), (COLORREF) Model::DEFAULT_COLOR));
+					}
+					else if (word == "Kd" && !materials->empty() && reader.readDouble(&red) && reader.readDouble(&green) && reader.readDouble(&blue))
+					{
+						materials->back().second = (materials->back().second & 0xFF000000) |
+												   RGB(std::min(std::max(red,	0.0), 1.0) * 255,
+													   std::min(std::max(green, 0.0), 1.0) * 255,
+													   std::min(std::max(blue,	0.0), 1.0) * 255);
+					}
+					else if ((word == "d" || word == "Tr") && !materials->empty() && reader.readDouble(&opacity))
+					{
+						// "Tr" is the transparency:
+						materials->back().second = transparentColor(materials->back().second, word == "d" ? opacity : 1 - opacity);
+					}
+				}
+			}
+
+		bool Model::importObj(const char* filename)
+		{
+			assert(filename);
+
+			FileStream file(filename);
+			if (!file.ok()) return fail(0, "cannot open the file");
+
+			size_t pointCapacity = 0, triangleCapacity = 0;
+
+			PointWelder welder;
+
+			// Model point of every "v" line:
+			std::vector<unsigned int> objPoints;
+
+			std::vector<unsigned int> polygon, scratch;
+
+			std::vector<std::pair<std::string, COLORREF> > materials;
+			COLORREF color = DEFAULT_COLOR;
+
+			const char* begin = NULL;
+			const char* end	  = NULL;
+
+			while (file.readLine(&begin, &end))
+			{
+				TextReader reader = TextReader(begin, end, file.getLine());
+
+				const char* keyword = NULL;
+				size_t length = 0;
+
+				if (reader.atLineEnd() || !reader.readWord(&keyword, &length)) continue;
+
+				if (length == 1 && keyword[0] == 'v')
+				{
+					double x = 0, y = 0, z = 0;
+
+					if (!reader.readDouble(&x) || !reader.readDouble(&y) || !reader.readDouble(&z))
+					{
+						return fail(file.getLine(), "expected three vertex coordinates");
+					}
+
+					size_t point = welder.weld(points_, pointCount_, x, y, z);
+
+					if (point == pointCount_)
+					{
+						points_ = grow(points_, &pointCapacity, pointCount_ + 1);
+						points_[pointCount_++] = Vector(x, y, z);
+					}
+
+					objPoints.push_back(static_cast<unsigned int>(point));
+				}
+				else if (length == 1 && keyword[0] == 'f')
+				{
+					polygon.clear();
+
+					// Only the position of "v/vt/vn", negative indices count back from the last vertex:
+
+						const char* vertex = NULL;
+						size_t vertexLength = 0;
+
+						while (!reader.atLineEnd() && reader.readWord(&vertex, &vertexLength))
+						{
+							bool relative = vertex[0] == '-';
+
+							TextReader indexReader = TextReader(vertex + relative, vertex + vertexLength, file.getLine());
+
+							unsigned long long index = 0;
+
+							if (!indexReader.readUnsigned(&index) || index == 0 || index > objPoints.size())
+							{
+								return fail(file.getLine(), "vertex index out of range");
+							}
+
+							polygon.push_back(objPoints[relative ? objPoints.size() - index : index - 1]);
+						}
+
+					if (polygon.size() < 3) return fail(file.getLine(), "a face needs at least three vertices");
+
+					addPolygon(polygon.data(), polygon.size(), color, &triangleCapacity, &scratch);
+				}
+				else if (std::string(keyword, length) == "mtllib" && reader.readWord(&keyword, &length))
+				{
+					// Relative to the directory of the .obj file:
+
+						std::string directory = filename;
+						directory.erase(directory.find_last_of("/\\") == std::string::npos ? 0 : directory.find_last_of("/\\") + 1);
+
+						readMaterials(directory + std::string(keyword, length), &materials);
+				}
+				else if (std::string(keyword, length) == "usemtl" && reader.readWord(&keyword, &length))
+				{
+					color = DEFAULT_COLOR;
+
+					for (size_t i = 0; i < materials.size(); i++)
+					{
+						if (materials[i].first == std::string(keyword, length)) color = materials[i].second;
+					}
+				}
+			}
+
+			points_	   = grow(points_,	  &pointCapacity,	 1);
+			triangles_ = grow(triangles_, &triangleCapacity, 1);
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ STL
+	//----------------------------------------------------------------------------
+
+		// Binary files may start with "solid" too, so only the size tells them apart:
+
+			bool Model::importStl(const char* filename)
+			{
+				assert(filename);
+
+				FileStream file(filename);
+				if (!file.ok()) return fail(0, "cannot open the file");
+
+				char header[80] = "";
+				unsigned int count = 0;
+
+				bool binary = file.read(header, sizeof(header)) && file.read(&count, sizeof(count)) &&
+							  file.getSize() == sizeof(header) + sizeof(count) + 50ull * count;
+
+				if (!binary) return importStlText(filename);
+
+				size_t pointCapacity = 0, triangleCapacity = 0;
+				triangles_ = grow(triangles_, &triangleCapacity, count);
+
+				PointWelder welder;
+
+				for (size_t i = 0; i < count; i++)
+				{
+					// Normal, three corners and a 16 bit attribute:
+
+						unsigned char facet[50] = {};
+						if (!file.read(facet, sizeof(facet))) return fail(0, "the file ends before the last triangle");
+
+						float coordinates[12] = {};
+						memcpy(coordinates, facet, sizeof(coordinates));
+
+						unsigned short attribute = static_cast<unsigned short>(facet[48] | facet[49] << 8);
+
+					unsigned int corners[3] = {};
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						const float* point = coordinates + 3 + 3 * corner;
+
+						size_t index = welder.weld(points_, pointCount_, point[0], point[1], point[2]);
+
+						if (index == pointCount_)
+						{
+							points_ = grow(points_, &pointCapacity, pointCount_ + 1);
+							points_[pointCount_++] = Vector(point[0], point[1], point[2]);
+						}
+
+						corners[corner] = static_cast<unsigned int>(index);
+					}
+
+					// The top bit marks a 5-5-5 color with blue in the low bits:
+
+						COLORREF color = DEFAULT_COLOR;
+
+						if (attribute & 0x8000)
+						{
+							color = RGB(((attribute >> 10) & 0x1F) * 255 / 31, ((attribute >> 5) & 0x1F) * 255 / 31, (attribute & 0x1F) * 255 / 31);
+						}
+
+					addTriangle(corners[0], corners[1], corners[2], color, &triangleCapacity);
+				}
+
+				points_	   = grow(points_,	  &pointCapacity,	 1);
+				triangles_ = grow(triangles_, &triangleCapacity, 1);
+
+				return true;
+			}
+
+		bool Model::importStlText(const char* filename)
+		{
+			assert(filename);
+
+			FileStream file(filename);
+			if (!file.ok()) return fail(0, "cannot open the file");
+
+			size_t pointCapacity = 0, triangleCapacity = 0;
+
+			PointWelder welder;
+
+			std::vector<unsigned int> polygon, scratch;
+
+			const char* begin = NULL;
+			const char* end	  = NULL;
+
+			while (file.readLine(&begin, &end))
+			{
+				TextReader reader = TextReader(begin, end, file.getLine());
+
+				const char* keyword = NULL;
+				size_t length = 0;
+
+				if (reader.atLineEnd() || !reader.readWord(&keyword, &length)) continue;
+
+				std::string word = std::string(keyword, length);
+
+				if (word == "facet") polygon.clear();
+				else if (word == "vertex")
+				{
+					double x = 0, y = 0, z = 0;
+
+					if (!reader.readDouble(&x) || !reader.readDouble(&y) || !reader.readDouble(&z))
+					{
+						return fail(file.getLine(), "expected three vertex coordinates");
+					}
+
+					size_t index = welder.weld(points_, pointCount_, x, y, z);
+
+					if (index == pointCount_)
+					{
+						points_ = grow(points_, &pointCapacity, pointCount_ + 1);
+						points_[pointCount_++] = Vector(x, y, z);
+					}
+
+					polygon.push_back(static_cast<unsigned int>(index));
+				}
+				else if (word == "endfacet")
+				{
+					if (polygon.size() < 3) return fail(file.getLine(), "a facet needs at least three vertices");
+
+					addPolygon(polygon.data(), polygon.size(), DEFAULT_COLOR, &triangleCapacity, &scratch);
+				}
+			}
+
+			points_	   = grow(points_,	  &pointCapacity,	 1);
+			triangles_ = grow(triangles_, &triangleCapacity, 1);
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ PLY
+	//----------------------------------------------------------------------------
+
+		struct PlyProperty
+		{
+			enum Role { OTHER, X, Y, Z, RED, GREEN, BLUE, INDICES };
+
+			// Size in bytes of the value and of the list count, the count is 0 for scalars:
+			unsigned int size, countSize;
+
+			bool floating, isSigned, countSigned;
+
+			Role role;
+		};
+
+		struct PlyElement
+		{
+			enum Kind { OTHER, VERTEX, FACE };
+
+			Kind kind;
+			unsigned long long count;
+
+			std::vector<PlyProperty> properties;
+		};
+
+		// Size and kind of a PLY type name, false for unknown names:
+
+			bool plyType(const std::string& name, unsigned int* size, bool* floating, bool* isSigned)
+			{
+				static const struct { const char* name; unsigned int size; bool floating, isSigned; } TYPES[] =
+				{
+					{ "char",  1, false, true  }, { "int8",	   1, false, true  }, { "uchar",  1, false, false }, { "uint8",  1, false, false },
+					{ "short", 2, false, true  }, { "int16",   2, false, true  }, { "ushort", 2, false, false }, { "uint16", 2, false, false },
+					{ "int",   4, false, true  }, { "int32",   4, false, true  }, { "uint",	  4, false, false }, { "uint32", 4, false, false },
+					{ "float", 4, true,	 true  }, { "float32", 4, true,	 true  }, { "double", 8, true,	true  }, { "float64", 8, true,	true  }
+				};
+
+				for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); i++)
+				{
+					if (name != TYPES[i].name) continue;
+
+					*size	  = TYPES[i].size;
+					*floating = TYPES[i].floating;
+					*isSigned = TYPES[i].isSigned;
+
+					return true;
+				}
+
+				return false;
+			}
+
+		// One value, from the current line of an ASCII file or the stream of a binary one:
+
+			bool readPlyValue(FileStream* file, TextReader* line, bool bigEndian, unsigned int size, bool floating, bool isSigned, double* value)
+			{
+				assert(file);
+				assert(value);
+
+				if (line) return line->readDouble(value);
+
+				unsigned char bytes[8] = {};
+				if (!file->read(bytes, size)) return false;
+
+				if (bigEndian) std::reverse(bytes, bytes + size);
+
+				if (floating)
+				{
+					if (size == 4) { float result = 0; memcpy(&result, bytes, 4); *value = result; }
+					else		   { double result = 0; memcpy(&result, bytes, 8); *value = result; }
+
+					return true;
+				}
+
+				unsigned long long bits = 0;
+				memcpy(&bits, bytes, size); // Little-endian host
+
+				if (isSigned && size < 8 && (bits >> (8 * size - 1)) & 1) bits |= ~0ull << (8 * size);
+
+				*value = isSigned ? static_cast<double>(static_cast<long long>(bits)) : static_cast<double>(bits);
+
+				return true;
+			}
+
+		bool Model::importPly(const char* filename)
+		{
+			assert(filename);
+
+			FileStream file(filename);
+			if (!file.ok()) return fail(0, "cannot open the file");
+
+			const char* begin = NULL;
+			const char* end	  = NULL;
+
+			// Header:
+
+				if (!file.readLine(&begin, &end) || std::string(begin, end).compare(0, 3, "ply") != 0) return fail(1, "not a PLY file");
+
+				bool ascii = false, bigEndian = false;
+
+				std::vector<PlyElement> elements;
+
+				for (;;)
+				{
+					if (!file.readLine(&begin, &end)) return fail(file.getLine(), "the header has no end_header");
+
+					TextReader reader = TextReader(begin, end, file.getLine());
+
+					const char* word = NULL;
+					size_t length = 0;
+
+					if (reader.atLineEnd() || !reader.readWord(&word, &length)) continue;
+
+					std::string keyword = std::string(word, length);
+
+					if (keyword == "end_header") break;
+
+					if (keyword == "format")
+					{
+						if (!reader.readWord(&word, &length)) return fail(file.getLine(), "expected a format");
+
+						std::string format = std::string(word, length);
+
+						ascii	  = format == "ascii";
+						bigEndian = format == "binary_big_endian";
+
+						if (!ascii && !bigEndian && format != "binary_little_endian") return fail(file.getLine(), "unknown format");
+					}
+					else if (keyword == "element")
+					{
+						PlyElement element = {};
+
+						if (!reader.readWord(&word, &length) || !reader.readUnsigned(&element.count)) return fail(file.getLine(), "expected an element name and count");
+
+						std::string name = std::string(word, length);
+
+						element.kind = name == "vertex" ? PlyElement::VERTEX : name == "face" ? PlyElement::FACE : PlyElement::OTHER;
+						elements.push_back(element);
+					}
+					else if (keyword == "property")
+					{
+						if (elements.empty()) return fail(file.getLine(), "a property before the first element");
+
+						PlyProperty property = {};
+
+						if (!reader.readWord(&word, &length)) return fail(file.getLine(), "expected a property type");
+
+						if (std::string(word, length) == "list")
+						{
+							bool countFloating = false;
+
+							if (!reader.readWord(&word, &length) || !plyType(std::string(word, length), &property.countSize, &countFloating, &property.countSigned) ||
+								countFloating)
+							{
+								return fail(file.getLine(), "unknown list count type");
+							}
+
+							if (!reader.readWord(&word, &length)) return fail(file.getLine(), "expected a property type");
+						}
+
+						if (!plyType(std::string(word, length), &property.size, &property.floating, &property.isSigned))
+						{
+							return fail(file.getLine(), "unknown property type");
+						}
+
+						if (!reader.readWord(&word, &length)) return fail(file.getLine(), "expected a property name");
+
+						std::string name = std::string(word, length);
+
+						if (property.countSize)
+						{
+							if (name == "vertex_indices" || name == "vertex_index") property.role = PlyProperty::INDICES;
+						}
+						else if (name == "x")						  property.role = PlyProperty::X;
+						else if (name == "y")						  property.role = PlyProperty::Y;
+						else if (name == "z")						  property.role = PlyProperty::Z;
+						else if (name == "red"	 || name == "diffuse_red")	 property.role = PlyProperty::RED;
+						else if (name == "green" || name == "diffuse_green") property.role = PlyProperty::GREEN;
+						else if (name == "blue"	 || name == "diffuse_blue")	 property.role = PlyProperty::BLUE;
+
+						elements.back().properties.push_back(property);
+					}
+				}
+
+			// Arrays, vertices are known in advance and faces have at least one triangle each:
+
+				size_t vertexCount = 0, pointCapacity = 0, triangleCapacity = 0;
+
+				for (size_t i = 0; i < elements.size(); i++)
+				{
+					if (elements[i].kind == PlyElement::VERTEX) vertexCount	   += static_cast<size_t>(elements[i].count);
+					if (elements[i].kind == PlyElement::FACE)	triangleCapacity += static_cast<size_t>(elements[i].count);
+				}
+
+				points_	   = grow(points_, &pointCapacity, vertexCount);
+				triangles_ = (Triangle*) trackedCalloc(std::max<size_t>(triangleCapacity, 1), sizeof(*triangles_));
+				assert(triangles_);
+
+				// Face colors default to the average of vertex colors when there are some:
+				std::vector<COLORREF> vertexColors;
+
+				std::vector<unsigned int> polygon, scratch;
+
+			// Data:
+
+				size_t vertex = 0;
+
+				for (size_t i = 0; i < elements.size(); i++)
+				{
+					const PlyElement& element = elements[i];
+
+					for (unsigned long long instance = 0; instance < element.count; instance++)
+					{
+						TextReader line = TextReader(NULL, NULL);
+
+						if (ascii)
+						{
+							if (!file.readLine(&begin, &end)) return fail(file.getLine(), "the file ends before the last element");
+
+							line = TextReader(begin, end, file.getLine());
+						}
+
+						double coordinates[3] = {}, channels[3] = { -1, -1, -1 };
+						polygon.clear();
+
+						for (size_t j = 0; j < element.properties.size(); j++)
+						{
+							const PlyProperty& property = element.properties[j];
+
+							double value = 0;
+
+							if (property.countSize == 0)
+							{
+								if (!readPlyValue(&file, ascii ? &line : NULL, bigEndian, property.size, property.floating, property.isSigned, &value))
+								{
+									return fail(file.getLine(), "the file ends before the last element");
+								}
+
+								if (property.role >= PlyProperty::X && property.role <= PlyProperty::Z)	 coordinates[property.role - PlyProperty::X] = value;
+
+								if (property.role >= PlyProperty::RED && property.role <= PlyProperty::BLUE)
+								{
+									channels[property.role - PlyProperty::RED] = property.floating ? value * 255 : value;
+								}
+
+								continue;
+							}
+
+							double count = 0;
+
+							if (!readPlyValue(&file, ascii ? &line : NULL, bigEndian, property.countSize, false, property.countSigned, &count) || count < 0)
+							{
+								return fail(file.getLine(), "bad list count");
+							}
+
+							for (size_t item = 0; item < static_cast<size_t>(count); item++)
+							{
+								if (!readPlyValue(&file, ascii ? &line : NULL, bigEndian, property.size, property.floating, property.isSigned, &value))
+								{
+									return fail(file.getLine(), "the file ends before the last element");
+								}
+
+								if (property.role != PlyProperty::INDICES) continue;
+
+								if (value < 0 || value >= vertexCount) return fail(file.getLine(), "vertex index out of range");
+
+								polygon.push_back(static_cast<unsigned int>(value));
+							}
+						}
+
+						bool colored = channels[0] >= 0 && channels[1] >= 0 && channels[2] >= 0;
+
+						COLORREF color = colored ? RGB(std::min(channels[0], 255.0), std::min(channels[1], 255.0), std::min(channels[2], 255.0)) :
+												   DEFAULT_COLOR;
+
+						if (element.kind == PlyElement::VERTEX)
+						{
+							points_[vertex++] = Vector(coordinates[0], coordinates[1], coordinates[2]);
+
+							if (colored) vertexColors.resize(vertexCount, (COLORREF) DEFAULT_COLOR);
+							if (!vertexColors.empty()) vertexColors[vertex - 1] = color;
+						}
+
+						if (element.kind == PlyElement::FACE && polygon.size() >= 3)
+						{
+							if (!colored && !vertexColors.empty())
+							{
+								unsigned int sums[3] = {};
+
+								for (size_t corner = 0; corner < polygon.size(); corner++)
+								{
+									sums[0] += GetRValue(vertexColors[polygon[corner]]);
+									sums[1] += GetGValue(vertexColors[polygon[corner]]);
+									sums[2] += GetBValue(vertexColors[polygon[corner]]);
+								}
+
+								color = RGB(sums[0] / polygon.size(), sums[1] / polygon.size(), sums[2] / polygon.size());
+							}
+
+							pointCount_ = vertexCount;
+
+							// Faces before vertices can't be clipped as their points aren't read yet:
+
+								if (vertex == vertexCount) addPolygon(polygon.data(), polygon.size(), color, &triangleCapacity, &scratch);
+								else
+								{
+									for (size_t corner = 1; corner + 1 < polygon.size(); corner++)
+									{
+										addTriangle(polygon[0], polygon[corner], polygon[corner + 1], color, &triangleCapacity);
+									}
+								}
+						}
+					}
+				}
+
+			pointCount_ = vertexCount;
+
+			points_ = grow(points_, &pointCapacity, 1);
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
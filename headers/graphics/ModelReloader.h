@@ -0,0 +1,571 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <mutex>
+	#include <string>
+	#include <thread>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Model reloader
+//----------------------------------------------------------------------------
+
+	struct ModelReloaderSettings
+	{
+		// Used by the reloads, both may be NULL:
+		ThreadPool* threadPool;
+		AssetCache* cache;
+
+		// A file is loaded when it hasn't changed for that long, editors save in several writes:
+		unsigned int settleMilliseconds;
+
+		// update() calls after which a frame can't read a model's old data any more,
+		// 0 if every frame is finished by then, as it is after Renderer::finishRendering():
+		unsigned int framesInFlight;
+	};
+
+	/*
+		Loads watched model files again when they change, without making the
+		render loop wait:
+
+			ModelReloader reloader(settings);
+			reloader.watch(&model, "model.obj");
+
+			while (...)
+			{
+				renderer.startRendering();
+				model.render(&renderer, transformation);
+				renderer.finishRendering();
+
+				reloader.update();
+			}
+
+		A thread waits for changes of the directories of watched files, then
+		loads the new model, levels of detail like buildLods() was last asked
+		for, and queues it. update() swaps queued models into the watched ones
+		between frames, so pointers to them stay valid, and gives the old data
+		back to the thread to free once no frame can read it. It only ever
+		tries the lock, if the thread holds it the models are swapped at the
+		next update(). A file that fails to load leaves the model as it was,
+		what went wrong comes back through update() like the swapped models.
+
+		The thread never reads the watched models, their level of detail
+		options are copied by watch() and update() on the render thread.
+
+		Scenes keep the bounds models had when added, move() objects of the
+		reloaded models to their own transformation to update them.
+	*/
+	class ModelReloader
+	{
+		public:
+
+			// Constructor && destructor:
+
+				ModelReloader(const ModelReloaderSettings& settings);
+				~ModelReloader();
+
+			// Functions:
+
+				// The model stays watched for the reloader's lifetime, so it has to outlive it:
+				void watch(Model* model, const char* filename);
+
+				// From the render thread between finishRendering() and the next startRendering(), returns the models swapped.
+				// Messages of failed reloads and directories that can't be watched since the last call go to errors:
+				size_t update(std::vector<const Model*>* reloaded = NULL, std::vector<std::string>* errors = NULL);
+
+		private:
+
+			struct WatchedFile
+			{
+				Model* model;
+
+				std::string filename;
+
+				// Split from filename, the directory with its separator or empty:
+				std::string directory;
+				std::string name;
+
+				// GetTickCount64() of the last change not loaded yet, 0 if there is none:
+				unsigned long long changed;
+
+				// The model's buildLods() options as of the last update(), reloads build the same levels:
+				size_t lodCount;
+				double lodReduction;
+			};
+
+			// A directory with a change notification pending, the watcher thread's only:
+			struct WatchedDirectory
+			{
+				std::string path;
+
+				HANDLE handle;
+				HANDLE event;
+
+				OVERLAPPED overlapped;
+
+				// FILE_NOTIFY_INFORMATION records, which have to be DWORD aligned:
+				std::vector<DWORD> buffer;
+			};
+
+			struct LoadedModel
+			{
+				Model* target;
+				Model* model;
+			};
+
+			struct RetiredModel
+			{
+				Model* model;
+				unsigned long long frame;
+			};
+
+			// Only the watcher thread waits on more than its own events, at most MAXIMUM_WAIT_OBJECTS in all:
+			static const size_t MAX_DIRECTORIES = MAXIMUM_WAIT_OBJECTS - 2;
+
+			static const size_t NOTIFY_BUFFER_SIZE = 1 << 14;
+
+			ModelReloaderSettings settings_;
+
+			// Guards everything below but the events and the thread:
+			std::mutex mutex_;
+
+			std::vector<WatchedFile> files_;
+
+			std::vector<LoadedModel> loaded_;
+			std::vector<RetiredModel> retired_;
+			std::vector<Model*> reclaimed_;
+
+			std::vector<std::string> errors_;
+
+			unsigned long long frame_;
+
+			HANDLE stopEvent_;
+			HANDLE wakeEvent_;
+
+			std::thread watcher_;
+
+			void watchChanges();
+
+			bool listen(WatchedDirectory* directory);
+			void readChanges(WatchedDirectory* directory);
+
+			void reloadSettled(unsigned long long now, DWORD* timeout);
+			void reload(const WatchedFile& file);
+
+			// From the watcher thread without the lock held:
+			void addError(const char* message);
+
+			ModelReloader(const ModelReloader&);
+			ModelReloader& operator=(const ModelReloader&);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		ModelReloader::ModelReloader(const ModelReloaderSettings& settings) :
+			settings_  (settings),
+			mutex_	   (),
+			files_	   (),
+			loaded_	   (),
+			retired_   (),
+			reclaimed_ (),
+			errors_	   (),
+			frame_	   (0),
+			stopEvent_ (CreateEventA(NULL, TRUE,  FALSE, NULL)),
+			wakeEvent_ (CreateEventA(NULL, FALSE, FALSE, NULL)),
+			watcher_   ()
+		{
+			watcher_ = std::thread(&ModelReloader::watchChanges, this);
+		}
+
+		ModelReloader::~ModelReloader()
+		{
+			SetEvent(stopEvent_);
+			watcher_.join();
+
+			for (size_t i = 0; i < loaded_.size();	  i++) delete loaded_[i].model;
+			for (size_t i = 0; i < retired_.size();	  i++) delete retired_[i].model;
+			for (size_t i = 0; i < reclaimed_.size(); i++) delete reclaimed_[i];
+
+			CloseHandle(stopEvent_);
+			CloseHandle(wakeEvent_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		void ModelReloader::watch(Model* model, const char* filename)
+		{
+			assert(model && filename);
+
+			WatchedFile file = { model, filename, "", "", 0, model->getRequestedLodCount(), model->getLodReduction() };
+
+			size_t separator = file.filename.find_last_of("/\\");
+
+			if (separator != std::string::npos)
+			{
+				file.directory = file.filename.substr(0, separator + 1);
+				file.name	   = file.filename.substr(separator + 1);
+			}
+			else file.name = file.filename;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+
+				files_.push_back(file);
+			}
+
+			// The thread listens to new directories itself:
+			SetEvent(wakeEvent_);
+		}
+
+		size_t ModelReloader::update(std::vector<const Model*>* reloaded /*= NULL*/, std::vector<std::string>* errors /*= NULL*/)
+		{
+			std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+			if (!lock.owns_lock()) return 0;
+
+			frame_++;
+
+			size_t swapped = loaded_.size();
+
+			// Thresholds set on the levels both have are kept:
+
+				for (size_t i = 0; i < loaded_.size(); i++)
+				{
+					Model* target = loaded_[i].target;
+					Model* model  = loaded_[i].model;
+
+					for (size_t level = 1; level < std::min(target->getLodCount(), model->getLodCount()); level++)
+					{
+						model->setLodThreshold(level, target->getLodThreshold(level));
+					}
+
+					target->swap(*model);
+
+					RetiredModel retired = { model, frame_ };
+					retired_.push_back(retired);
+
+					if (reloaded) reloaded->push_back(target);
+				}
+
+				loaded_.clear();
+
+			// Options the render thread may have changed since, for the next reloads:
+
+				for (size_t i = 0; i < files_.size(); i++)
+				{
+					files_[i].lodCount	   = files_[i].model->getRequestedLodCount();
+					files_[i].lodReduction = files_[i].model->getLodReduction();
+				}
+
+				if (errors) errors->insert(errors->end(), errors_.begin(), errors_.end());
+
+				errors_.clear();
+
+			// Freed by the watcher thread:
+
+				size_t kept = 0;
+
+				for (size_t i = 0; i < retired_.size(); i++)
+				{
+					if (frame_ - retired_[i].frame >= settings_.framesInFlight) reclaimed_.push_back(retired_[i].model);
+					else retired_[kept++] = retired_[i];
+				}
+
+				retired_.resize(kept);
+
+				if (!reclaimed_.empty()) SetEvent(wakeEvent_);
+
+			return swapped;
+		}
+
+		void ModelReloader::watchChanges()
+		{
+			std::vector<WatchedDirectory*> directories;
+
+			DWORD timeout = INFINITE;
+
+			while (true)
+			{
+				std::vector<HANDLE> events;
+
+				events.push_back(stopEvent_);
+				events.push_back(wakeEvent_);
+
+				for (size_t i = 0; i < directories.size(); i++) events.push_back(directories[i]->event);
+
+				DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, timeout);
+
+				if (signaled == WAIT_OBJECT_0) break;
+
+				if (signaled == WAIT_OBJECT_0 + 1)
+				{
+					// Old data update() is done with:
+
+						std::vector<Model*> reclaimed;
+
+						{
+							std::lock_guard<std::mutex> lock(mutex_);
+
+							reclaimed.swap(reclaimed_);
+						}
+
+						for (size_t i = 0; i < reclaimed.size(); i++) delete reclaimed[i];
+
+					// Directories of files watched since:
+
+						std::vector<std::string> paths;
+
+						{
+							std::lock_guard<std::mutex> lock(mutex_);
+
+							for (size_t i = 0; i < files_.size(); i++) paths.push_back(files_[i].directory);
+						}
+
+						for (size_t i = 0; i < paths.size(); i++)
+						{
+							bool listening = false;
+
+							for (size_t j = 0; j < directories.size() && !listening; j++) listening = _stricmp(directories[j]->path.c_str(), paths[i].c_str()) == 0;
+
+							if (listening) continue;
+
+							if (directories.size() == MAX_DIRECTORIES)
+							{
+								char message[MAX_PATH + 128] = "";
+								snprintf(message, sizeof(message), "ModelReloader: more than %u directories, %s is not watched", (unsigned int) MAX_DIRECTORIES, paths[i].c_str());
+
+								addError(message);
+								continue;
+							}
+
+							WatchedDirectory* directory = new WatchedDirectory();
+							directory->path = paths[i];
+
+							if (listen(directory)) directories.push_back(directory);
+							else delete directory;
+						}
+				}
+				else if (signaled > WAIT_OBJECT_0 + 1 && signaled < WAIT_OBJECT_0 + events.size())
+				{
+					readChanges(directories[signaled - WAIT_OBJECT_0 - 2]);
+				}
+
+				reloadSettled(GetTickCount64(), &timeout);
+			}
+
+			for (size_t i = 0; i < directories.size(); i++)
+			{
+				CancelIoEx(directories[i]->handle, &directories[i]->overlapped);
+
+				DWORD unused = 0;
+				GetOverlappedResult(directories[i]->handle, &directories[i]->overlapped, &unused, TRUE);
+
+				CloseHandle(directories[i]->handle);
+				CloseHandle(directories[i]->event);
+
+				delete directories[i];
+			}
+		}
+
+		bool ModelReloader::listen(WatchedDirectory* directory)
+		{
+			assert(directory);
+
+			const char* path = directory->path.empty() ? "." : directory->path.c_str();
+
+			directory->handle = CreateFileA(path, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+											FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+			char message[MAX_PATH + 128] = "";
+
+			if (directory->handle == INVALID_HANDLE_VALUE)
+			{
+				snprintf(message, sizeof(message), "ModelReloader: cannot open %s, error %u", path, (unsigned int) GetLastError());
+
+				addError(message);
+				return false;
+			}
+
+			directory->event = CreateEventA(NULL, TRUE, FALSE, NULL);
+			directory->buffer.resize(NOTIFY_BUFFER_SIZE / sizeof(DWORD));
+
+			memset(&directory->overlapped, 0, sizeof(directory->overlapped));
+			directory->overlapped.hEvent = directory->event;
+
+			// Saving in place changes the last write time, saving through a temporary file renames it over the model:
+
+				if (!ReadDirectoryChangesW(directory->handle, directory->buffer.data(), NOTIFY_BUFFER_SIZE, FALSE,
+										   FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE,
+										   NULL, &directory->overlapped, NULL))
+				{
+					snprintf(message, sizeof(message), "ModelReloader: cannot watch %s, error %u", path, (unsigned int) GetLastError());
+					addError(message);
+
+					CloseHandle(directory->handle);
+					CloseHandle(directory->event);
+
+					return false;
+				}
+
+			return true;
+		}
+
+		void ModelReloader::readChanges(WatchedDirectory* directory)
+		{
+			assert(directory);
+
+			DWORD size = 0;
+			bool read = GetOverlappedResult(directory->handle, &directory->overlapped, &size, FALSE) != 0;
+
+			unsigned long long now = GetTickCount64();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+
+				// No records when the buffer overflowed, then every file there may have changed:
+
+					if (!read || size == 0)
+					{
+						for (size_t i = 0; i < files_.size(); i++)
+						{
+							if (_stricmp(files_[i].directory.c_str(), directory->path.c_str()) == 0) files_[i].changed = now;
+						}
+					}
+
+				const char* record = reinterpret_cast<const char*>(directory->buffer.data());
+
+				while (read && size > 0)
+				{
+					const FILE_NOTIFY_INFORMATION* change = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+
+					char name[MAX_PATH] = "";
+
+					int length = WideCharToMultiByte(CP_ACP, 0, change->FileName, static_cast<int>(change->FileNameLength / sizeof(WCHAR)),
+													 name, sizeof(name) - 1, NULL, NULL);
+					name[std::max(length, 0)] = '\0';
+
+					for (size_t i = 0; i < files_.size(); i++)
+					{
+						if (_stricmp(files_[i].directory.c_str(), directory->path.c_str()) == 0 &&
+							_stricmp(files_[i].name.c_str(), name) == 0)
+						{
+							files_[i].changed = now;
+						}
+					}
+
+					if (change->NextEntryOffset == 0) break;
+					record += change->NextEntryOffset;
+				}
+			}
+
+			ResetEvent(directory->event);
+
+			memset(&directory->overlapped, 0, sizeof(directory->overlapped));
+			directory->overlapped.hEvent = directory->event;
+
+			ReadDirectoryChangesW(directory->handle, directory->buffer.data(), NOTIFY_BUFFER_SIZE, FALSE,
+								  FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE,
+								  NULL, &directory->overlapped, NULL);
+		}
+
+		void ModelReloader::reloadSettled(unsigned long long now, DWORD* timeout)
+		{
+			assert(timeout);
+
+			std::vector<WatchedFile> settled;
+
+			*timeout = INFINITE;
+
+			// Files quiet for long enough, the wait ends when the next one will be:
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+
+					for (size_t i = 0; i < files_.size(); i++)
+					{
+						if (files_[i].changed == 0) continue;
+
+						unsigned long long quiet = now - files_[i].changed;
+
+						if (quiet >= settings_.settleMilliseconds)
+						{
+							files_[i].changed = 0;
+							settled.push_back(files_[i]);
+						}
+						else *timeout = std::min<DWORD>(*timeout, static_cast<DWORD>(settings_.settleMilliseconds - quiet));
+					}
+				}
+
+			for (size_t i = 0; i < settled.size(); i++) reload(settled[i]);
+		}
+
+		void ModelReloader::reload(const WatchedFile& file)
+		{
+			Model* target = file.model;
+
+			Model* model = new Model(file.filename.c_str(), settings_.threadPool, settings_.cache);
+
+			if (model->getError())
+			{
+				std::string message = "ModelReloader: " + file.filename + ":" + std::to_string(model->getErrorLine()) + ": " + model->getError() + ", keeping the loaded model";
+				addError(message.c_str());
+
+				delete model;
+				return;
+			}
+
+			if (file.lodCount > 0) model->buildLods(file.lodCount, file.lodReduction);
+
+			// A model loaded before and not swapped in yet is replaced, and freed here rather than under the lock:
+
+				Model* replaced = NULL;
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+
+					for (size_t i = 0; i < loaded_.size() && !replaced; i++)
+					{
+						if (loaded_[i].target == target)
+						{
+							replaced = loaded_[i].model;
+							loaded_[i].model = model;
+						}
+					}
+
+					if (!replaced)
+					{
+						LoadedModel loaded = { target, model };
+						loaded_.push_back(loaded);
+					}
+				}
+
+				delete replaced;
+		}
+
+		void ModelReloader::addError(const char* message)
+		{
+			assert(message);
+
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			errors_.push_back(message);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,386 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Occlusion statistics
+//----------------------------------------------------------------------------
+
+	struct OcclusionStats
+	{
+		unsigned long long occluderTriangles;
+
+		unsigned long long modelsTested;
+		unsigned long long modelsCulled;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Occlusion culler
+//----------------------------------------------------------------------------
+
+	/*
+		Low resolution depth buffer filled with designated occluders, which is used
+		to skip models hidden behind them before any per-vertex work:
+
+			culler.clear();
+			culler.addOccluder(walls, transformation);
+
+			if (culler.visible(chair, chairTransformation)) chair.render(&renderer, chairTransformation);
+
+		Occluders write only the pixels they cover whole, with the farthest depth of
+		each pixel, and models are tested with the nearest depth of their whole
+		bounding box, so nothing showing past an occluder's silhouette is culled.
+	*/
+	class OcclusionCuller
+	{
+		public:
+
+			// Constructor && destructor:
+
+				OcclusionCuller(const Renderer* renderer, unsigned int width = 256, unsigned int height = 128);
+				~OcclusionCuller();
+
+			// Getters:
+
+				const OcclusionStats& getStats() const;
+
+			// Functions:
+
+				bool ok() const;
+
+				OcclusionCuller& clear();
+				OcclusionCuller& resetStats();
+
+				OcclusionCuller& addOccluder(const Model& model, const Matrix& transformation);
+
+				bool visible(const Model& model, const Matrix& transformation) const;
+
+		private:
+
+			void occluderTriangle(const double* point0, const double* point1, const double* point2);
+
+			// Renderer window coordinates of a camera space point:
+			void toBuffer(const double* viewPoint, double* bufferPoint) const;
+
+			const Renderer* renderer_;
+
+			unsigned int width_;
+			unsigned int height_;
+
+			double scaleX_;
+			double scaleY_;
+
+			// Camera space depth, never nearer than the occluders really are:
+			float* depth_;
+
+			mutable OcclusionStats stats_;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		OcclusionCuller::OcclusionCuller(const Renderer* renderer, unsigned int width /*= 256*/, unsigned int height /*= 128*/) :
+			renderer_ (renderer),
+			width_    (width),
+			height_   (height),
+			scaleX_   (0),
+			scaleY_   (0),
+			depth_    (NULL),
+			stats_    ()
+		{
+			assert(renderer);
+			assert(renderer->ok());
+			assert(width > 0 && height > 0);
+
+			scaleX_ = static_cast<double>(width_)  / renderer_->getWindowWidth();
+			scaleY_ = static_cast<double>(height_) / renderer_->getWindowHeight();
+
+			depth_ = (float*) calloc((size_t) width_ * height_, sizeof(*depth_));
+			assert(depth_);
+
+			clear();
+
+			assert(ok());
+		}
+
+		OcclusionCuller::~OcclusionCuller()
+		{
+			free(depth_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		const OcclusionStats& OcclusionCuller::getStats() const
+		{
+			return stats_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool OcclusionCuller::ok() const
+		{
+			bool everythingOk = true;
+
+			if (renderer_ == NULL)
+			{
+				puts("OcclusionCuller::ok(): renderer_ is a NULL pointer");
+				everythingOk = false;
+			}
+
+			if (depth_ == NULL)
+			{
+				puts("OcclusionCuller::ok(): depth_ is a NULL pointer");
+				everythingOk = false;
+			}
+
+			return everythingOk;
+		}
+
+		OcclusionCuller& OcclusionCuller::clear()
+		{
+			assert(ok());
+
+			std::fill(depth_, depth_ + (size_t) width_ * height_, FLT_MAX);
+
+			return *this;
+		}
+
+		OcclusionCuller& OcclusionCuller::resetStats()
+		{
+			stats_ = OcclusionStats();
+
+			return *this;
+		}
+
+		void OcclusionCuller::toBuffer(const double* viewPoint, double* bufferPoint) const
+		{
+			assert(viewPoint[2] > 0);
+
+			double parallax = renderer_->getParallax();
+			const Vector& shift = renderer_->getShift();
+
+			bufferPoint[0] = (parallax * viewPoint[0] / viewPoint[2] + shift.x()) * scaleX_;
+			bufferPoint[1] = (parallax * viewPoint[1] / viewPoint[2] + shift.y()) * scaleY_;
+			bufferPoint[2] = viewPoint[2];
+		}
+
+		// Occluders:
+
+			OcclusionCuller& OcclusionCuller::addOccluder(const Model& model, const Matrix& transformation)
+			{
+				assert(ok());
+				assert(model.ok());
+				assert(transformation.ok());
+
+				Transform toView = Transform(renderer_->getCamera() * transformation);
+
+				// Every point is transformed once, triangles only index them:
+
+					double* bufferPoints = (double*) calloc(model.getPointCount() * 3, sizeof(*bufferPoints));
+					assert(bufferPoints || model.getPointCount() == 0);
+
+					for (size_t i = 0; i < model.getPointCount(); i++)
+					{
+						double viewPoint[3] = {};
+						toView.apply(model.getPoint(i), viewPoint);
+
+						// Points behind the camera are marked to drop their triangles:
+						if (viewPoint[2] > 0) toBuffer(viewPoint, bufferPoints + 3 * i);
+						else bufferPoints[3 * i + 2] = 0;
+					}
+
+				for (size_t i = 0; i < model.getTriangleCount(); i++)
+				{
+					const Triangle& triangle = model.getTriangle(i);
+
+					const double* point0 = bufferPoints + 3 * triangle.point0;
+					const double* point1 = bufferPoints + 3 * triangle.point1;
+					const double* point2 = bufferPoints + 3 * triangle.point2;
+
+					if (point0[2] <= 0 || point1[2] <= 0 || point2[2] <= 0) continue;
+
+					occluderTriangle(point0, point1, point2);
+				}
+
+				free(bufferPoints);
+
+				return *this;
+			}
+
+			void OcclusionCuller::occluderTriangle(const double* point0, const double* point1, const double* point2)
+			{
+				double area = (point1[0] - point0[0]) * (point2[1] - point0[1]) -
+							  (point2[0] - point0[0]) * (point1[1] - point0[1]);
+
+				if (fabs(area) < 1e-9) return;
+
+				// Both windings are rasterized, so the edge functions are made positive inside:
+
+					if (area < 0)
+					{
+						std::swap(point1, point2);
+						area = -area;
+					}
+
+				stats_.occluderTriangles++;
+
+				// Bounding box:
+
+					int minX = std::max(static_cast<int>(floor(std::min(std::min(point0[0], point1[0]), point2[0]))), 0);
+					int minY = std::max(static_cast<int>(floor(std::min(std::min(point0[1], point1[1]), point2[1]))), 0);
+
+					int maxX = std::min(static_cast<int>(ceil(std::max(std::max(point0[0], point1[0]), point2[0]))), static_cast<int>(width_)  - 1);
+					int maxY = std::min(static_cast<int>(ceil(std::max(std::max(point0[1], point1[1]), point2[1]))), static_cast<int>(height_) - 1);
+
+					if (minX > maxX || minY > maxY) return;
+
+				// Edge functions E(x, y) = A * x + B * y + C:
+
+					const double* points[3] = { point0, point1, point2 };
+
+					double edgeA[3] = {}, edgeB[3] = {}, edgeC[3] = {};
+
+					for (size_t edge = 0; edge < 3; edge++)
+					{
+						const double* from = points[edge];
+						const double* to   = points[(edge + 1) % 3];
+
+						edgeA[edge] = from[1] - to[1];
+						edgeB[edge] = to[0] - from[0];
+						edgeC[edge] = from[0] * to[1] - to[0] * from[1];
+
+						// Evaluated at the pixel corner farthest inside, so a pixel passes only if its worst corner does:
+						edgeC[edge] -= (fabs(edgeA[edge]) + fabs(edgeB[edge])) / 2;
+					}
+
+				// Depth plane (1/z is linear in screen space), the farthest depth of a pixel lies in its corner:
+
+					double dW1 = 1 / point1[2] - 1 / point0[2];
+					double dW2 = 1 / point2[2] - 1 / point0[2];
+
+					double planeA = (dW1 * (point2[1] - point0[1]) - dW2 * (point1[1] - point0[1])) / area;
+					double planeB = ((point1[0] - point0[0]) * dW2 - (point2[0] - point0[0]) * dW1) / area;
+					double planeC = 1 / point0[2] - planeA * point0[0] - planeB * point0[1];
+
+					double planeMargin = (fabs(planeA) + fabs(planeB)) / 2;
+
+					float farZ = static_cast<float>(std::max(std::max(point0[2], point1[2]), point2[2]));
+
+				// Filling the pixels inside all three edges at their worst corners:
+
+					for (int y = minY; y <= maxY; y++)
+					{
+						double centerX = minX + 0.5;
+						double centerY = y + 0.5;
+
+						double edge0 = edgeA[0] * centerX + edgeB[0] * centerY + edgeC[0];
+						double edge1 = edgeA[1] * centerX + edgeB[1] * centerY + edgeC[1];
+						double edge2 = edgeA[2] * centerX + edgeB[2] * centerY + edgeC[2];
+
+						double inverseZ = planeA * centerX + planeB * centerY + planeC - planeMargin;
+
+						float* row = depth_ + (size_t) y * width_;
+
+						for (int x = minX; x <= maxX; x++)
+						{
+							if (edge0 >= 0 && edge1 >= 0 && edge2 >= 0 && inverseZ > 0)
+							{
+								float z = std::min(static_cast<float>(1 / inverseZ), farZ);
+
+								if (z < row[x]) row[x] = z;
+							}
+
+							edge0 += edgeA[0];
+							edge1 += edgeA[1];
+							edge2 += edgeA[2];
+
+							inverseZ += planeA;
+						}
+					}
+			}
+
+		// Occludees:
+
+			bool OcclusionCuller::visible(const Model& model, const Matrix& transformation) const
+			{
+				assert(ok());
+				assert(model.ok());
+				assert(transformation.ok());
+
+				stats_.modelsTested++;
+
+				Transform toView = Transform(renderer_->getCamera() * transformation);
+
+				const Vector& boundsMin = model.getBoundsMin();
+				const Vector& boundsMax = model.getBoundsMax();
+
+				// Projecting bounding box corners:
+
+					double minX = DBL_MAX, minY = DBL_MAX, maxX = -DBL_MAX, maxY = -DBL_MAX;
+					double nearZ = DBL_MAX;
+
+					for (unsigned int corner = 0; corner < 8; corner++)
+					{
+						double viewPoint[3] = {};
+
+						toView.apply((corner & 1) ? boundsMax.x() : boundsMin.x(),
+									 (corner & 2) ? boundsMax.y() : boundsMin.y(),
+									 (corner & 4) ? boundsMax.z() : boundsMin.z(), viewPoint);
+
+						// Boxes reaching behind the camera can't be projected, so they are kept:
+						if (viewPoint[2] <= 0) return true;
+
+						double bufferPoint[3] = {};
+						toBuffer(viewPoint, bufferPoint);
+
+						minX = std::min(minX, bufferPoint[0]);
+						minY = std::min(minY, bufferPoint[1]);
+						maxX = std::max(maxX, bufferPoint[0]);
+						maxY = std::max(maxY, bufferPoint[1]);
+
+						nearZ = std::min(nearZ, bufferPoint[2]);
+					}
+
+				// Every covered pixel of the box's screen rectangle is tested against its nearest depth:
+
+					int startX = std::max(static_cast<int>(floor(minX)), 0);
+					int startY = std::max(static_cast<int>(floor(minY)), 0);
+
+					int endX = std::min(static_cast<int>(floor(maxX)), static_cast<int>(width_)  - 1);
+					int endY = std::min(static_cast<int>(floor(maxY)), static_cast<int>(height_) - 1);
+
+					for (int y = startY; y <= endY; y++)
+					{
+						const float* row = depth_ + (size_t) y * width_;
+
+						for (int x = startX; x <= endX; x++)
+						{
+							if (nearZ < row[x]) return true;
+						}
+					}
+
+				// Hidden or off the screen:
+
+					stats_.modelsCulled++;
+
+					return false;
+			}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
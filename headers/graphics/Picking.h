@@ -0,0 +1,125 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Pick hit
+//----------------------------------------------------------------------------
+
+	struct PickHit
+	{
+		const Model* model;
+
+		// Scene object index, Scene::NOTHING when a single model was picked:
+		size_t object;
+
+		size_t triangle;
+
+		// Camera space depth of the hit:
+		double distance;
+
+		// Hit point is (1 - u - v) * point0 + u * point1 + v * point2 of the triangle:
+		double u, v;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Picking functions prototypes
+//----------------------------------------------------------------------------
+
+	// Nearest triangle under the window point (x, y), false if there is none:
+
+		bool pick(const Renderer* renderer, double x, double y, const Model& model, const Matrix& transformation, PickHit* hit);
+		bool pick(const Renderer* renderer, double x, double y, const Scene& scene, PickHit* hit);
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Picking functions
+//----------------------------------------------------------------------------
+
+	// Model space ray of the world ray, distances along both are the same:
+
+		bool pickModel(const Vector& origin, const Vector& direction, const Model& model, const Matrix& transformation, double maxDistance, RayHit* hit)
+		{
+			Transform toModel = Transform(transformation).inverted();
+
+			double modelOrigin[3] = {}, modelDirection[3] = {};
+
+			toModel.apply(origin, modelOrigin);
+			toModel.applyDirection(direction.x(), direction.y(), direction.z(), modelDirection);
+
+			return model.getHierarchy().intersect(modelOrigin, modelDirection, maxDistance, hit);
+		}
+
+	bool pick(const Renderer* renderer, double x, double y, const Model& model, const Matrix& transformation, PickHit* hit)
+	{
+		assert(renderer);
+		assert(model.ok());
+		assert(transformation.ok());
+		assert(hit);
+
+		Vector origin, direction;
+		renderer->unproject(x, y, &origin, &direction);
+
+		RayHit modelHit = {};
+		if (!pickModel(origin, direction, model, transformation, DBL_MAX, &modelHit)) return false;
+
+		PickHit toReturn = { &model, Scene::NOTHING, modelHit.triangle, modelHit.distance, modelHit.u, modelHit.v };
+		*hit = toReturn;
+
+		return true;
+	}
+
+	// Scene objects are intersected in the order their boxes are hit, until a triangle is nearer than the next box:
+
+		struct PickVisitor
+		{
+			const Scene* scene;
+
+			const Vector* origin;
+			const Vector* direction;
+
+			PickHit* hit;
+			bool found;
+
+			double operator()(size_t object, double /*boxDistance*/)
+			{
+				const SceneObject& sceneObject = scene->getObject(object);
+
+				RayHit modelHit = {};
+
+				if (pickModel(*origin, *direction, *sceneObject.model, sceneObject.transformation, hit->distance, &modelHit))
+				{
+					PickHit toReturn = { sceneObject.model, object, modelHit.triangle, modelHit.distance, modelHit.u, modelHit.v };
+					*hit = toReturn;
+
+					found = true;
+				}
+
+				return hit->distance;
+			}
+		};
+
+	bool pick(const Renderer* renderer, double x, double y, const Scene& scene, PickHit* hit)
+	{
+		assert(renderer);
+		assert(scene.ok());
+		assert(hit);
+
+		Vector origin, direction;
+		renderer->unproject(x, y, &origin, &direction);
+
+		hit->distance = DBL_MAX;
+
+		PickVisitor visitor = { &scene, &origin, &direction, hit, false };
+		scene.traverseRay(origin, direction, DBL_MAX, visitor);
+
+		return visitor.found;
+	}
+
+//}
+//----------------------------------------------------------------------------
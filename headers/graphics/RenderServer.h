@@ -0,0 +1,702 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <stddef.h>
+	#include <algorithm>
+	#include <atomic>
+	#include <deque>
+	#include <memory>
+	#include <mutex>
+	#include <condition_variable>
+	#include <thread>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Render protocol
+//----------------------------------------------------------------------------
+
+	/*
+		Messages over a message mode named pipe, frames go through shared memory:
+
+			1. The client connects to the pipe and reads a RenderHello, which names
+			   a file mapping of slotCount frames made for this client only.
+			2. It writes RenderRequests, any number of objects up to
+			   RENDER_MAX_OBJECTS, the message may end after the last one used.
+			3. For every request a RenderReply comes back, when it is done the
+			   frame is in slot id % slotCount of the mapping.
+
+		Requests of one client are rendered in parallel and may finish out of
+		order. Every slot holds one request at a time, a request whose slot is
+		taken by an earlier one still queued or rendering is answered with
+		RENDER_BUSY. Request id + slotCount overwrites the frame of id, so a
+		client sends it only after the reply to id and once it read that frame.
+
+		A client that doesn't read a reply within RENDER_REPLY_TIMEOUT
+		milliseconds is disconnected.
+	*/
+
+	const unsigned int RENDER_PROTOCOL_MAGIC   = 0x56525352; // "RSRV"
+	const unsigned int RENDER_PROTOCOL_VERSION = 1;
+
+	const unsigned int RENDER_MAX_OBJECTS = 64;
+
+	const unsigned int RENDER_REPLY_TIMEOUT = 5000;
+
+	enum RenderStatus
+	{
+		RENDER_DONE,
+		RENDER_BAD_REQUEST,
+		RENDER_BUSY
+	};
+
+	struct RenderHello
+	{
+		unsigned int magic;
+		unsigned int version;
+
+		// Frames are rows of 0x00RRGGBB pixels from the top:
+		unsigned int width, height;
+		unsigned int slotCount;
+
+		// Model ids are 0 to modelCount - 1, in the order the server loaded them:
+		unsigned int modelCount;
+
+		char mapping[64];
+	};
+
+	// Matrices are given row by row, like Matrix(4, 4, ...) takes them:
+	struct RenderObject
+	{
+		unsigned int model;
+
+		double transformation[16];
+	};
+
+	struct RenderRequest
+	{
+		unsigned int magic;
+		unsigned int id;
+
+		double camera[16];
+
+		unsigned int objectCount;
+		RenderObject objects[RENDER_MAX_OBJECTS];
+	};
+
+	struct RenderReply
+	{
+		unsigned int id;
+		unsigned int slot;
+		unsigned int status;
+
+		double milliseconds;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Render server
+//----------------------------------------------------------------------------
+
+	struct RenderServerSettings
+	{
+		// \\.\pipe\ and a name:
+		const char* pipeName;
+
+		unsigned int width, height;
+		double parallax;
+
+		bool multisampling;
+
+		// Frames in every client's mapping:
+		unsigned int slotCount;
+
+		// Renderers drawing at once (0 means one per physical core):
+		unsigned int threadCount;
+	};
+
+	/*
+		Serves the render protocol to any number of clients with the models
+		loaded once:
+
+			RenderServer server(settings, models);
+			server.run();
+
+		Every client has a thread reading its requests into its own queue, the
+		renderer threads take from the queues in turn, so a busy client can't
+		starve the others.
+	*/
+	class RenderServer
+	{
+		public:
+
+			// Constructor && destructor:
+
+				RenderServer(const RenderServerSettings& settings, const std::vector<const Model*>& models);
+				~RenderServer();
+
+			// Functions:
+
+				// Accepts clients until stop(), false if the pipe can't be created:
+				bool run();
+
+				// From any thread, run() returns soon after:
+				void stop();
+
+		private:
+
+			struct Client
+			{
+				unsigned int id;
+
+				HANDLE pipe;
+
+				// Reads and writes wait on their own events, so one can be pending while the other runs:
+				HANDLE readEvent;
+				HANDLE writeEvent;
+
+				// Set once the client is dropped, its transfers pending or started later give up:
+				HANDLE dropEvent;
+
+				HANDLE mapping;
+				unsigned int* frames;
+
+				// Replies come from every renderer thread:
+				std::mutex writeMutex;
+
+				// Guarded by the server's mutex_:
+				std::deque<RenderRequest> queue;
+				bool closed;
+
+				// Slots of requests queued or being rendered, freed once the reply is written:
+				std::vector<bool> slotsTaken;
+
+				std::atomic<bool> finished;
+
+				Client();
+				~Client();
+			};
+
+			// Reader thread and the client it reads, joined when the client is gone:
+			struct Connection
+			{
+				std::thread reader;
+				std::shared_ptr<Client> client;
+			};
+
+			// Overlapped read or write on the client's pipe, waited for, ERROR_SUCCESS or the error.
+			// Writes give up after RENDER_REPLY_TIMEOUT, both give up once the client is dropped:
+			static DWORD transfer(Client* client, bool write, void* buffer, DWORD size, DWORD* transferred);
+
+			bool accept(HANDLE pipe);
+			void pruneConnections();
+
+			void readRequests(std::shared_ptr<Client> client);
+			bool validRequest(const RenderRequest& request, DWORD size) const;
+
+			void renderRequests(size_t worker);
+
+			// Blocks until some client has a request or the server stops, false then:
+			bool takeRequest(std::shared_ptr<Client>* client, RenderRequest* request);
+
+			void reply(Client* client, const RenderReply& reply);
+
+			RenderServerSettings settings_;
+			std::vector<const Model*> models_;
+
+			std::vector<Renderer*> renderers_;
+			std::vector<std::thread> workers_;
+
+			std::mutex mutex_;
+			std::condition_variable requestsWaiting_;
+
+			std::vector<std::shared_ptr<Client> > clients_;
+			size_t nextClient_;
+			unsigned int clientCount_;
+
+			std::vector<Connection> connections_;
+
+			bool stopping_;
+			HANDLE stopEvent_;
+
+			RenderServer(const RenderServer&);
+			RenderServer& operator=(const RenderServer&);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		RenderServer::Client::Client() :
+			id		   (0),
+			pipe	   (INVALID_HANDLE_VALUE),
+			readEvent  (CreateEventA(NULL, TRUE, FALSE, NULL)),
+			writeEvent (CreateEventA(NULL, TRUE, FALSE, NULL)),
+			dropEvent  (CreateEventA(NULL, TRUE, FALSE, NULL)),
+			mapping	   (NULL),
+			frames	   (NULL),
+			writeMutex (),
+			queue	   (),
+			closed	   (false),
+			slotsTaken (),
+			finished   (false)
+		{}
+
+		RenderServer::Client::~Client()
+		{
+			if (frames) UnmapViewOfFile(frames);
+			if (mapping) CloseHandle(mapping);
+
+			if (pipe != INVALID_HANDLE_VALUE)
+			{
+				DisconnectNamedPipe(pipe);
+				CloseHandle(pipe);
+			}
+
+			CloseHandle(readEvent);
+			CloseHandle(writeEvent);
+			CloseHandle(dropEvent);
+		}
+
+		RenderServer::RenderServer(const RenderServerSettings& settings, const std::vector<const Model*>& models) :
+			settings_		 (settings),
+			models_			 (models),
+			renderers_		 (),
+			workers_		 (),
+			mutex_			 (),
+			requestsWaiting_ (),
+			clients_		 (),
+			nextClient_		 (0),
+			clientCount_	 (0),
+			connections_	 (),
+			stopping_		 (false),
+			stopEvent_		 (CreateEventA(NULL, TRUE, FALSE, NULL))
+		{
+			assert(settings.pipeName);
+			assert(settings.width > 0 && settings.height > 0 && settings.slotCount > 0);
+
+			unsigned int threadCount = settings.threadCount ? settings.threadCount : ThreadPool::physicalCoreCount();
+
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				Renderer* renderer = new Renderer(settings.width, settings.height, RGB(0, 0, 0), identityMatrix(4),
+												  Vector(settings.width / 2.0, settings.height / 2.0), settings.parallax, true);
+
+				renderer->setMultisampling(settings.multisampling);
+
+				renderers_.push_back(renderer);
+			}
+
+			for (size_t i = 0; i < renderers_.size(); i++) workers_.push_back(std::thread(&RenderServer::renderRequests, this, i));
+		}
+
+		RenderServer::~RenderServer()
+		{
+			stop();
+
+			// Renderers writing replies and readers waiting for requests return once their clients are dropped:
+
+				for (size_t i = 0; i < connections_.size(); i++) SetEvent(connections_[i].client->dropEvent);
+
+				for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+
+				for (size_t i = 0; i < connections_.size(); i++) connections_[i].reader.join();
+
+			for (size_t i = 0; i < renderers_.size(); i++) delete renderers_[i];
+
+			CloseHandle(stopEvent_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool RenderServer::run()
+		{
+			HANDLE connectEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+			while (true)
+			{
+				HANDLE pipe = CreateNamedPipeA(settings_.pipeName, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+											   PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT, PIPE_UNLIMITED_INSTANCES,
+											   sizeof(RenderReply) * 64, sizeof(RenderRequest) * 4, 0, NULL);
+
+				if (pipe == INVALID_HANDLE_VALUE)
+				{
+					printf("RenderServer::run(): cannot create %s, error %u\n", settings_.pipeName, (unsigned int) GetLastError());
+
+					CloseHandle(connectEvent);
+					return false;
+				}
+
+				// Waiting for a client or stop():
+
+					OVERLAPPED overlapped = {};
+					overlapped.hEvent = connectEvent;
+
+					ResetEvent(connectEvent);
+
+					bool connected = ConnectNamedPipe(pipe, &overlapped) != 0;
+
+					if (!connected)
+					{
+						DWORD error = GetLastError();
+
+						if (error == ERROR_PIPE_CONNECTED) connected = true;
+						else if (error == ERROR_IO_PENDING)
+						{
+							HANDLE events[2] = { connectEvent, stopEvent_ };
+
+							if (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0)
+							{
+								DWORD unused = 0;
+								connected = GetOverlappedResult(pipe, &overlapped, &unused, FALSE) != 0;
+							}
+							else
+							{
+								CancelIoEx(pipe, &overlapped);
+
+								DWORD unused = 0;
+								GetOverlappedResult(pipe, &overlapped, &unused, TRUE);
+							}
+						}
+					}
+
+				if (WaitForSingleObject(stopEvent_, 0) == WAIT_OBJECT_0)
+				{
+					CloseHandle(pipe);
+					break;
+				}
+
+				if (!connected || !accept(pipe)) CloseHandle(pipe);
+
+				pruneConnections();
+			}
+
+			CloseHandle(connectEvent);
+
+			return true;
+		}
+
+		void RenderServer::stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+
+				stopping_ = true;
+			}
+
+			requestsWaiting_.notify_all();
+
+			SetEvent(stopEvent_);
+		}
+
+		DWORD RenderServer::transfer(Client* client, bool write, void* buffer, DWORD size, DWORD* transferred)
+		{
+			assert(client && buffer && transferred);
+
+			HANDLE event = write ? client->writeEvent : client->readEvent;
+
+			OVERLAPPED overlapped = {};
+			overlapped.hEvent = event;
+
+			ResetEvent(event);
+
+			BOOL done = write ? WriteFile(client->pipe, buffer, size, NULL, &overlapped) : ReadFile(client->pipe, buffer, size, NULL, &overlapped);
+
+			if (!done && GetLastError() != ERROR_IO_PENDING && GetLastError() != ERROR_MORE_DATA) return GetLastError();
+
+			// A cancelled transfer still has to finish before overlapped goes out of scope:
+
+				HANDLE events[2] = { event, client->dropEvent };
+
+				if (WaitForMultipleObjects(2, events, FALSE, write ? RENDER_REPLY_TIMEOUT : INFINITE) != WAIT_OBJECT_0) CancelIoEx(client->pipe, &overlapped);
+
+			if (!GetOverlappedResult(client->pipe, &overlapped, transferred, TRUE)) return GetLastError();
+
+			return ERROR_SUCCESS;
+		}
+
+		bool RenderServer::accept(HANDLE pipe)
+		{
+			std::shared_ptr<Client> client = std::make_shared<Client>();
+
+			client->pipe = pipe;
+			client->slotsTaken.assign(settings_.slotCount, false);
+
+			// The client's own frames:
+
+				RenderHello hello = {};
+
+				hello.magic		 = RENDER_PROTOCOL_MAGIC;
+				hello.version	 = RENDER_PROTOCOL_VERSION;
+				hello.width		 = settings_.width;
+				hello.height	 = settings_.height;
+				hello.slotCount	 = settings_.slotCount;
+				hello.modelCount = static_cast<unsigned int>(models_.size());
+
+				client->id = ++clientCount_;
+
+				snprintf(hello.mapping, sizeof(hello.mapping), "Local\\restorizer-%u-%u", (unsigned int) GetCurrentProcessId(), client->id);
+
+				unsigned long long mappingSize = (unsigned long long) settings_.width * settings_.height * settings_.slotCount * sizeof(*client->frames);
+
+				client->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+													 static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize), hello.mapping);
+
+				if (client->mapping) client->frames = (unsigned int*) MapViewOfFile(client->mapping, FILE_MAP_WRITE, 0, 0, 0);
+
+				if (!client->frames)
+				{
+					printf("RenderServer::accept(): cannot map %s, error %u\n", hello.mapping, (unsigned int) GetLastError());
+
+					// The pipe is closed by the caller:
+					client->pipe = INVALID_HANDLE_VALUE;
+
+					return false;
+				}
+
+			DWORD written = 0;
+
+			if (transfer(client.get(), true, &hello, sizeof(hello), &written) != ERROR_SUCCESS) return true;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+
+				clients_.push_back(client);
+			}
+
+			Connection connection;
+
+			connection.client = client;
+			connection.reader = std::thread(&RenderServer::readRequests, this, client);
+
+			connections_.push_back(std::move(connection));
+
+			return true;
+		}
+
+		void RenderServer::pruneConnections()
+		{
+			for (size_t i = 0; i < connections_.size(); )
+			{
+				if (connections_[i].client->finished.load())
+				{
+					connections_[i].reader.join();
+
+					std::swap(connections_[i], connections_.back());
+					connections_.pop_back();
+				}
+				else i++;
+			}
+		}
+
+		void RenderServer::readRequests(std::shared_ptr<Client> client)
+		{
+			// Too large to be on the stack of every reader:
+			std::unique_ptr<RenderRequest> request = std::unique_ptr<RenderRequest>(new RenderRequest());
+
+			while (true)
+			{
+				DWORD size = 0;
+				DWORD error = transfer(client.get(), false, request.get(), sizeof(*request), &size);
+
+				if (error == ERROR_MORE_DATA)
+				{
+					// The rest of a message too long to be a request is dropped:
+
+						while (error == ERROR_MORE_DATA) error = transfer(client.get(), false, request.get(), sizeof(*request), &size);
+
+						if (error != ERROR_SUCCESS) break;
+
+						RenderReply rejected = { 0, 0, RENDER_BAD_REQUEST, 0 };
+						reply(client.get(), rejected);
+
+						continue;
+				}
+
+				if (error != ERROR_SUCCESS) break;
+
+				if (!validRequest(*request, size))
+				{
+					RenderReply rejected = { size >= offsetof(RenderRequest, camera) ? request->id : 0, 0, RENDER_BAD_REQUEST, 0 };
+					reply(client.get(), rejected);
+
+					continue;
+				}
+
+				unsigned int slot = request->id % settings_.slotCount;
+				bool queued = false;
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+
+					if (!client->slotsTaken[slot])
+					{
+						client->queue.push_back(*request);
+						client->slotsTaken[slot] = true;
+
+						queued = true;
+					}
+				}
+
+				if (queued) requestsWaiting_.notify_one();
+				else
+				{
+					RenderReply busy = { request->id, slot, RENDER_BUSY, 0 };
+					reply(client.get(), busy);
+				}
+			}
+
+			// Disconnected, requests still queued are dropped and renderers drawing for it finish with their own reference:
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+
+					client->closed = true;
+
+					for (size_t i = 0; i < client->queue.size(); i++) client->slotsTaken[client->queue[i].id % settings_.slotCount] = false;
+					client->queue.clear();
+
+					clients_.erase(std::find(clients_.begin(), clients_.end(), client));
+				}
+
+			client->finished.store(true);
+		}
+
+		bool RenderServer::validRequest(const RenderRequest& request, DWORD size) const
+		{
+			if (size < offsetof(RenderRequest, objects)) return false;
+
+			if (request.magic != RENDER_PROTOCOL_MAGIC || request.objectCount > RENDER_MAX_OBJECTS) return false;
+
+			if (size < offsetof(RenderRequest, objects) + request.objectCount * sizeof(RenderObject)) return false;
+
+			for (unsigned int i = 0; i < request.objectCount; i++)
+			{
+				if (request.objects[i].model >= models_.size()) return false;
+			}
+
+			return true;
+		}
+
+		bool RenderServer::takeRequest(std::shared_ptr<Client>* client, RenderRequest* request)
+		{
+			assert(client && request);
+
+			std::unique_lock<std::mutex> lock(mutex_);
+
+			while (!stopping_)
+			{
+				// Clients in turn, starting after the last one served:
+
+					for (size_t i = 0; i < clients_.size(); i++)
+					{
+						size_t index = (nextClient_ + i) % clients_.size();
+
+						if (clients_[index]->queue.empty()) continue;
+
+						*client	 = clients_[index];
+						*request = clients_[index]->queue.front();
+
+						clients_[index]->queue.pop_front();
+
+						nextClient_ = index + 1;
+
+						return true;
+					}
+
+				requestsWaiting_.wait(lock);
+			}
+
+			return false;
+		}
+
+		void RenderServer::renderRequests(size_t worker)
+		{
+			Renderer* renderer = renderers_[worker];
+
+			size_t pixelCount = (size_t) settings_.width * settings_.height;
+
+			std::shared_ptr<Client> client;
+			std::unique_ptr<RenderRequest> request = std::unique_ptr<RenderRequest>(new RenderRequest());
+
+			while (takeRequest(&client, request.get()))
+			{
+				LARGE_INTEGER start = {}, end = {}, frequency = {};
+
+				QueryPerformanceCounter(&start);
+
+				const double* camera = request->camera;
+
+				renderer->setCamera(Matrix(4, 4, camera[0],	 camera[1],	 camera[2],	 camera[3],
+												 camera[4],	 camera[5],	 camera[6],	 camera[7],
+												 camera[8],	 camera[9],	 camera[10], camera[11],
+												 camera[12], camera[13], camera[14], camera[15]));
+
+				renderer->clear();
+				renderer->startRendering();
+
+				for (unsigned int i = 0; i < request->objectCount; i++)
+				{
+					const double* t = request->objects[i].transformation;
+
+					models_[request->objects[i].model]->render(renderer, Matrix(4, 4, t[0],	 t[1],	t[2],  t[3],
+																					  t[4],	 t[5],	t[6],  t[7],
+																					  t[8],	 t[9],	t[10], t[11],
+																					  t[12], t[13], t[14], t[15]));
+				}
+
+				renderer->finishRendering();
+
+				unsigned int slot = request->id % settings_.slotCount;
+
+				memcpy(client->frames + slot * pixelCount, renderer->getColorBuffer(), pixelCount * sizeof(*client->frames));
+
+				QueryPerformanceCounter(&end);
+				QueryPerformanceFrequency(&frequency);
+
+				RenderReply done = { request->id, slot, RENDER_DONE, 1000.0 * (end.QuadPart - start.QuadPart) / frequency.QuadPart };
+				reply(client.get(), done);
+
+				// The slot may be written again only now:
+
+					{
+						std::lock_guard<std::mutex> lock(mutex_);
+						client->slotsTaken[slot] = false;
+					}
+
+				client.reset();
+			}
+		}
+
+		void RenderServer::reply(Client* client, const RenderReply& reply)
+		{
+			assert(client);
+
+			std::lock_guard<std::mutex> lock(client->writeMutex);
+
+			// A client gone in between or not reading its replies is dropped, its reader then disconnects it:
+
+				DWORD written = 0;
+
+				if (transfer(client, true, const_cast<RenderReply*>(&reply), sizeof(reply), &written) != ERROR_SUCCESS) SetEvent(client->dropEvent);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -5,6 +5,83 @@
 //----------------------------------------------------------------------------
 
 	#include <utility>
+	#include <algorithm>
+	#include <float.h>
+	#include <emmintrin.h>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Hierarchical depth statistics
+//----------------------------------------------------------------------------
+
+	// Work saved by the per-tile depth pyramid since the last Renderer::resetHiZStats():
+	struct HiZStats
+	{
+		unsigned long long trianglesTested;
+		unsigned long long trianglesRejected;
+
+		unsigned long long tilesRejected;
+
+		// Fully rejected triangles add their area, partially rejected ones add every skipped pixel
+		unsigned long long pixelsRejected;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Transparent colors
+//----------------------------------------------------------------------------
+
+	// The high byte of a COLORREF is its transparency, so RGB() colors are opaque:
+
+		COLORREF transparentColor(COLORREF color, double opacity)
+		{
+			unsigned int transparency = static_cast<unsigned int>((1 - std::min(std::max(opacity, 0.0), 1.0)) * 255 + 0.5);
+
+			return (color & 0xFFFFFF) | transparency << 24;
+		}
+
+		double getOpacity(COLORREF color)
+		{
+			return 1 - (color >> 24) / 255.0;
+		}
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Line segment
+//----------------------------------------------------------------------------
+
+	// Window coordinates, z is the camera space depth used by depth tested lines:
+	struct LineSegment
+	{
+		double x0, y0, z0;
+		double x1, y1, z1;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Point light
+//----------------------------------------------------------------------------
+
+	// Lights deferred shaded pixels within the radius around its world space position, fading out toward it:
+	struct PointLight
+	{
+		double x, y, z;
+		double radius;
+
+		COLORREF color;
+	};
 
 //}
 //----------------------------------------------------------------------------
@@ -14,359 +91,2503 @@
 //{ Renderer
 //----------------------------------------------------------------------------
 
-	class Renderer
-	{
-		public:
+	class Renderer
+	{
+		public:
+
+			// View space depth triangles and lines are clipped at, nearer points would project too far out for pixel coordinates:
+			static const double NEAR_PLANE_Z;
+
+			// Constructor && destructor:
+
+				// Offscreen renderers create no window, frames are only read through getColorBuffer():
+				Renderer(unsigned int windowWidth, unsigned int windowHeight, COLORREF backgroundColor, const Matrix& startCamera, const Vector& shift, double parallax, bool offscreen = false);
+				~Renderer();
+
+			// Getters:
+
+				unsigned int getWindowWidth()  const;
+				unsigned int getWindowHeight() const;
+
+				bool isOffscreen() const;
+
+				const Matrix& getCamera() const;
+				const Vector& getShift() const;
+				double getParallax() const;
+
+				// NULL when rendering single-threaded:
+				ThreadPool* getThreadPool() const;
+				Renderer& setThreadPool(ThreadPool* threadPool);
+
+				// Anti-aliased lines, blended by the coverage of the two nearest pixels:
+				bool getLineSmoothing() const;
+				Renderer& setLineSmoothing(bool lineSmoothing);
+
+				// Frame being drawn, rows of 0x00RRGGBB pixels from top to bottom, multisampled frames are resolved into it by finishRendering():
+				const unsigned int* getColorBuffer() const;
+
+				// 4x multisampling: triangles test coverage and depth per sample but compute their color once per pixel:
+				bool getMultisampling() const;
+				Renderer& setMultisampling(bool multisampling);
+
+				// Transparent triangles are sorted back to front by object unless this is on:
+				bool getOrderIndependentTransparency() const;
+				Renderer& setOrderIndependentTransparency(bool orderIndependent);
+
+				// Shadows of a directional light, cast by a depth-only pass into a shadow map:
+				bool getShadows() const;
+				Renderer& setShadows(bool shadows);
+
+				// Light shining along the direction, shadows are cast inside the sphere around the center,
+				// shadowed pixels keep the brightness part of their color:
+				Renderer& setShadowLight(const Vector& direction, const Vector& center, double radius, double brightness = 0.5);
+
+				// Between startShadowPass() and finishShadowPass():
+				bool inShadowPass() const;
+
+				// Deferred shading: triangle3d() also writes a packed normal per pixel and the pixel's color is its material,
+				// finishRendering() lights the visible pixels by the point lights afterwards, so overdraw costs no lighting:
+				bool getDeferredShading() const;
+				Renderer& setDeferredShading(bool deferred);
+
+				// Light every deferred pixel gets, 1 keeps the material's color:
+				double getAmbientLight() const;
+				Renderer& setAmbientLight(double ambient);
+
+				size_t getLightCount() const;
+
+			// Functions:
+
+				// Debugging:
+
+					bool ok() const;
+
+					const HiZStats& hiZStats() const;
+					Renderer& resetHiZStats();
+
+				// Camera stuff:
+
+					// Multiplies the camera by the movement, repeated small movements drift from orthonormal:
+					Renderer& moveCamera(Matrix movement);
+
+					// Rebuilt from scratch instead, so a kept orientation doesn't accumulate errors:
+					Renderer& setCamera(const Matrix& camera);
+
+					// Camera at the position, turned by the orientation from looking along z:
+					Renderer& setCamera(const Quaternion& orientation, const Vector& position);
+
+					// Window coordinates of the point with its camera space depth as z:
+					Vector project(const Vector& point) const;
+
+					// World space ray through the window point, origin + t * direction has depth t:
+					void unproject(double x, double y, Vector* origin, Vector* direction) const;
+
+				// Deferred shading lights:
+
+					Renderer& addLight(const PointLight& light);
+					Renderer& clearLights();
+
+				// Rendering:
+
+					void  startRendering() const;
+
+					// Shows the frame in the window:
+					void finishRendering() const;
+
+					void clear() const;
+
+					// Transparent triangles from here on are sorted as one object:
+					void startObject() const;
+
+					// Triangles drawn by triangle3d() in between only write the shadow map's depth, transparent ones cast no shadows:
+					void startShadowPass() const;
+					void finishShadowPass() const;
+
+					void pixel(const int x, const int y, COLORREF color) const;
+					void pixel3d(const Vector& point, COLORREF color) const;
+
+					void line(int x0, int y0, int x1, int y1, const COLORREF color) const;
+
+					// Depth tested without writing depth, drawn over the surfaces it lies on:
+					void line(int x0, int y0, double z0, int x1, int y1, double z1, COLORREF color) const;
+
+					// Many segments at once, split between threads by rows:
+					void lines(const LineSegment* segments, size_t count, COLORREF color, bool depthTest) const;
+					void line3d(const Vector& point0, const Vector& point1, const COLORREF color) const;
+
+					void triangle3d(const Vector& point0, const Vector& point1, const Vector& point2, const Vector& normal, COLORREF color) const;
+					void triangle(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color) const;
+					void triangle(int x0, int y0, double z0, int x1, int y1, double z1, int x2, int y2, double z2, COLORREF color) const;
+
+		private:
+
+			// Depth pyramid tiles are (1 << HIZ_TILE_SHIFT) x (1 << HIZ_TILE_SHIFT) pixels:
+			static const unsigned int HIZ_TILE_SHIFT = 3;
+
+			// 1/z is linear in screen space, so depth is interpolated through it:
+			struct DepthPlane
+			{
+				double a, b, c;
+
+				float nearZ, farZ;
+			};
+
+			void clearDepth() const;
+
+			// Color buffer pixel of a color:
+			static unsigned int toPixel(COLORREF color);
+
+			// Row write, aligned four pixels at a time:
+			static void fillRow(unsigned int* row, int count, unsigned int pixel);
+
+			// Part [t0, t1] of the segment inside the rectangle (Liang-Barsky), false if there is none:
+			static bool clipLine(double x0, double y0, double x1, double y1, double minX, double minY, double maxX, double maxY, double* t0, double* t1);
+
+			// Only the pixels in rows [firstY, lastY] are visited, whatever the segment's length:
+			void rasterizeLine(const LineSegment& segment, unsigned int pixel, bool depthTest, int firstY, int lastY) const;
+
+			// Writes every sample of the pixel when multisampling:
+
+				void writePixel(size_t index, unsigned int pixel) const;
+
+				// Coverage is out of 256:
+				void blendPixel(size_t index, unsigned int pixel, unsigned int coverage) const;
+				static unsigned int blend(unsigned int destination, unsigned int pixel, unsigned int coverage);
+
+			// triangle() with the packed normal deferred shading writes, 0 for none:
+			void depthTriangle(int x0, int y0, double z0, int x1, int y1, double z1, int x2, int y2, double z2, COLORREF color, unsigned int normal) const;
+
+			void fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color, const DepthPlane* plane, unsigned int normal) const;
+
+			// Calls span(y, left, right) for every row of the triangle inside the width x height target,
+			// half-open spans leave out the right and bottom edges, so triangles sharing an edge never cover a pixel twice.
+			// The closed rule, used by the shadow map only, covers both edges and keeps thin and flat triangles visible:
+			template <typename SpanFunction>
+			void forEachSpan(int x0, int y0, int x1, int y1, int x2, int y2, unsigned int width, unsigned int height, bool halfOpen, const SpanFunction& span) const;
+			void depthSpan(int y, int left, int right, unsigned int pixel, unsigned int normal, const DepthPlane& plane) const;
+
+			// Multisampling:
+
+				static const unsigned int SAMPLE_COUNT = 4;
+
+				void multisampleTriangle(int x0, int y0, int x1, int y1, int x2, int y2, unsigned int pixel, unsigned int normal, const DepthPlane* plane) const;
+
+				// Averages the samples into the color buffer:
+				void resolveSamples() const;
+
+			// Transparency:
+
+				// Kept until finishRendering() draws them over the opaque frame:
+				struct TransparentTriangle
+				{
+					int x0, y0, x1, y1, x2, y2;
+
+					// Depth tested triangles only:
+					DepthPlane plane;
+					bool depthTested;
+
+					unsigned int pixel;
+
+					// Out of 256:
+					unsigned int opacity;
+
+					unsigned int object;
+					float depth;
+				};
+
+				void queueTransparent(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color, const DepthPlane* plane) const;
+				void drawTransparent() const;
+
+				// Behind the depth buffer pixels are kept, the rest is mixed with the pixel four at a time:
+				void blendSpan(int y, int left, int right, unsigned int pixel, unsigned int opacity, const DepthPlane* plane) const;
+
+				// Weighted blended order independent transparency, sums resolved by drawTransparent():
+				void accumulateSpan(int y, int left, int right, unsigned int pixel, unsigned int opacity, const DepthPlane* plane) const;
+
+			// Shadows:
+
+				static const unsigned int SHADOW_MAP_SIZE = 1024;
+
+				// The light's projection is orthographic, so depth is linear in the map and the plane holds z instead of 1/z,
+				// it comes from the unrounded points, small triangles would be tilted by rounding them to texels:
+				void shadowTriangle(const double* point0, const double* point1, const double* point2) const;
+
+				// Nothing but the nearest depth is written:
+				void shadowSpan(int y, int left, int right, const DepthPlane& plane) const;
+
+				// Darkens the pixels (or samples) farther from the light than the map's depth, averaged over 3x3 texels:
+				void applyShadows() const;
+
+			// Deferred shading:
+
+				// Lights are culled per (1 << LIGHT_TILE_SHIFT) pixels wide square tile:
+				static const unsigned int LIGHT_TILE_SHIFT = 4;
+
+				// Octahedral, 16 bits per coordinate, 0 is left for pixels without a normal:
+				static unsigned int packNormal(double x, double y, double z);
+				static void unpackNormal(unsigned int packed, float* normal);
+
+				// Every tile tests the lights against the box around its pixels' points, then its pixels only get the ones that passed:
+				void shadeDeferred() const;
+
+			unsigned int hiZVisibleTiles(int minX, int minY, int maxX, int maxY, float nearZ) const;
+			void updateHiZ() const;
+
+			unsigned int windowWidth_;
+			unsigned int windowHeight_;
+
+			bool offscreen_;
+
+			COLORREF backgroundColor_;
+
+			Matrix camera_;
+
+			Vector shift_;
+
+			double parallax_;
+
+			bool lineSmoothing_;
+
+			unsigned int* colorBuffer_;
+
+			// SAMPLE_COUNT consecutive samples per pixel, NULL without multisampling:
+
+				unsigned int* sampleColors_;
+				float*		  sampleDepths_;
+
+			// Transparent triangles of the frame:
+
+				mutable std::vector<TransparentTriangle> transparentTriangles_;
+				mutable unsigned int objectCount_;
+
+				// Premultiplied weighted color sums and the products of transparencies, NULL while triangles are sorted:
+
+					float* accumulation_;
+					float* revealage_;
+
+			// Shadow map of the light, NULL without shadows:
+
+				float* shadowDepths_;
+
+				// World space to map pixels, with the depth along the light as z, flat since every shadow pass vertex goes through it:
+				Transform light_;
+
+				// Depth the map's surfaces are pushed away from the light by, so they don't shadow themselves by rounding:
+				double shadowBias_;
+
+				// Out of 256:
+				unsigned int shadowBrightness_;
+
+				mutable bool shadowPass_;
+
+			// Deferred shading's camera space normals, NULL without it:
+
+				unsigned int* normalBuffer_;
+
+				std::vector<PointLight> lights_;
+				double ambientLight_;
+
+			// Depth buffer with its coarse min/max pyramid:
+
+				float* depthBuffer_;
+
+				unsigned int tileCountX_;
+				unsigned int tileCountY_;
+
+				float* tileMinDepth_;
+				float* tileMaxDepth_;
+
+				// Tiles written by the current triangle, their maxima are recomputed after it:
+				unsigned int* dirtyTiles_;
+				bool*		  tileDirty_;
+
+				mutable size_t dirtyTileCount_;
+
+				mutable HiZStats hiZStats_;
+
+			ThreadPool* threadPool_;
+
+			// Buffers are owned, a copy would free them twice:
+			Renderer(const Renderer&);
+			Renderer& operator=(const Renderer&);
+	};
+
+	const double Renderer::NEAR_PLANE_Z = 1;
+
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		Renderer::Renderer(unsigned int windowWidth, unsigned int windowHeight, COLORREF backgroundColor, const Matrix& startCamera, const Vector& shift, double parallax, bool offscreen /*= false*/) :
+			windowWidth_  (windowWidth),
+			windowHeight_ (windowHeight),
+			offscreen_	  (offscreen),
+			backgroundColor_ (backgroundColor),
+			camera_		     (startCamera),
+			shift_			 (shift),
+			parallax_		 (parallax),
+			lineSmoothing_	 (false),
+			colorBuffer_	 (NULL),
+			sampleColors_	 (NULL),
+			sampleDepths_	 (NULL),
+			transparentTriangles_ (),
+			objectCount_	 (0),
+			accumulation_	 (NULL),
+			revealage_		 (NULL),
+			shadowDepths_	 (NULL),
+			light_			 (identityMatrix(4)),
+			shadowBias_		 (0),
+			shadowBrightness_ (0),
+			shadowPass_		 (false),
+			normalBuffer_	 (NULL),
+			lights_			 (),
+			ambientLight_	 (0.2),
+			depthBuffer_	 (NULL),
+			tileCountX_		 ((windowWidth  + (1 << HIZ_TILE_SHIFT) - 1) >> HIZ_TILE_SHIFT),
+			tileCountY_		 ((windowHeight + (1 << HIZ_TILE_SHIFT) - 1) >> HIZ_TILE_SHIFT),
+			tileMinDepth_	 (NULL),
+			tileMaxDepth_	 (NULL),
+			dirtyTiles_		 (NULL),
+			tileDirty_		 (NULL),
+			dirtyTileCount_	 (0),
+			hiZStats_		 (),
+			threadPool_		 (NULL)
+		{
+			// Creating color buffer:
+
+				colorBuffer_ = (unsigned int*) trackedCalloc((size_t) windowWidth_ * windowHeight_, sizeof(*colorBuffer_));
+				assert(colorBuffer_);
+
+			// Creating depth buffers:
+
+				depthBuffer_ = (float*) trackedCalloc((size_t) windowWidth_ * windowHeight_, sizeof(*depthBuffer_));
+				assert(depthBuffer_);
+
+				tileMinDepth_ = (float*) trackedCalloc((size_t) tileCountX_ * tileCountY_, sizeof(*tileMinDepth_));
+				assert(tileMinDepth_);
+
+				tileMaxDepth_ = (float*) trackedCalloc((size_t) tileCountX_ * tileCountY_, sizeof(*tileMaxDepth_));
+				assert(tileMaxDepth_);
+
+				dirtyTiles_ = (unsigned int*) trackedCalloc((size_t) tileCountX_ * tileCountY_, sizeof(*dirtyTiles_));
+				assert(dirtyTiles_);
+
+				tileDirty_ = (bool*) trackedCalloc((size_t) tileCountX_ * tileCountY_, sizeof(*tileDirty_));
+				assert(tileDirty_);
+
+				clearDepth();
+
+			setShadowLight(Vector(0, 1, 0), Vector(0, 0, 0), 1000);
+
+			// Creating window:
+
+				if (!offscreen_)
+				{
+					txCreateWindow(windowWidth, windowHeight);
+					txTextCursor(false);
+				}
+
+			assert(ok());
+		}
+
+		Renderer::~Renderer()
+		{
+			trackedAlignedFree(sampleColors_);
+			trackedAlignedFree(sampleDepths_);
+
+			trackedAlignedFree(accumulation_);
+			trackedAlignedFree(revealage_);
+
+			trackedAlignedFree(shadowDepths_);
+			trackedAlignedFree(normalBuffer_);
+
+			trackedFree(colorBuffer_);
+			trackedFree(depthBuffer_);
+			trackedFree(tileMinDepth_);
+			trackedFree(tileMaxDepth_);
+			trackedFree(dirtyTiles_);
+			trackedFree(tileDirty_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		unsigned int Renderer::getWindowWidth() const
+		{
+			return windowWidth_;
+		}
+
+		unsigned int Renderer::getWindowHeight() const
+		{
+			return windowHeight_;
+		}
+
+		bool Renderer::isOffscreen() const
+		{
+			return offscreen_;
+		}
+
+		const Matrix& Renderer::getCamera() const
+		{
+			return camera_;
+		}
+
+		const Vector& Renderer::getShift() const
+		{
+			return shift_;
+		}
+
+		double Renderer::getParallax() const
+		{
+			return parallax_;
+		}
+
+		ThreadPool* Renderer::getThreadPool() const
+		{
+			return threadPool_;
+		}
+
+		Renderer& Renderer::setThreadPool(ThreadPool* threadPool)
+		{
+			threadPool_ = threadPool;
+
+			return *this;
+		}
+
+		bool Renderer::getLineSmoothing() const
+		{
+			return lineSmoothing_;
+		}
+
+		Renderer& Renderer::setLineSmoothing(bool lineSmoothing)
+		{
+			lineSmoothing_ = lineSmoothing;
+
+			return *this;
+		}
+
+		const unsigned int* Renderer::getColorBuffer() const
+		{
+			return colorBuffer_;
+		}
+
+		bool Renderer::getMultisampling() const
+		{
+			return sampleColors_ != NULL;
+		}
+
+		Renderer& Renderer::setMultisampling(bool multisampling)
+		{
+			if (multisampling == getMultisampling()) return *this;
+
+			size_t pixelCount = (size_t) windowWidth_ * windowHeight_;
+
+			if (multisampling)
+			{
+				// Aligned, so every pixel's samples are one SSE register:
+
+					sampleColors_ = (unsigned int*) trackedAlignedMalloc(pixelCount * SAMPLE_COUNT * sizeof(*sampleColors_), 16);
+					assert(sampleColors_);
+
+					sampleDepths_ = (float*) trackedAlignedMalloc(pixelCount * SAMPLE_COUNT * sizeof(*sampleDepths_), 16);
+					assert(sampleDepths_);
+
+				// The frame drawn so far is kept:
+
+					for (size_t i = 0; i < pixelCount; i++)
+					{
+						_mm_store_si128(reinterpret_cast<__m128i*>(sampleColors_ + i * SAMPLE_COUNT), _mm_set1_epi32(static_cast<int>(colorBuffer_[i])));
+						_mm_store_ps(sampleDepths_ + i * SAMPLE_COUNT, _mm_set1_ps(depthBuffer_[i]));
+					}
+			}
+			else
+			{
+				resolveSamples();
+
+				trackedAlignedFree(sampleColors_);
+				trackedAlignedFree(sampleDepths_);
+
+				sampleColors_ = NULL;
+				sampleDepths_ = NULL;
+			}
+
+			return *this;
+		}
+
+		bool Renderer::getOrderIndependentTransparency() const
+		{
+			return accumulation_ != NULL;
+		}
+
+		Renderer& Renderer::setOrderIndependentTransparency(bool orderIndependent)
+		{
+			if (orderIndependent == getOrderIndependentTransparency()) return *this;
+
+			if (orderIndependent)
+			{
+				accumulation_ = (float*) trackedAlignedMalloc((size_t) windowWidth_ * windowHeight_ * 4 * sizeof(*accumulation_), 16);
+				assert(accumulation_);
+
+				revealage_ = (float*) trackedAlignedMalloc((size_t) windowWidth_ * windowHeight_ * sizeof(*revealage_), 16);
+				assert(revealage_);
+			}
+			else
+			{
+				trackedAlignedFree(accumulation_);
+				trackedAlignedFree(revealage_);
+
+				accumulation_ = NULL;
+				revealage_	  = NULL;
+			}
+
+			return *this;
+		}
+
+		bool Renderer::getShadows() const
+		{
+			return shadowDepths_ != NULL;
+		}
+
+		Renderer& Renderer::setShadows(bool shadows)
+		{
+			assert(!shadowPass_);
+
+			if (shadows == getShadows()) return *this;
+
+			if (shadows)
+			{
+				shadowDepths_ = (float*) trackedAlignedMalloc((size_t) SHADOW_MAP_SIZE * SHADOW_MAP_SIZE * sizeof(*shadowDepths_), 16);
+				assert(shadowDepths_);
+
+				std::fill(shadowDepths_, shadowDepths_ + (size_t) SHADOW_MAP_SIZE * SHADOW_MAP_SIZE, FLT_MAX);
+			}
+			else
+			{
+				trackedAlignedFree(shadowDepths_);
+
+				shadowDepths_ = NULL;
+			}
+
+			return *this;
+		}
+
+		Renderer& Renderer::setShadowLight(const Vector& direction, const Vector& center, double radius, double brightness /*= 0.5*/)
+		{
+			assert(direction.ok());
+			assert(center.ok());
+			assert(radius > 0);
+
+			// Vector::length() is squared:
+			double length = sqrt(direction.length());
+			assert(length > 0);
+
+			// Orthonormal basis with the light along z, any axis not along it completes it:
+
+				double lightZ[3] = { direction.x() / length, direction.y() / length, direction.z() / length };
+
+				double helper[3] = { 0, 0, 0 };
+				helper[fabs(lightZ[0]) < 0.9 ? 0 : 1] = 1;
+
+				double lightX[3] = { helper[1] * lightZ[2] - helper[2] * lightZ[1],
+									 helper[2] * lightZ[0] - helper[0] * lightZ[2],
+									 helper[0] * lightZ[1] - helper[1] * lightZ[0] };
+
+				double lightXLength = sqrt(lightX[0] * lightX[0] + lightX[1] * lightX[1] + lightX[2] * lightX[2]);
+				for (size_t i = 0; i < 3; i++) lightX[i] /= lightXLength;
+
+				double lightY[3] = { lightZ[1] * lightX[2] - lightZ[2] * lightX[1],
+									 lightZ[2] * lightX[0] - lightZ[0] * lightX[2],
+									 lightZ[0] * lightX[1] - lightZ[1] * lightX[0] };
+
+			// The sphere's diameter fills the map, depth is counted from its near side:
+
+				double scale = SHADOW_MAP_SIZE / (2 * radius);
+				double half	 = SHADOW_MAP_SIZE / 2.0;
+
+				double centerX = lightX[0] * center.x() + lightX[1] * center.y() + lightX[2] * center.z();
+				double centerY = lightY[0] * center.x() + lightY[1] * center.y() + lightY[2] * center.z();
+				double centerZ = lightZ[0] * center.x() + lightZ[1] * center.y() + lightZ[2] * center.z();
+
+				light_ = Transform(Matrix(4, 4, lightX[0] * scale, lightX[1] * scale, lightX[2] * scale, half - centerX * scale,
+												lightY[0] * scale, lightY[1] * scale, lightY[2] * scale, half - centerY * scale,
+												lightZ[0],		   lightZ[1],		  lightZ[2],		 radius - centerZ,
+												0.0,			   0.0,				  0.0,				 1.0));
+
+			// A texel of depth for rounding, shadowTriangle() adds the triangle's slope:
+			shadowBias_ = 1 / scale;
+
+			shadowBrightness_ = static_cast<unsigned int>(std::min(std::max(brightness, 0.0), 1.0) * 256 + 0.5);
+
+			return *this;
+		}
+
+		bool Renderer::inShadowPass() const
+		{
+			return shadowPass_;
+		}
+
+		bool Renderer::getDeferredShading() const
+		{
+			return normalBuffer_ != NULL;
+		}
+
+		Renderer& Renderer::setDeferredShading(bool deferred)
+		{
+			if (deferred == getDeferredShading()) return *this;
+
+			if (deferred)
+			{
+				// Pixels drawn so far have no normal, so they stay as they are:
+
+					normalBuffer_ = (unsigned int*) trackedAlignedMalloc((size_t) windowWidth_ * windowHeight_ * sizeof(*normalBuffer_), 16);
+					assert(normalBuffer_);
+
+					fillRow(normalBuffer_, static_cast<int>(windowWidth_ * windowHeight_), 0);
+			}
+			else
+			{
+				trackedAlignedFree(normalBuffer_);
+
+				normalBuffer_ = NULL;
+			}
+
+			return *this;
+		}
+
+		double Renderer::getAmbientLight() const
+		{
+			return ambientLight_;
+		}
+
+		Renderer& Renderer::setAmbientLight(double ambient)
+		{
+			assert(ambient >= 0);
+
+			ambientLight_ = ambient;
+
+			return *this;
+		}
+
+		size_t Renderer::getLightCount() const
+		{
+			return lights_.size();
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Debugging
+		//----------------------------------------------------------------------------
+
+			bool Renderer::ok() const
+			{
+				bool everythingOk = true;
+
+				if (camera_.getSizeX() != 4 || camera_.getSizeY() != 4)
+				{
+					everythingOk = false;
+					printf("Renderer::ok(): Camera matrix has invalid size (it should be 4x4).\n");
+				}
+
+				if (!camera_.ok())
+				{
+					everythingOk = false;
+					printf("Renderer::ok(): Camera matrix is not ok.\n");
+				}
+
+				if (colorBuffer_ == NULL)
+				{
+					everythingOk = false;
+					printf("Renderer::ok(): Color buffer is not allocated.\n");
+				}
+
+				if ((sampleColors_ == NULL) != (sampleDepths_ == NULL))
+				{
+					everythingOk = false;
+					printf("Renderer::ok(): Only one of the sample buffers is allocated.\n");
+				}
+
+				if (shadowPass_ && shadowDepths_ == NULL)
+				{
+					everythingOk = false;
+					printf("Renderer::ok(): Shadow pass without a shadow map.\n");
+				}
+
+				if (depthBuffer_ == NULL || tileMinDepth_ == NULL || tileMaxDepth_ == NULL || dirtyTiles_ == NULL || tileDirty_ == NULL)
+				{
+					everythingOk = false;
+					printf("Renderer::ok(): Depth buffers are not allocated.\n");
+				}
+
+				return everythingOk;
+			}
+
+			const HiZStats& Renderer::hiZStats() const
+			{
+				return hiZStats_;
+			}
+
+			Renderer& Renderer::resetHiZStats()
+			{
+				hiZStats_ = HiZStats();
+
+				return *this;
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+
+		//----------------------------------------------------------------------------
+		//{ Camera
+		//----------------------------------------------------------------------------
+
+			Renderer& Renderer::moveCamera(Matrix movement)
+			{
+				assert(ok());
+				assert(movement.ok());
+				assert(movement.getSizeX() == 4 && movement.getSizeY() == 4);
+
+				camera_ *= movement;
+
+				assert(ok());
+
+				return *this;
+			}
+
+			Renderer& Renderer::setCamera(const Matrix& camera)
+			{
+				assert(camera.ok());
+				assert(camera.getSizeX() == 4 && camera.getSizeY() == 4);
+
+				camera_ = camera;
+
+				assert(ok());
+
+				return *this;
+			}
+
+			Renderer& Renderer::setCamera(const Quaternion& orientation, const Vector& position)
+			{
+				assert(position.ok());
+
+				// The inverse pose: rotated back, then shifted by the rotated back position:
+
+					Quaternion inverse = orientation.conjugated();
+
+					double rotatedPosition[3] = {};
+					inverse.rotate(position.x(), position.y(), position.z(), rotatedPosition);
+
+					return setCamera(inverse.toMatrix(Vector(-rotatedPosition[0], -rotatedPosition[1], -rotatedPosition[2])));
+			}
+
+			Vector Renderer::project(const Vector& point) const
+			{
+				assert(point.ok());
+
+				Vector viewPoint = point * camera_;
+
+				Vector fixedPoint = viewPoint.perspectived(parallax_) + shift_;
+				fixedPoint.z() = viewPoint.z();
+
+				return fixedPoint;
+			}
+
+			void Renderer::unproject(double x, double y, Vector* origin, Vector* direction) const
+			{
+				assert(ok());
+				assert(origin);
+				assert(direction);
+				assert(parallax_ != 0);
+
+				Transform toWorld = Transform(camera_).inverted();
+
+				double worldOrigin[3] = {}, worldDirection[3] = {};
+
+				toWorld.apply(0, 0, 0, worldOrigin);
+				toWorld.applyDirection((x - shift_.x()) / parallax_, (y - shift_.y()) / parallax_, 1, worldDirection);
+
+				*origin	   = Vector(worldOrigin[0],	   worldOrigin[1],	  worldOrigin[2]);
+				*direction = Vector(worldDirection[0], worldDirection[1], worldDirection[2]);
+			}
+
+			Renderer& Renderer::addLight(const PointLight& light)
+			{
+				assert(light.radius > 0);
+
+				lights_.push_back(light);
+
+				return *this;
+			}
+
+			Renderer& Renderer::clearLights()
+			{
+				lights_.clear();
+
+				return *this;
+			}
+			
+		//}
+		//----------------------------------------------------------------------------
+
+
+		//----------------------------------------------------------------------------
+		//{ Rendering
+		//----------------------------------------------------------------------------
+
+			// Additional:
+
+				void Renderer::startRendering() const
+				{
+					TRACE_SCOPE("Renderer::startRendering");
+
+					#ifdef TRACK_ALLOCATIONS
+						AllocationTracker::startFrame();
+					#endif
+
+					if (!offscreen_) txBegin();
+				}
+
+				void Renderer::finishRendering() const
+				{
+					assert(!shadowPass_);
+
+					TRACE_SCOPE("Renderer::finishRendering");
+
+					// Passes over the whole frame, counted before the frame ends:
+					{
+						ALLOCATION_STAGE(ALLOCATION_FINISH);
+
+						if (normalBuffer_) shadeDeferred();
+
+						if (shadowDepths_) applyShadows();
+
+						if (sampleColors_) resolveSamples();
+
+						drawTransparent();
+					}
+
+					#ifdef TRACK_ALLOCATIONS
+						AllocationTracker::finishFrame();
+					#endif
+
+					if (offscreen_) return;
+
+					// Top-down 32 bit DIB, so the color buffer is copied as it is:
+
+						BITMAPINFO info = {};
+
+						info.bmiHeader.biSize		 = sizeof(info.bmiHeader);
+						info.bmiHeader.biWidth		 = static_cast<LONG>(windowWidth_);
+						info.bmiHeader.biHeight		 = -static_cast<LONG>(windowHeight_);
+						info.bmiHeader.biPlanes		 = 1;
+						info.bmiHeader.biBitCount	 = 32;
+						info.bmiHeader.biCompression = BI_RGB;
+
+						SetDIBitsToDevice(txDC(), 0, 0, windowWidth_, windowHeight_, 0, 0, 0, windowHeight_, colorBuffer_, &info, DIB_RGB_COLORS);
+
+					txEnd();
+				}
+
+				void Renderer::clear() const
+				{
+					assert(ok());
+
+					unsigned int* colorBuffer = colorBuffer_;
+					unsigned int windowWidth = windowWidth_;
+					unsigned int background = toPixel(backgroundColor_);
+
+					unsigned int* sampleColors = sampleColors_;
+					float*		  sampleDepths = sampleDepths_;
+
+					unsigned int* normalBuffer = normalBuffer_;
+
+					parallelFor(threadPool_, 0, windowHeight_, 0, [=](size_t begin, size_t end)
+					{
+						fillRow(colorBuffer + begin * windowWidth, static_cast<int>((end - begin) * windowWidth), background);
+
+						if (normalBuffer) fillRow(normalBuffer + begin * windowWidth, static_cast<int>((end - begin) * windowWidth), 0);
+
+						if (sampleColors)
+						{
+							size_t first = begin * windowWidth * SAMPLE_COUNT, last = end * windowWidth * SAMPLE_COUNT;
+
+							fillRow(sampleColors + first, static_cast<int>(last - first), background);
+							std::fill(sampleDepths + first, sampleDepths + last, FLT_MAX);
+						}
+					});
+
+					clearDepth();
+
+					transparentTriangles_.clear();
+					objectCount_ = 0;
+				}
+
+				void Renderer::startObject() const
+				{
+					objectCount_++;
+				}
+
+				void Renderer::startShadowPass() const
+				{
+					assert(shadowDepths_);
+					assert(!shadowPass_);
+
+					std::fill(shadowDepths_, shadowDepths_ + (size_t) SHADOW_MAP_SIZE * SHADOW_MAP_SIZE, FLT_MAX);
+
+					shadowPass_ = true;
+				}
+
+				void Renderer::finishShadowPass() const
+				{
+					assert(shadowPass_);
+
+					shadowPass_ = false;
+				}
+
+				unsigned int Renderer::toPixel(COLORREF color)
+				{
+					return GetRValue(color) << 16 | GetGValue(color) << 8 | GetBValue(color);
+				}
+
+				void Renderer::fillRow(unsigned int* row, int count, unsigned int pixel)
+				{
+					int x = 0;
+
+					for (; x < count && (reinterpret_cast<size_t>(row + x) & 15); x++) row[x] = pixel;
+
+					__m128i pixels = _mm_set1_epi32(static_cast<int>(pixel));
+					for (; x + 4 <= count; x += 4) _mm_store_si128(reinterpret_cast<__m128i*>(row + x), pixels);
+
+					for (; x < count; x++) row[x] = pixel;
+				}
+
+				void Renderer::clearDepth() const
+				{
+					if (threadPool_)
+					{
+						float* depthBuffer = depthBuffer_;
+						unsigned int windowWidth = windowWidth_;
+
+						threadPool_->parallelFor(0, windowHeight_, 0, [=](size_t begin, size_t end)
+						{
+							std::fill(depthBuffer + begin * windowWidth, depthBuffer + end * windowWidth, FLT_MAX);
+						});
+					}
+					else std::fill(depthBuffer_, depthBuffer_ + (size_t) windowWidth_ * windowHeight_, FLT_MAX);
+
+					std::fill(tileMinDepth_, tileMinDepth_ + (size_t) tileCountX_ * tileCountY_, FLT_MAX);
+					std::fill(tileMaxDepth_, tileMaxDepth_ + (size_t) tileCountX_ * tileCountY_, FLT_MAX);
+				}
+
+			// Pixel:
+
+				void Renderer::pixel(const int x, const int y, COLORREF color) const
+				{
+					if (x < 0 || y < 0 || x >= static_cast<int>(windowWidth_) || y >= static_cast<int>(windowHeight_)) return;
+
+					writePixel(static_cast<size_t>(y) * windowWidth_ + x, toPixel(color));
+				}
+
+				void Renderer::pixel3d(const Vector& point, COLORREF color) const
+				{
+					assert(point.ok());
+
+					Vector fixedPoint = (point  * camera_).perspectived(parallax_) + shift_;
+
+					pixel(static_cast<int>(fixedPoint.x()), static_cast<int>(fixedPoint.y()), color);
+				}
+
+			// Line:
+
+				void Renderer::line(int x0, int y0, int x1, int y1, const COLORREF color) const
+				{
+					LineSegment segment = { static_cast<double>(x0), static_cast<double>(y0), 0, static_cast<double>(x1), static_cast<double>(y1), 0 };
+
+					rasterizeLine(segment, toPixel(color), false, 0, static_cast<int>(windowHeight_) - 1);
+				}
+
+				void Renderer::line(int x0, int y0, double z0, int x1, int y1, double z1, COLORREF color) const
+				{
+					assert(z0 > 0 && z1 > 0);
+
+					LineSegment segment = { static_cast<double>(x0), static_cast<double>(y0), z0, static_cast<double>(x1), static_cast<double>(y1), z1 };
+
+					rasterizeLine(segment, toPixel(color), true, 0, static_cast<int>(windowHeight_) - 1);
+				}
+
+				void Renderer::lines(const LineSegment* segments, size_t count, COLORREF color, bool depthTest) const
+				{
+					assert(segments || count == 0);
+
+					unsigned int pixel = toPixel(color);
+
+					if (!threadPool_ || windowHeight_ == 0)
+					{
+						for (size_t i = 0; i < count; i++) rasterizeLine(segments[i], pixel, depthTest, 0, static_cast<int>(windowHeight_) - 1);
+
+						return;
+					}
+
+					// Every job owns a band of rows, so segments are drawn in order and no pixel is shared:
+
+						const unsigned int MIN_BAND_HEIGHT = 16;
+
+						unsigned int bandHeight = std::max(MIN_BAND_HEIGHT, (windowHeight_ + 4 * threadPool_->getThreadCount() - 1) / (4 * threadPool_->getThreadCount()));
+						unsigned int bandCount	= (windowHeight_ + bandHeight - 1) / bandHeight;
+
+					// Segments binned by the bands their clipped rows touch, keeping their order within a band:
+
+						double margin = lineSmoothing_ ? 1.5 : 0.5;
+
+						std::vector<unsigned int> firstBands = std::vector<unsigned int>(count);
+						std::vector<unsigned int> lastBands	 = std::vector<unsigned int>(count);
+
+						std::vector<size_t> binStarts = std::vector<size_t>(bandCount + 1, 0);
+
+						for (size_t i = 0; i < count; i++)
+						{
+							const LineSegment& segment = segments[i];
+
+							double t0 = 0, t1 = 1;
+
+							if (!clipLine(segment.x0, segment.y0, segment.x1, segment.y1,
+										  -margin, -margin, windowWidth_ - 1 + margin, windowHeight_ - 1 + margin, &t0, &t1))
+							{
+								firstBands[i] = 1;
+								lastBands[i]  = 0;
+
+								continue;
+							}
+
+							double clippedY0 = segment.y0 + t0 * (segment.y1 - segment.y0);
+							double clippedY1 = segment.y0 + t1 * (segment.y1 - segment.y0);
+
+							double minY = std::max(std::min(clippedY0, clippedY1) - margin, 0.0);
+							double maxY = std::min(std::max(clippedY0, clippedY1) + margin, windowHeight_ - 1.0);
+
+							firstBands[i] = static_cast<unsigned int>(floor(minY)) / bandHeight;
+							lastBands[i]  = static_cast<unsigned int>(ceil(maxY))  / bandHeight;
+
+							for (unsigned int band = firstBands[i]; band <= lastBands[i]; band++) binStarts[band + 1]++;
+						}
+
+						for (unsigned int band = 0; band < bandCount; band++) binStarts[band + 1] += binStarts[band];
+
+						std::vector<unsigned int> binned = std::vector<unsigned int>(binStarts[bandCount]);
+						std::vector<size_t> binEnds = std::vector<size_t>(binStarts.begin(), binStarts.end() - 1);
+
+						for (size_t i = 0; i < count; i++)
+						{
+							for (unsigned int band = firstBands[i]; band <= lastBands[i]; band++) binned[binEnds[band]++] = static_cast<unsigned int>(i);
+						}
+
+					parallelFor(threadPool_, 0, bandCount, 1, [&](size_t begin, size_t end)
+					{
+						for (size_t band = begin; band < end; band++)
+						{
+							int firstY = static_cast<int>(band * bandHeight);
+							int lastY  = static_cast<int>(std::min<size_t>((band + 1) * bandHeight, windowHeight_)) - 1;
+
+							for (size_t i = binStarts[band]; i < binStarts[band + 1]; i++)
+							{
+								rasterizeLine(segments[binned[i]], pixel, depthTest, firstY, lastY);
+							}
+						}
+					});
+				}
+
+				void Renderer::line3d(const Vector& point0, const Vector& point1, const COLORREF color) const
+				{
+					assert(point0.ok());
+					assert(point1.ok());
+
+					Vector viewPoint0 = point0 * camera_;
+					Vector viewPoint1 = point1 * camera_;
+
+					// Cut just in front of the camera plane, the part behind it has no projection:
+
+						const double NEAR_Z = 1e-3;
+
+						if (viewPoint0.z() < NEAR_Z && viewPoint1.z() < NEAR_Z) return;
+
+						if (viewPoint0.z() < NEAR_Z) viewPoint0 = viewPoint0 + (viewPoint1 - viewPoint0) * ((NEAR_Z - viewPoint0.z()) / (viewPoint1.z() - viewPoint0.z()));
+						if (viewPoint1.z() < NEAR_Z) viewPoint1 = viewPoint1 + (viewPoint0 - viewPoint1) * ((NEAR_Z - viewPoint1.z()) / (viewPoint0.z() - viewPoint1.z()));
+
+					Vector fixedPoint0 = viewPoint0.perspectived(parallax_) + shift_;
+					Vector fixedPoint1 = viewPoint1.perspectived(parallax_) + shift_;
+
+					LineSegment segment = { fixedPoint0.x(), fixedPoint0.y(), 0, fixedPoint1.x(), fixedPoint1.y(), 0 };
+
+					rasterizeLine(segment, toPixel(color), false, 0, static_cast<int>(windowHeight_) - 1);
+				}
+
+				bool Renderer::clipLine(double x0, double y0, double x1, double y1, double minX, double minY, double maxX, double maxY, double* t0, double* t1)
+				{
+					assert(t0);
+					assert(t1);
+
+					// Distances to the four sides over their rates of change along the segment:
+
+						double p[4] = { x0 - x1, x1 - x0, y0 - y1, y1 - y0 };
+						double q[4] = { x0 - minX, maxX - x0, y0 - minY, maxY - y0 };
+
+					*t0 = 0;
+					*t1 = 1;
+
+					for (size_t side = 0; side < 4; side++)
+					{
+						if (p[side] == 0)
+						{
+							if (q[side] < 0) return false;
+
+							continue;
+						}
+
+						double t = q[side] / p[side];
+
+						if (p[side] < 0)
+						{
+							if (t > *t1) return false;
+							*t0 = std::max(*t0, t);
+						}
+						else
+						{
+							if (t < *t0) return false;
+							*t1 = std::min(*t1, t);
+						}
+					}
+
+					return true;
+				}
+
+				void Renderer::rasterizeLine(const LineSegment& segment, unsigned int pixel, bool depthTest, int firstY, int lastY) const
+				{
+					assert(!depthTest || (segment.z0 > 0 && segment.z1 > 0));
+
+					// Clipping to the area of the rows' pixels, smooth lines also touch the pixels next to it:
+
+						double margin = lineSmoothing_ ? 1.5 : 0.5;
+
+						double t0 = 0, t1 = 1;
+
+						if (!clipLine(segment.x0, segment.y0, segment.x1, segment.y1,
+									  -margin, firstY - margin, windowWidth_ - 1 + margin, lastY + margin, &t0, &t1)) return;
+
+					// One pixel (or two smooth ones) per step along the major axis u, v is the other one:
+
+						bool xMajor = fabs(segment.x1 - segment.x0) >= fabs(segment.y1 - segment.y0);
+
+						double u0 = xMajor ? segment.x0 : segment.y0;
+						double v0 = xMajor ? segment.y0 : segment.x0;
+
+						double dU = xMajor ? segment.x1 - segment.x0 : segment.y1 - segment.y0;
+						double dV = xMajor ? segment.y1 - segment.y0 : segment.x1 - segment.x0;
+
+						double slope = (dU != 0) ? dV / dU : 0;
+
+						double clippedU0 = u0 + t0 * dU;
+						double clippedU1 = u0 + t1 * dU;
+
+						int firstU = static_cast<int>(floor(std::min(clippedU0, clippedU1) + 0.5));
+						int lastU  = static_cast<int>(floor(std::max(clippedU0, clippedU1) + 0.5));
+
+					// 1/z is linear along the segment:
+
+						double inverseZ0	 = depthTest ? 1 / segment.z0 : 0;
+						double inverseZSlope = (depthTest && dU != 0) ? (1 / segment.z1 - 1 / segment.z0) / dU : 0;
+
+						// Surfaces round depth at pixel centers, the line on their edges, so it wins within a percent:
+						const float DEPTH_TOLERANCE = 1.01f;
+
+					float z = 0;
+
+					auto plot = [&](int u, int v, unsigned int coverage)
+					{
+						int x = xMajor ? u : v;
+						int y = xMajor ? v : u;
+
+						if (coverage == 0 || x < 0 || x >= static_cast<int>(windowWidth_) || y < firstY || y > lastY) return;
+
+						size_t index = static_cast<size_t>(y) * windowWidth_ + x;
+
+						if (depthTest && !(z <= depthBuffer_[index] * DEPTH_TOLERANCE)) return;
+
+						if (coverage >= 256) writePixel(index, pixel);
+						else				 blendPixel(index, pixel, coverage);
+					};
+
+					for (int u = firstU; u <= lastU; u++)
+					{
+						// Positions come from the whole segment, so clipping it to bands doesn't move any pixel:
+						double v = v0 + slope * (u - u0);
+
+						if (depthTest) z = static_cast<float>(1 / (inverseZ0 + inverseZSlope * (u - u0)));
+
+						if (lineSmoothing_)
+						{
+							double lowerV = floor(v);
+							unsigned int coverage = static_cast<unsigned int>((v - lowerV) * 256 + 0.5);
+
+							plot(u, static_cast<int>(lowerV),	  256 - coverage);
+							plot(u, static_cast<int>(lowerV) + 1, coverage);
+						}
+						else plot(u, static_cast<int>(floor(v + 0.5)), 256);
+					}
+				}
+
+				void Renderer::writePixel(size_t index, unsigned int pixel) const
+				{
+					// Pixels and lines have no surface, deferred shading leaves their colors as they are:
+					if (normalBuffer_) normalBuffer_[index] = 0;
+
+					if (sampleColors_) _mm_store_si128(reinterpret_cast<__m128i*>(sampleColors_ + index * SAMPLE_COUNT), _mm_set1_epi32(static_cast<int>(pixel)));
+					else			   colorBuffer_[index] = pixel;
+				}
+
+				void Renderer::blendPixel(size_t index, unsigned int pixel, unsigned int coverage) const
+				{
+					assert(coverage <= 256);
+
+					if (normalBuffer_) normalBuffer_[index] = 0;
+
+					if (sampleColors_)
+					{
+						for (size_t sample = 0; sample < SAMPLE_COUNT; sample++)
+						{
+							sampleColors_[index * SAMPLE_COUNT + sample] = blend(sampleColors_[index * SAMPLE_COUNT + sample], pixel, coverage);
+						}
+					}
+					else colorBuffer_[index] = blend(colorBuffer_[index], pixel, coverage);
+				}
+
+				unsigned int Renderer::blend(unsigned int destination, unsigned int pixel, unsigned int coverage)
+				{
+					// Red and blue in one multiplication, blue's product fits below red:
+
+						unsigned int redBlue = (((pixel & 0xFF00FF) * coverage + (destination & 0xFF00FF) * (256 - coverage)) >> 8) & 0xFF00FF;
+						unsigned int green	 = (((pixel & 0x00FF00) * coverage + (destination & 0x00FF00) * (256 - coverage)) >> 8) & 0x00FF00;
+
+					return redBlue | green;
+				}
+
+			// Triangle:
+
+				void Renderer::triangle3d(const Vector& point0, const Vector& point1, const Vector& point2, const Vector& normal, COLORREF color) const
+				{
+					ALLOCATION_STAGE(ALLOCATION_TRIANGLES);
+					TRACE_SCOPE("Renderer::triangle3d");
+
+					assert(normal.ok());
+					assert(point0.ok());
+					assert(point1.ok());
+					assert(point2.ok());
+
+					// Both faces cast shadows, so open meshes do too and the map holds the surfaces nearest to the light:
+
+						if (shadowPass_)
+						{
+							if (color >> 24) return;
+
+							double mapPoint0[3] = {}, mapPoint1[3] = {}, mapPoint2[3] = {};
+
+							light_.apply(point0, mapPoint0);
+							light_.apply(point1, mapPoint1);
+							light_.apply(point2, mapPoint2);
+
+							shadowTriangle(mapPoint0, mapPoint1, mapPoint2);
+
+							return;
+						}
+
+					Vector viewNormal = normal * camera_ - Vector(camera_[3][0], camera_[3][1], camera_[3][2]);
+
+					if (viewNormal.z() > 0)
+					{
+						Vector viewPoints[3] = { point0 * camera_, point1 * camera_, point2 * camera_ };
+
+						// Clipped by the near plane (Sutherland-Hodgman), which leaves up to four points drawn as a fan:
+
+							double clipped[4][3] = {};
+							size_t clippedCount = 0;
+
+							for (size_t i = 0; i < 3; i++)
+							{
+								const Vector& current = viewPoints[i];
+								const Vector& next	  = viewPoints[(i + 1) % 3];
+
+								bool currentInside = current.z() >= NEAR_PLANE_Z;
+								bool nextInside	   = next.z()	 >= NEAR_PLANE_Z;
+
+								if (currentInside)
+								{
+									clipped[clippedCount][0] = current.x();
+									clipped[clippedCount][1] = current.y();
+									clipped[clippedCount][2] = current.z();
+
+									clippedCount++;
+								}
+
+								if (currentInside != nextInside)
+								{
+									double t = (NEAR_PLANE_Z - current.z()) / (next.z() - current.z());
+
+									clipped[clippedCount][0] = current.x() + (next.x() - current.x()) * t;
+									clipped[clippedCount][1] = current.y() + (next.y() - current.y()) * t;
+									clipped[clippedCount][2] = NEAR_PLANE_Z;
+
+									clippedCount++;
+								}
+							}
+
+							if (clippedCount < 3) return;
+
+						int projected[4][2] = {};
+
+						for (size_t i = 0; i < clippedCount; i++)
+						{
+							projected[i][0] = static_cast<int>(parallax_ * clipped[i][0] / clipped[i][2] + shift_.x());
+							projected[i][1] = static_cast<int>(parallax_ * clipped[i][1] / clipped[i][2] + shift_.y());
+						}
+
+						// Faces turned away from the camera are the drawn ones, so their normal is flipped to face it for lighting:
+						unsigned int packedNormal = normalBuffer_ ? packNormal(-viewNormal.x(), -viewNormal.y(), -viewNormal.z()) : 0;
+
+						for (size_t i = 1; i + 1 < clippedCount; i++)
+						{
+							depthTriangle(projected[0][0],	   projected[0][1],		clipped[0][2],
+										  projected[i][0],	   projected[i][1],		clipped[i][2],
+										  projected[i + 1][0], projected[i + 1][1], clipped[i + 1][2], color, packedNormal);
+						}
+					}
+				}
+
+				void Renderer::triangle(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color) const
+				{
+					if (color >> 24) queueTransparent(x0, y0, x1, y1, x2, y2, color, NULL);
+					else			 fillTriangle(x0, y0, x1, y1, x2, y2, color, NULL, 0);
+				}
+
+				void Renderer::triangle(int x0, int y0, double z0, int x1, int y1, double z1, int x2, int y2, double z2, COLORREF color) const
+				{
+					depthTriangle(x0, y0, z0, x1, y1, z1, x2, y2, z2, color, 0);
+				}
+
+				void Renderer::depthTriangle(int x0, int y0, double z0, int x1, int y1, double z1, int x2, int y2, double z2, COLORREF color, unsigned int normal) const
+				{
+					assert(z0 > 0 && z1 > 0 && z2 > 0);
+
+					hiZStats_.trianglesTested++;
+
+					// Bounding box clipped to the window:
+
+						int minX = std::max(std::min(std::min(x0, x1), x2), 0);
+						int minY = std::max(std::min(std::min(y0, y1), y2), 0);
+
+						int maxX = std::min(std::max(std::max(x0, x1), x2), static_cast<int>(windowWidth_)  - 1);
+						int maxY = std::min(std::max(std::max(y0, y1), y2), static_cast<int>(windowHeight_) - 1);
+
+						if (minX > maxX || minY > maxY) return;
+
+					// Depth plane:
+
+						DepthPlane plane = {};
+
+						plane.nearZ = static_cast<float>(std::min(std::min(z0, z1), z2));
+						plane.farZ  = static_cast<float>(std::max(std::max(z0, z1), z2));
+
+						double det = static_cast<double>(x1 - x0) * (y2 - y0) - static_cast<double>(x2 - x0) * (y1 - y0);
+
+						if (det != 0)
+						{
+							double dW1 = 1 / z1 - 1 / z0;
+							double dW2 = 1 / z2 - 1 / z0;
+
+							plane.a = (dW1 * (y2 - y0) - dW2 * (y1 - y0)) / det;
+							plane.b = ((x1 - x0) * dW2 - (x2 - x0) * dW1) / det;
+							plane.c = 1 / z0 - plane.a * x0 - plane.b * y0;
+						}
+						else plane.c = 1 / plane.nearZ;
+
+					// Whole triangle rejection by the tiles' farthest depth:
+
+						if (hiZVisibleTiles(minX, minY, maxX, maxY, plane.nearZ) == 0)
+						{
+							hiZStats_.trianglesRejected++;
+							hiZStats_.pixelsRejected += static_cast<unsigned long long>(fabs(det) / 2);
+
+							return;
+						}
+
+					// Transparent triangles neither hide anything nor write depth:
+
+						if (color >> 24)
+						{
+							queueTransparent(x0, y0, x1, y1, x2, y2, color, &plane);
+							return;
+						}
+
+					fillTriangle(x0, y0, x1, y1, x2, y2, color, &plane, normal);
+
+					updateHiZ();
+				}
+
+				void Renderer::fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color, const DepthPlane* plane, unsigned int normal) const
+				{
+					TRACE_SCOPE("Renderer::fillTriangle");
+
+					if (sampleColors_)
+					{
+						multisampleTriangle(x0, y0, x1, y1, x2, y2, toPixel(color), normal, plane);
+						return;
+					}
+
+					unsigned int pixel = toPixel(color);
+
+					// Half-open, so triangles of a mesh never write a pixel twice:
+					forEachSpan(x0, y0, x1, y1, x2, y2, windowWidth_, windowHeight_, true, [&](int y, int left, int right)
+					{
+						if (plane) depthSpan(y, left, right, pixel, normal, *plane);
+						else
+						{
+							fillRow(colorBuffer_ + static_cast<size_t>(y) * windowWidth_ + left, right - left + 1, pixel);
+
+							if (normalBuffer_) fillRow(normalBuffer_ + static_cast<size_t>(y) * windowWidth_ + left, right - left + 1, 0);
+						}
+					});
+				}
+
+				template <typename SpanFunction>
+				void Renderer::forEachSpan(int x0, int y0, int x1, int y1, int x2, int y2, unsigned int width, unsigned int height, bool halfOpen, const SpanFunction& span) const
+				{
+					// Sorting points by y:
+
+						if (y0 > y1)
+						{
+							std::swap(x0, x1);
+							std::swap(y0, y1);
+						}
+
+						if (y1 > y2)
+						{
+							std::swap(x1, x2);
+							std::swap(y1, y2);
+						}
+
+						if (y0 > y1)
+						{
+							std::swap(x0, x1);
+							std::swap(y0, y1);
+						}
+
+					// Rows are clipped to the target once, spans only have their ends clamped.
+					// Half-open triangles own rows y0 to y2 - 1, closed ones y0 to y2:
+
+						int firstY = std::max(y0, 0);
+						int lastY  = std::min(halfOpen ? y2 - 1 : y2, static_cast<int>(height) - 1);
+
+						int lastX = static_cast<int>(width) - 1;
+
+					// Edge x per row, the long edge goes from point 0 to point 2:
+
+						double longSlope   = (y2 != y0) ? static_cast<double>(x2 - x0) / (y2 - y0) : 0;
+						double upperSlope  = (y1 != y0) ? static_cast<double>(x1 - x0) / (y1 - y0) : 0;
+						double lowerSlope  = (y2 != y1) ? static_cast<double>(x2 - x1) / (y2 - y1) : 0;
+
+					for (int y = firstY; y <= lastY; y++)
+					{
+						double longX  = x0 + longSlope * (y - y0);
+						double shortX = (y < y1 || y1 == y2) ? x0 + upperSlope * (y - y0) : x1 + lowerSlope * (y - y1);
+
+						// Closed rule only, a flat triangle is a single row through all of its points.
+						// Half-open ones have no rows at all, lastY is already above y0 == y2:
+
+							double minX = std::min(longX, shortX);
+							double maxX = std::max(longX, shortX);
+
+							if (y0 == y2)
+							{
+								minX = std::min(std::min(x0, x1), x2);
+								maxX = std::max(std::max(x0, x1), x2);
+							}
+
+						// Closed spans round both ends, which keeps at least a pixel on every row the triangle crosses.
+						// Half-open spans take the pixels whose centers are in [minX, maxX), thin triangles may skip rows:
+
+							int left  = static_cast<int>(halfOpen ? ceil(minX)	   : floor(minX + 0.5));
+							int right = static_cast<int>(halfOpen ? ceil(maxX) - 1 : floor(maxX + 0.5));
+
+							left  = std::max(left,	0);
+							right = std::min(right, lastX);
+
+							if (left > right) continue;
+
+						span(y, left, right);
+					}
+				}
+
+				// Tile by tile, so a tile's depth range is checked once, and four pixels at a time inside:
+
+					void Renderer::depthSpan(int y, int left, int right, unsigned int pixel, unsigned int normal, const DepthPlane& plane) const
+					{
+						float*		  depthRow = depthBuffer_ + static_cast<size_t>(y) * windowWidth_;
+						unsigned int* colorRow = colorBuffer_ + static_cast<size_t>(y) * windowWidth_;
+
+						unsigned int* normalRow = normalBuffer_ ? normalBuffer_ + static_cast<size_t>(y) * windowWidth_ : NULL;
+
+						size_t tileRow = static_cast<size_t>(y >> HIZ_TILE_SHIFT) * tileCountX_;
+
+						// 1/z of the row start in double, the steps between lanes are small enough for float:
+						double rowInverseZ = plane.b * y + plane.c;
+
+						__m128 laneSteps = _mm_mul_ps(_mm_set1_ps(static_cast<float>(plane.a)), _mm_set_ps(3, 2, 1, 0));
+
+						__m128 nearZ = _mm_set1_ps(plane.nearZ);
+						__m128 farZ	 = _mm_set1_ps(plane.farZ);
+
+						__m128i pixels	= _mm_set1_epi32(static_cast<int>(pixel));
+						__m128i normals = _mm_set1_epi32(static_cast<int>(normal));
+
+						for (int segmentStart = left; segmentStart <= right; )
+						{
+							size_t tile = tileRow + (segmentStart >> HIZ_TILE_SHIFT);
+							int segmentEnd = std::min(right, (((segmentStart >> HIZ_TILE_SHIFT) + 1) << HIZ_TILE_SHIFT) - 1);
+
+							// Everything in the tile is already nearer than the whole triangle:
+
+								if (plane.nearZ >= tileMaxDepth_[tile])
+								{
+									hiZStats_.pixelsRejected += segmentEnd - segmentStart + 1;
+
+									segmentStart = segmentEnd + 1;
+									continue;
+								}
+
+							// Per-pixel depth is read only if the tile's nearest depth doesn't accept the triangle at once:
+							__m128 testDepth = _mm_castsi128_ps(_mm_set1_epi32(plane.farZ >= tileMinDepth_[tile] ? -1 : 0));
+
+							__m128 segmentMin = _mm_set1_ps(FLT_MAX);
+							int written = 0;
+
+							for (int x = segmentStart; x <= segmentEnd; x += 4)
+							{
+								int count = std::min(4, segmentEnd - x + 1);
+
+								__m128 lanes = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(count)));
+
+								// Edge pixels may lie slightly outside of the triangle, so depth is clamped to its range:
+
+									__m128 inverseZ = _mm_add_ps(_mm_set1_ps(static_cast<float>(rowInverseZ + plane.a * x)), laneSteps);
+
+									__m128 positive = _mm_cmpgt_ps(inverseZ, _mm_setzero_ps());
+									__m128 z = _mm_or_ps(_mm_and_ps(positive, _mm_div_ps(_mm_set1_ps(1), inverseZ)), _mm_andnot_ps(positive, farZ));
+
+									z = _mm_min_ps(_mm_max_ps(z, nearZ), farZ);
+
+								// Partial blocks go through copies, so nothing past the span is touched:
+
+									float		 oldDepths[4] = {};
+									unsigned int oldPixels[4] = {};
+
+									memcpy(oldDepths, depthRow + x, count * sizeof(float));
+									memcpy(oldPixels, colorRow + x, count * sizeof(unsigned int));
+
+									__m128 oldDepth = _mm_loadu_ps(oldDepths);
+
+								__m128 pass = _mm_and_ps(lanes, _mm_or_ps(_mm_andnot_ps(testDepth, lanes), _mm_cmplt_ps(z, oldDepth)));
+
+								int passMask = _mm_movemask_ps(pass);
+								if (passMask == 0) continue;
+
+								written |= passMask;
+
+								__m128	newDepth = _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldDepth));
+								__m128i newPixel = _mm_or_si128(_mm_and_si128(_mm_castps_si128(pass), pixels),
+																_mm_andnot_si128(_mm_castps_si128(pass), _mm_loadu_si128(reinterpret_cast<const __m128i*>(oldPixels))));
+
+								segmentMin = _mm_min_ps(segmentMin, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, _mm_set1_ps(FLT_MAX))));
+
+								_mm_storeu_ps(oldDepths, newDepth);
+								_mm_storeu_si128(reinterpret_cast<__m128i*>(oldPixels), newPixel);
+
+								memcpy(depthRow + x, oldDepths, count * sizeof(float));
+								memcpy(colorRow + x, oldPixels, count * sizeof(unsigned int));
+
+								if (normalRow)
+								{
+									unsigned int oldNormals[4] = {};
+									memcpy(oldNormals, normalRow + x, count * sizeof(unsigned int));
+
+									__m128i newNormal = _mm_or_si128(_mm_and_si128(_mm_castps_si128(pass), normals),
+																	 _mm_andnot_si128(_mm_castps_si128(pass), _mm_loadu_si128(reinterpret_cast<const __m128i*>(oldNormals))));
+
+									_mm_storeu_si128(reinterpret_cast<__m128i*>(oldNormals), newNormal);
+									memcpy(normalRow + x, oldNormals, count * sizeof(unsigned int));
+								}
+							}
+
+							if (written)
+							{
+								float minima[4] = {};
+								_mm_storeu_ps(minima, segmentMin);
+
+								float minDepth = std::min(std::min(minima[0], minima[1]), std::min(minima[2], minima[3]));
+								if (minDepth < tileMinDepth_[tile]) tileMinDepth_[tile] = minDepth;
+
+								if (!tileDirty_[tile])
+								{
+									tileDirty_[tile] = true;
+									dirtyTiles_[dirtyTileCount_++] = static_cast<unsigned int>(tile);
+								}
+							}
+
+							segmentStart = segmentEnd + 1;
+						}
+					}
+
+			// Multisampling:
+
+				void Renderer::multisampleTriangle(int x0, int y0, int x1, int y1, int x2, int y2, unsigned int pixel, unsigned int normal, const DepthPlane* plane) const
+				{
+					// Rotated grid, in eighths of a pixel from its center:
+
+						static const float SAMPLE_X[SAMPLE_COUNT] = { -1,  3, 1, -3 };
+						static const float SAMPLE_Y[SAMPLE_COUNT] = { -3, -1, 3,  1 };
+
+						__m128 sampleX = _mm_mul_ps(_mm_loadu_ps(SAMPLE_X), _mm_set1_ps(0.125f));
+						__m128 sampleY = _mm_mul_ps(_mm_loadu_ps(SAMPLE_Y), _mm_set1_ps(0.125f));
+
+					// Edge functions a * x + b * y + c, positive inside whatever the winding:
+
+						double area = static_cast<double>(x1 - x0) * (y2 - y0) - static_cast<double>(x2 - x0) * (y1 - y0);
+						if (area == 0) return;
+
+						int pointX[3] = { x0, x1, x2 };
+						int pointY[3] = { y0, y1, y2 };
+
+						double edgeA[3] = {}, edgeB[3] = {}, edgeC[3] = {};
+
+						__m128 edgeSteps[3];
+						__m128 edgeLimits[3];
+
+						for (size_t edge = 0; edge < 3; edge++)
+						{
+							size_t next = (edge + 1) % 3;
+
+							edgeA[edge] = pointY[edge] - pointY[next];
+							edgeB[edge] = pointX[next] - pointX[edge];
+
+							if (area < 0)
+							{
+								edgeA[edge] = -edgeA[edge];
+								edgeB[edge] = -edgeB[edge];
+							}
+
+							edgeC[edge] = -(edgeA[edge] * pointX[edge] + edgeB[edge] * pointY[edge]);
+
+							edgeSteps[edge] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(static_cast<float>(edgeA[edge])), sampleX),
+														 _mm_mul_ps(_mm_set1_ps(static_cast<float>(edgeB[edge])), sampleY));
+
+							// Samples on a shared edge belong to the triangle it is the top or left edge of,
+							// edge values are multiples of 1/8 here, so half of that makes them inclusive:
+
+								bool topLeft = edgeA[edge] > 0 || (edgeA[edge] == 0 && edgeB[edge] > 0);
+
+								edgeLimits[edge] = _mm_set1_ps(topLeft ? -0.0625f : 0);
+						}
+
+					// Depth of every sample from the pixel's one:
+
+						__m128 depthSteps = _mm_setzero_ps();
+
+						if (plane) depthSteps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(static_cast<float>(plane->a)), sampleX),
+														   _mm_mul_ps(_mm_set1_ps(static_cast<float>(plane->b)), sampleY));
+
+					__m128i pixels = _mm_set1_epi32(static_cast<int>(pixel));
+
+					int firstY = std::max(std::min(std::min(y0, y1), y2), 0);
+					int lastY  = std::min(std::max(std::max(y0, y1), y2), static_cast<int>(windowHeight_) - 1);
+
+					for (int y = firstY; y <= lastY; y++)
+					{
+						// Pixels whose samples may be covered, from where the triangle crosses the samples' rows:
+
+							double minX = DBL_MAX, maxX = -DBL_MAX;
+
+							for (size_t edge = 0; edge < 3; edge++)
+							{
+								size_t next = (edge + 1) % 3;
+
+								double lowY  = std::max<double>(std::min(pointY[edge], pointY[next]), y - 0.375);
+								double highY = std::min<double>(std::max(pointY[edge], pointY[next]), y + 0.375);
+
+								if (lowY > highY) continue;
+
+								if (pointY[edge] == pointY[next])
+								{
+									minX = std::min<double>(minX, std::min(pointX[edge], pointX[next]));
+									maxX = std::max<double>(maxX, std::max(pointX[edge], pointX[next]));
+
+									continue;
+								}
+
+								double slope = static_cast<double>(pointX[next] - pointX[edge]) / (pointY[next] - pointY[edge]);
+
+								double lowX  = pointX[edge] + slope * (lowY  - pointY[edge]);
+								double highX = pointX[edge] + slope * (highY - pointY[edge]);
+
+								minX = std::min(minX, std::min(lowX, highX));
+								maxX = std::max(maxX, std::max(lowX, highX));
+							}
+
+							if (minX > maxX) continue;
+
+							int left  = std::max(static_cast<int>(ceil (minX - 0.375)), 0);
+							int right = std::min(static_cast<int>(floor(maxX + 0.375)), static_cast<int>(windowWidth_) - 1);
+
+						size_t tileRow = static_cast<size_t>(y >> HIZ_TILE_SHIFT) * tileCountX_;
+
+						for (int x = left; x <= right; x++)
+						{
+							size_t tile = tileRow + (x >> HIZ_TILE_SHIFT);
+
+							if (plane && plane->nearZ >= tileMaxDepth_[tile])
+							{
+								hiZStats_.pixelsRejected++;
+								continue;
+							}
+
+							// Coverage of the four samples at once:
+
+								__m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+								for (size_t edge = 0; edge < 3; edge++)
+								{
+									__m128 value = _mm_add_ps(_mm_set1_ps(static_cast<float>(edgeA[edge] * x + edgeB[edge] * y + edgeC[edge])), edgeSteps[edge]);
+
+									covered = _mm_and_ps(covered, _mm_cmpgt_ps(value, edgeLimits[edge]));
+								}
+
+								if (_mm_movemask_ps(covered) == 0) continue;
+
+							size_t index = static_cast<size_t>(y) * windowWidth_ + x;
+
+							__m128i* colors = reinterpret_cast<__m128i*>(sampleColors_ + index * SAMPLE_COUNT);
+							__m128 pass = covered;
+
+							if (plane)
+							{
+								// Clamped to the triangle's range like depthSpan() does:
+
+									__m128 inverseZ = _mm_add_ps(_mm_set1_ps(static_cast<float>(plane->a * x + plane->b * y + plane->c)), depthSteps);
+
+									__m128 positive = _mm_cmpgt_ps(inverseZ, _mm_setzero_ps());
+									__m128 z = _mm_or_ps(_mm_and_ps(positive, _mm_div_ps(_mm_set1_ps(1), inverseZ)), _mm_andnot_ps(positive, _mm_set1_ps(plane->farZ)));
+
+									z = _mm_min_ps(_mm_max_ps(z, _mm_set1_ps(plane->nearZ)), _mm_set1_ps(plane->farZ));
+
+								float* depths = sampleDepths_ + index * SAMPLE_COUNT;
+								__m128 oldDepth = _mm_load_ps(depths);
+
+								pass = _mm_and_ps(pass, _mm_cmplt_ps(z, oldDepth));
+								if (_mm_movemask_ps(pass) == 0) continue;
+
+								__m128 newDepth = _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldDepth));
+								_mm_store_ps(depths, newDepth);
+
+								// The pixel keeps its farthest sample, so the depth pyramid stays conservative:
+
+									depthBuffer_[index] = std::max(std::max(depths[0], depths[1]), std::max(depths[2], depths[3]));
+
+									float minDepth = std::min(std::min(depths[0], depths[1]), std::min(depths[2], depths[3]));
+
+									if (minDepth < tileMinDepth_[tile]) tileMinDepth_[tile] = minDepth;
+
+									if (!tileDirty_[tile])
+									{
+										tileDirty_[tile] = true;
+										dirtyTiles_[dirtyTileCount_++] = static_cast<unsigned int>(tile);
+									}
+							}
+
+							__m128i mask = _mm_castps_si128(pass);
+							_mm_store_si128(colors, _mm_or_si128(_mm_and_si128(mask, pixels), _mm_andnot_si128(mask, _mm_load_si128(colors))));
+
+							// One normal per pixel, the last triangle to cover any of its samples:
+							if (normalBuffer_) normalBuffer_[index] = normal;
+						}
+					}
+				}
+
+				void Renderer::resolveSamples() const
+				{
+					TRACE_SCOPE("Renderer::resolveSamples");
+
+					assert(sampleColors_);
+
+					unsigned int*		colorBuffer	 = colorBuffer_;
+					const unsigned int* sampleColors = sampleColors_;
+
+					parallelFor(threadPool_, 0, (size_t) windowWidth_ * windowHeight_, 0, [=](size_t begin, size_t end)
+					{
+						__m128i zero	 = _mm_setzero_si128();
+						__m128i rounding = _mm_set1_epi16(2);
+
+						for (size_t i = begin; i < end; i++)
+						{
+							__m128i samples = _mm_load_si128(reinterpret_cast<const __m128i*>(sampleColors + i * SAMPLE_COUNT));
+
+							// Channels widened to 16 bits, samples 0 + 2 and 1 + 3 are summed first, then the two sums:
+
+								__m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(samples, zero), _mm_unpackhi_epi8(samples, zero));
+								sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+
+								sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+
+							colorBuffer[i] = static_cast<unsigned int>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+						}
+					});
+				}
+
+			// Transparency:
+
+				void Renderer::queueTransparent(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color, const DepthPlane* plane) const
+				{
+					TransparentTriangle triangle = {};
+
+					triangle.x0 = x0;
+					triangle.y0 = y0;
+					triangle.x1 = x1;
+					triangle.y1 = y1;
+					triangle.x2 = x2;
+					triangle.y2 = y2;
+
+					if (plane) triangle.plane = *plane;
+					triangle.depthTested = plane != NULL;
+
+					triangle.pixel	 = toPixel(color);
+					triangle.opacity = 256 - ((color >> 24) * 256 + 127) / 255;
+
+					triangle.object = objectCount_;
+					triangle.depth	= plane ? (plane->nearZ + plane->farZ) / 2 : 0;
+
+					if (triangle.opacity > 0) transparentTriangles_.push_back(triangle);
+				}
+
+				void Renderer::drawTransparent() const
+				{
+					TRACE_SCOPE("Renderer::drawTransparent");
+
+					if (transparentTriangles_.empty()) return;
+
+					size_t pixelCount = (size_t) windowWidth_ * windowHeight_;
+
+					if (accumulation_ == NULL)
+					{
+						// Objects from the farthest by their triangles' average depth, keeping the order inside each:
+
+							std::vector<double> objectDepths = std::vector<double>(objectCount_ + 1);
+							std::vector<size_t> objectSizes	 = std::vector<size_t>(objectCount_ + 1);
+
+							for (size_t i = 0; i < transparentTriangles_.size(); i++)
+							{
+								objectDepths[transparentTriangles_[i].object] += transparentTriangles_[i].depth;
+								objectSizes [transparentTriangles_[i].object]++;
+							}
+
+							for (size_t i = 0; i < objectDepths.size(); i++)
+							{
+								if (objectSizes[i]) objectDepths[i] /= objectSizes[i];
+							}
+
+							std::stable_sort(transparentTriangles_.begin(), transparentTriangles_.end(), [&](const TransparentTriangle& first, const TransparentTriangle& second)
+							{
+								double firstDepth  = objectDepths[first.object];
+								double secondDepth = objectDepths[second.object];
+
+								return firstDepth != secondDepth ? firstDepth > secondDepth : first.object < second.object;
+							});
+
+						for (size_t i = 0; i < transparentTriangles_.size(); i++)
+						{
+							const TransparentTriangle& triangle = transparentTriangles_[i];
+
+							forEachSpan(triangle.x0, triangle.y0, triangle.x1, triangle.y1, triangle.x2, triangle.y2, windowWidth_, windowHeight_, true, [&](int y, int left, int right)
+							{
+								blendSpan(y, left, right, triangle.pixel, triangle.opacity, triangle.depthTested ? &triangle.plane : NULL);
+							});
+						}
+					}
+					else
+					{
+						std::fill(accumulation_, accumulation_ + 4 * pixelCount, 0.0f);
+						std::fill(revealage_,	 revealage_	   +	 pixelCount, 1.0f);
+
+						for (size_t i = 0; i < transparentTriangles_.size(); i++)
+						{
+							const TransparentTriangle& triangle = transparentTriangles_[i];
+
+							forEachSpan(triangle.x0, triangle.y0, triangle.x1, triangle.y1, triangle.x2, triangle.y2, windowWidth_, windowHeight_, true, [&](int y, int left, int right)
+							{
+								accumulateSpan(y, left, right, triangle.pixel, triangle.opacity, triangle.depthTested ? &triangle.plane : NULL);
+							});
+						}
 
-			// Constructor && destructor:
+						// Average color of the layers over what shows through all of them:
 
-				Renderer(unsigned int windowWidth, unsigned int windowHeight, COLORREF backgroundColor, const Matrix& startCamera, const Vector& shift, double parallax);
+							unsigned int* colorBuffer  = colorBuffer_;
+							const float*  accumulation = accumulation_;
+							const float*  revealage	   = revealage_;
 
-			// Functions:
+							parallelFor(threadPool_, 0, pixelCount, 0, [=](size_t begin, size_t end)
+							{
+								for (size_t i = begin; i < end; i++)
+								{
+									if (revealage[i] >= 1) continue;
 
-				// Debugging:
+									__m128 sum = _mm_load_ps(accumulation + 4 * i);
 
-					bool ok() const;
+									float weight = 0;
+									_mm_store_ss(&weight, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3)));
 
-				// Camera stuff:
+									__m128 layers = _mm_mul_ps(sum, _mm_set1_ps((1 - revealage[i]) / std::max(weight, 1e-5f)));
 
-					Renderer& moveCamera(Matrix movement);
+									__m128i behind = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(colorBuffer[i])), _mm_setzero_si128()), _mm_setzero_si128());
+									__m128 color = _mm_add_ps(layers, _mm_mul_ps(_mm_cvtepi32_ps(behind), _mm_set1_ps(revealage[i])));
 
-				// Rendering:
+									__m128i channels = _mm_cvtps_epi32(_mm_min_ps(color, _mm_set1_ps(255)));
+									channels = _mm_packs_epi32(channels, channels);
 
-					void  startRendering() const;
-					void finishRendering() const;
+									colorBuffer[i] = static_cast<unsigned int>(_mm_cvtsi128_si32(_mm_packus_epi16(channels, channels))) & 0xFFFFFF;
+								}
+							});
+					}
 
-					void clear() const;
+					transparentTriangles_.clear();
+					objectCount_ = 0;
+				}
 
-					void pixel(const int x, const int y, COLORREF color) const;
-					void pixel3d(const Vector& point, COLORREF color) const;
+				void Renderer::blendSpan(int y, int left, int right, unsigned int pixel, unsigned int opacity, const DepthPlane* plane) const
+				{
+					const float*  depthRow = depthBuffer_ + static_cast<size_t>(y) * windowWidth_;
+					unsigned int* colorRow = colorBuffer_ + static_cast<size_t>(y) * windowWidth_;
 
-					void line(int x0, int y0, int x1, int y1, const COLORREF color) const;
-					void line3d(const Vector& point0, const Vector& point1, const COLORREF color) const;
+					__m128i zero = _mm_setzero_si128();
 
-					void triangle3d(const Vector& point0, const Vector& point1, const Vector& point2, const Vector& normal, COLORREF color) const;
-					void triangle(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color) const;
+					// dst * (256 - opacity) + src * opacity stays below 65536, so the 16 bit lanes never overflow:
 
-		private:
+						__m128i source		  = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(pixel)), zero), _mm_set1_epi16(static_cast<short>(opacity)));
+						__m128i transparency  = _mm_set1_epi16(static_cast<short>(256 - opacity));
 
-			unsigned int windowWidth_;
-			unsigned int windowHeight_;
+					double rowInverseZ = plane ? plane->b * y + plane->c : 0;
+					__m128 laneSteps   = plane ? _mm_mul_ps(_mm_set1_ps(static_cast<float>(plane->a)), _mm_set_ps(3, 2, 1, 0)) : _mm_setzero_ps();
 
-			COLORREF backgroundColor_;
+					for (int x = left; x <= right; x += 4)
+					{
+						int count = std::min(4, right - x + 1);
 
-			Matrix camera_;
+						__m128 pass = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(count)));
 
-			Vector shift_;
+						// Partial blocks go through copies, so nothing past the span is touched:
 
-			double parallax_;
+							unsigned int oldPixels[4] = {};
+							memcpy(oldPixels, colorRow + x, count * sizeof(unsigned int));
 
-	};
+							__m128i destination = _mm_loadu_si128(reinterpret_cast<const __m128i*>(oldPixels));
 
+						if (plane)
+						{
+							float depths[4] = {};
+							memcpy(depths, depthRow + x, count * sizeof(float));
 
-	//----------------------------------------------------------------------------
-	//{ Constructor && destructor
-	//----------------------------------------------------------------------------
+							__m128 inverseZ = _mm_add_ps(_mm_set1_ps(static_cast<float>(rowInverseZ + plane->a * x)), laneSteps);
 
-		Renderer::Renderer(unsigned int windowWidth, unsigned int windowHeight, COLORREF backgroundColor, const Matrix& startCamera, const Vector& shift, double parallax) :
-			windowWidth_  (windowWidth),
-			windowHeight_ (windowHeight),
-			backgroundColor_ (backgroundColor),
-			camera_		     (startCamera),
-			shift_			 (shift),
-			parallax_		 (parallax)
-		{
-			txCreateWindow(windowWidth, windowHeight);
-			txTextCursor(false);
+							// Extrapolated past the edges 1/z can reach zero or below, those pixels are as far as the triangle goes:
 
-			assert(ok());
-		}
+								__m128 positive = _mm_cmpgt_ps(inverseZ, _mm_setzero_ps());
+								__m128 z = _mm_or_ps(_mm_and_ps(positive, _mm_div_ps(_mm_set1_ps(1), inverseZ)), _mm_andnot_ps(positive, _mm_set1_ps(plane->farZ)));
 
-	//}
-	//----------------------------------------------------------------------------
+								z = _mm_min_ps(_mm_max_ps(z, _mm_set1_ps(plane->nearZ)), _mm_set1_ps(plane->farZ));
 
+							pass = _mm_and_ps(pass, _mm_cmplt_ps(z, _mm_loadu_ps(depths)));
+						}
 
-	//----------------------------------------------------------------------------
-	//{ Functions
-	//----------------------------------------------------------------------------
+						if (_mm_movemask_ps(pass) == 0) continue;
 
-		//----------------------------------------------------------------------------
-		//{ Debugging
-		//----------------------------------------------------------------------------
+						__m128i low	 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(destination, zero), transparency), source), 8);
+						__m128i high = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(destination, zero), transparency), source), 8);
 
-			bool Renderer::ok() const
-			{
-				bool everythingOk = true;
+						__m128i mask	= _mm_castps_si128(pass);
+						__m128i blended = _mm_or_si128(_mm_and_si128(mask, _mm_packus_epi16(low, high)), _mm_andnot_si128(mask, destination));
 
-				if (camera_.getSizeX() != 4 || camera_.getSizeY() != 4)
-				{
-					everythingOk = false;
-					printf("Renderer::ok(): Camera matrix has invalid size (it should be 4x4).\n");
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(oldPixels), blended);
+						memcpy(colorRow + x, oldPixels, count * sizeof(unsigned int));
+					}
 				}
 
-				if (!camera_.ok())
+				void Renderer::accumulateSpan(int y, int left, int right, unsigned int pixel, unsigned int opacity, const DepthPlane* plane) const
 				{
-					everythingOk = false;
-					printf("Renderer::ok(): Camera matrix is not ok.\n");
-				}
+					const float* depthRow = depthBuffer_ + static_cast<size_t>(y) * windowWidth_;
 
-				return true;
-			}
+					size_t rowStart = static_cast<size_t>(y) * windowWidth_;
 
-		//}
-		//----------------------------------------------------------------------------
+					float alpha = opacity / 256.0f;
 
+					// Blue, green and red premultiplied by opacity, in the color buffer's order, then the opacity itself:
+					__m128 color = _mm_mul_ps(_mm_set_ps(1, static_cast<float>(pixel >> 16 & 0xFF), static_cast<float>(pixel >> 8 & 0xFF), static_cast<float>(pixel & 0xFF)),
+											  _mm_set1_ps(alpha));
 
-		//----------------------------------------------------------------------------
-		//{ Camera
-		//----------------------------------------------------------------------------
+					for (int x = left; x <= right; x++)
+					{
+						float weight = 1;
 
-			Renderer& Renderer::moveCamera(Matrix movement)
-			{
-				assert(ok());
-				assert(movement.ok());
-				assert(movement.getSizeX() == 4 && movement.getSizeY() == 4);
+						if (plane)
+						{
+							// Like blendSpan(), 1/z extrapolated to zero or below is the triangle's farthest depth:
 
-				camera_ *= movement;
+								double inverseZ = plane->a * x + plane->b * y + plane->c;
 
-				assert(ok());
+								float z = inverseZ > 0 ? static_cast<float>(1 / inverseZ) : plane->farZ;
+								z = std::min(std::max(z, plane->nearZ), plane->farZ);
 
-				return *this;
-			}
-			
-		//}
-		//----------------------------------------------------------------------------
+							if (!(z < depthRow[x])) continue;
 
+							// Nearer layers weigh more, scaled for depths of hundreds to thousands:
 
-		//----------------------------------------------------------------------------
-		//{ Rendering
-		//----------------------------------------------------------------------------
+								float scaled = z / 1000;
 
-			// Additional:
+								weight = std::min(std::max(0.03f / (1e-5f + scaled * scaled * scaled * scaled), 1e-2f), 3e3f);
+						}
 
-				void Renderer::startRendering() const
-				{
-					txBegin();
+						float* sum = accumulation_ + 4 * (rowStart + x);
+						_mm_store_ps(sum, _mm_add_ps(_mm_load_ps(sum), _mm_mul_ps(color, _mm_set1_ps(weight))));
+
+						revealage_[rowStart + x] *= 1 - alpha;
+					}
 				}
 
-				void Renderer::finishRendering() const
+			// Shadows:
+
+				void Renderer::shadowTriangle(const double* point0, const double* point1, const double* point2) const
 				{
-					txEnd();
-				}
+					DepthPlane plane = {};
 
-				void Renderer::clear() const
-			{
-				assert(ok());
+					plane.nearZ = static_cast<float>(std::min(std::min(point0[2], point1[2]), point2[2]));
+					plane.farZ	= static_cast<float>(std::max(std::max(point0[2], point1[2]), point2[2]));
 
-				txSetFillColor(backgroundColor_);
-				txClear();
-			}
+					double det = (point1[0] - point0[0]) * (point2[1] - point0[1]) - (point2[0] - point0[0]) * (point1[1] - point0[1]);
 
-			// Pixel:
+					if (det != 0)
+					{
+						double dZ1 = point1[2] - point0[2];
+						double dZ2 = point2[2] - point0[2];
 
-				void Renderer::pixel(const int x, const int y, COLORREF color) const
-				{
-					SetPixel(txDC(), x, y, color);
+						plane.a = (dZ1 * (point2[1] - point0[1]) - dZ2 * (point1[1] - point0[1])) / det;
+						plane.b = ((point1[0] - point0[0]) * dZ2 - (point2[0] - point0[0]) * dZ1) / det;
+						plane.c = point0[2] - plane.a * point0[0] - plane.b * point0[1];
+					}
+					else plane.c = plane.nearZ;
+
+					// Slope scaled bias: texels are matched to the nearest pixels' points and the kernel reaches one further,
+					// so the surface is pushed back by its depth change over two texels, capped for surfaces seen edge-on:
+
+						double bias = shadowBias_ + std::min(2 * (fabs(plane.a) + fabs(plane.b)), 16 * shadowBias_);
+
+						plane.c	   += bias;
+						plane.nearZ = static_cast<float>(plane.nearZ + bias);
+						plane.farZ	= static_cast<float>(plane.farZ	 + bias);
+
+					// Texel centers are at whole coordinates:
+
+						int x0 = static_cast<int>(floor(point0[0] + 0.5)), y0 = static_cast<int>(floor(point0[1] + 0.5));
+						int x1 = static_cast<int>(floor(point1[0] + 0.5)), y1 = static_cast<int>(floor(point1[1] + 0.5));
+						int x2 = static_cast<int>(floor(point2[0] + 0.5)), y2 = static_cast<int>(floor(point2[1] + 0.5));
+
+					forEachSpan(x0, y0, x1, y1, x2, y2, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, false, [&](int y, int left, int right)
+					{
+						shadowSpan(y, left, right, plane);
+					});
 				}
 
-				void Renderer::pixel3d(const Vector& point, COLORREF color) const
+				void Renderer::shadowSpan(int y, int left, int right, const DepthPlane& plane) const
 				{
-					assert(point.ok());
+					float* row = shadowDepths_ + static_cast<size_t>(y) * SHADOW_MAP_SIZE;
 
-					Vector fixedPoint = (point  * camera_).perspectived(parallax_) + shift_;
+					double rowZ = plane.b * y + plane.c;
 
-					pixel(static_cast<int>(fixedPoint.x()), static_cast<int>(fixedPoint.y()), color);
-				}
+					__m128 laneSteps = _mm_mul_ps(_mm_set1_ps(static_cast<float>(plane.a)), _mm_set_ps(3, 2, 1, 0));
 
-			// Line:
+					__m128 nearZ = _mm_set1_ps(plane.nearZ);
+					__m128 farZ	 = _mm_set1_ps(plane.farZ);
 
-				void Renderer::line(int x0, int y0, int x1, int y1, const COLORREF color) const
-				{
-					bool swappedXandY = false;
+					int x = left;
 
-					if (abs(y1 - y0) > abs(x1 - x0))
+					for (; x + 3 <= right; x += 4)
 					{
-						std::swap(y0, x0);
-						std::swap(y1, x1);
+						__m128 z = _mm_add_ps(_mm_set1_ps(static_cast<float>(rowZ + plane.a * x)), laneSteps);
+						z = _mm_min_ps(_mm_max_ps(z, nearZ), farZ);
 
-						swappedXandY = true;
+						_mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), z));
 					}
 
-					if (x1 < x0)
+					for (; x <= right; x++)
 					{
-						std::swap(x0, x1);
-						std::swap(y0, y1);
+						float z = std::min(std::max(static_cast<float>(rowZ + plane.a * x), plane.nearZ), plane.farZ);
+
+						if (z < row[x]) row[x] = z;
 					}
+				}
 
-					int dX = x1 - x0;
-					int dY = y1 - y0;
-					int dX2 = dX << 1;
+				void Renderer::applyShadows() const
+				{
+					TRACE_SCOPE("Renderer::applyShadows");
+
+					assert(shadowDepths_);
+
+					// Camera space back to the world, then into the map:
+					Transform toMap = light_ * Transform(camera_).inverted();
+
+					unsigned int* colors = sampleColors_ ? sampleColors_ : colorBuffer_;
+					const float*  depths = sampleColors_ ? sampleDepths_ : depthBuffer_;
 
-					int error2dX = 0;
-					int deltaError = -(dY << 1);
+					size_t sampleCount = sampleColors_ ? SAMPLE_COUNT : 1;
 
-					for (int x = x0, y = y0; x <= x1; x++, error2dX += deltaError)
+					parallelFor(threadPool_, 0, windowHeight_, 0, [&](size_t begin, size_t end)
 					{
-						if (swappedXandY) txSetPixel(y, x, color);
-						else pixel(x, y, color);
+						const int LAST_TEXEL = static_cast<int>(SHADOW_MAP_SIZE) - 1;
 
-						if (error2dX < -dX)
+						for (size_t y = begin; y < end; y++)
 						{
-							error2dX += dX2;
-							y++;
-						}
-						else if (error2dX > dX)
-						{
-							error2dX -= dX2;
-							y--;
+							for (size_t x = 0; x < windowWidth_; x++)
+							{
+								// Camera space point of the pixel at depth 1, samples are scaled by their own depth.
+								// triangle3d() truncates points to pixels, so a pixel shows what projects half a pixel further on average:
+								double rayX = (x + 0.5 - shift_.x()) / parallax_;
+								double rayY = (y + 0.5 - shift_.y()) / parallax_;
+
+								for (size_t sample = 0; sample < sampleCount; sample++)
+								{
+									size_t index = (y * windowWidth_ + x) * sampleCount + sample;
+
+									float z = depths[index];
+									if (z == FLT_MAX) continue;
+
+									double mapPoint[3] = {};
+									toMap.apply(rayX * z, rayY * z, z, mapPoint);
+
+									int texelX = static_cast<int>(floor(mapPoint[0] + 0.5));
+									int texelY = static_cast<int>(floor(mapPoint[1] + 0.5));
+
+									// Pixels are rounded too, so the receiver is moved toward the light by its depth change to the next pixels,
+									// capped like the map's bias where the next pixel is another surface:
+
+										float nextX = (x + 1 < windowWidth_)  ? depths[index + sampleCount]				   : z;
+										float nextY = (y + 1 < windowHeight_) ? depths[index + windowWidth_ * sampleCount] : z;
+
+										if (nextX == FLT_MAX) nextX = z;
+										if (nextY == FLT_MAX) nextY = z;
+
+										double slack = std::min(static_cast<double>(fabs(nextX - z) + fabs(nextY - z)), 8 * shadowBias_);
+
+										float receiver = static_cast<float>(mapPoint[2] - slack);
+
+									// Texels outside of the map light everything:
+
+										unsigned int lit = 0;
+
+										for (int kernelY = texelY - 1; kernelY <= texelY + 1; kernelY++)
+										{
+											for (int kernelX = texelX - 1; kernelX <= texelX + 1; kernelX++)
+											{
+												if (kernelX < 0 || kernelY < 0 || kernelX > LAST_TEXEL || kernelY > LAST_TEXEL ||
+													receiver <= shadowDepths_[static_cast<size_t>(kernelY) * SHADOW_MAP_SIZE + kernelX]) lit++;
+											}
+										}
+
+									if (lit == 9) continue;
+
+									colors[index] = blend(0, colors[index], shadowBrightness_ + (256 - shadowBrightness_) * lit / 9);
+								}
+							}
 						}
-					}
+					});
 				}
 
-				void Renderer::line3d(const Vector& point0, const Vector& point1, const COLORREF color) const
+			// Deferred shading:
+
+				unsigned int Renderer::packNormal(double x, double y, double z)
 				{
-					assert(point0.ok());
-					assert(point1.ok());
+					double sum = fabs(x) + fabs(y) + fabs(z);
+					if (sum == 0) return 0;
 
-					Vector fixedPoint0 = (point0 * camera_).perspectived(parallax_) + shift_;
-					Vector fixedPoint1 = (point1 * camera_).perspectived(parallax_) + shift_;
+					double u = x / sum;
+					double v = y / sum;
 
-					line(static_cast<int>(fixedPoint0.x()), static_cast<int>(fixedPoint0.y()),
-						 static_cast<int>(fixedPoint1.x()), static_cast<int>(fixedPoint1.y()), color);
-				}
+					// The lower half of the octahedron is folded over the upper one's corners:
+					if (z < 0)
+					{
+						double foldedU = (1 - fabs(v)) * (u < 0 ? -1 : 1);
+						double foldedV = (1 - fabs(u)) * (v < 0 ? -1 : 1);
 
-			// Triangle:
+						u = foldedU;
+						v = foldedV;
+					}
 
-				void Renderer::triangle3d(const Vector& point0, const Vector& point1, const Vector& point2, const Vector& normal, COLORREF color) const
+					unsigned int packedU = 1 + static_cast<unsigned int>(floor((u + 1) / 2 * 65534 + 0.5));
+					unsigned int packedV = 1 + static_cast<unsigned int>(floor((v + 1) / 2 * 65534 + 0.5));
+
+					return packedU << 16 | packedV;
+				}
+
+				void Renderer::unpackNormal(unsigned int packed, float* normal)
 				{
-					assert(normal.ok());
-					assert(point0.ok());
-					assert(point1.ok());
-					assert(point2.ok());
+					assert(packed && normal);
+
+					float u = static_cast<float>((packed >> 16) - 1) / 65534 * 2 - 1;
+					float v = static_cast<float>((packed & 0xFFFF) - 1) / 65534 * 2 - 1;
+					float w = 1 - fabsf(u) - fabsf(v);
 
-					if ((normal * camera_ - Vector(camera_[3][0], camera_[3][1], camera_[3][2])).z() > 0)
+					if (w < 0)
 					{
-						Vector fixedPoint0 = (point0 * camera_).perspectived(parallax_) + shift_;
-						Vector fixedPoint1 = (point1 * camera_).perspectived(parallax_) + shift_;
-						Vector fixedPoint2 = (point2 * camera_).perspectived(parallax_) + shift_;
+						float unfoldedU = (1 - fabsf(v)) * (u < 0 ? -1 : 1);
+						float unfoldedV = (1 - fabsf(u)) * (v < 0 ? -1 : 1);
 
-						triangle(static_cast<int>(fixedPoint0.x()), static_cast<int>(fixedPoint0.y()),
-								 static_cast<int>(fixedPoint1.x()), static_cast<int>(fixedPoint1.y()),
-								 static_cast<int>(fixedPoint2.x()), static_cast<int>(fixedPoint2.y()), color);
+						u = unfoldedU;
+						v = unfoldedV;
 					}
-					
+
+					float length = sqrtf(u * u + v * v + w * w);
+
+					normal[0] = u / length;
+					normal[1] = v / length;
+					normal[2] = w / length;
 				}
 
-				void Renderer::triangle(int x0, int y0, int x1, int y1, int x2, int y2, COLORREF color) const
-				{	
-					// Sorting points:
+				void Renderer::shadeDeferred() const
+				{
+					TRACE_SCOPE("Renderer::shadeDeferred");
 
-						if (x0 > x1)
-						{
-							std::swap(x0, x1);
-							std::swap(y0, y1);
-						}
+					assert(normalBuffer_);
 
-						if (x1 > x2)
+					// Camera space lights, colors in 0..1:
+
+						struct ViewLight
 						{
-							std::swap(x1, x2);
-							std::swap(y1, y2);
-						} 
-						
-						if (x0 > x1)
+							double x, y, z;
+							double squaredRadius;
+
+							double red, green, blue;
+						};
+
+						Transform toView = Transform(camera_);
+
+						std::vector<ViewLight> lights = std::vector<ViewLight>(lights_.size());
+
+						for (size_t i = 0; i < lights_.size(); i++)
 						{
-							std::swap(x0, x1);
-							std::swap(y0, y1);
+							const PointLight& light = lights_[i];
+
+							double position[3] = {};
+							toView.apply(light.x, light.y, light.z, position);
+
+							ViewLight viewLight = { position[0], position[1], position[2], light.radius * light.radius,
+													GetRValue(light.color) / 255.0, GetGValue(light.color) / 255.0, GetBValue(light.color) / 255.0 };
+
+							lights[i] = viewLight;
 						}
 
-					// Creating useful variables:
-						
-						int dX = x1 - x0;
-						int dX2 = dX << 1;
+					unsigned int* colors = sampleColors_ ? sampleColors_ : colorBuffer_;
+					const float*  depths = sampleColors_ ? sampleDepths_ : depthBuffer_;
+
+					size_t sampleCount = sampleColors_ ? SAMPLE_COUNT : 1;
+
+					const unsigned int TILE_SIZE = 1u << LIGHT_TILE_SHIFT;
 
-						int error2dX = 0;
-						int deltaError = -(y1 - y0) << 1;
+					size_t tileRows = (windowHeight_ + TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
 
-						int yLong = y0;
-						int dXLong = x2 - x0;
-						int dX2Long = dXLong << 1;
+					parallelFor(threadPool_, 0, tileRows, 0, [&](size_t begin, size_t end)
+					{
+						std::vector<const ViewLight*> tileLights;
+						tileLights.reserve(lights.size());
 
-						int error2dXLong = 0;
-						int deltaErrorLong = -(y2 - y0) << 1;
-						
-					// First triangle half:
-						
-						if (x0 != x1)
+						for (size_t tileY = begin; tileY < end; tileY++)
 						{
-							for (int x01 = x0, y01 = y0; x01 <= x1; x01++, error2dX += deltaError, error2dXLong += deltaErrorLong)
+							size_t startY = tileY << LIGHT_TILE_SHIFT;
+							size_t endY	  = std::min(startY + TILE_SIZE, static_cast<size_t>(windowHeight_));
+
+							for (size_t startX = 0; startX < windowWidth_; startX += TILE_SIZE)
 							{
-								for (; error2dX < -dX; error2dX += dX2, y01++) pixel(x01, y01, color);
-								for (; error2dX >  dX; error2dX -= dX2, y01--) pixel(x01, y01, color);
+								size_t endX = std::min(startX + TILE_SIZE, static_cast<size_t>(windowWidth_));
 
-								for (; error2dXLong < -dXLong; error2dXLong += dX2Long, yLong++) pixel(x01, yLong, color);
-								for (; error2dXLong >  dXLong; error2dXLong -= dX2Long, yLong--) pixel(x01, yLong, color);
+								// Depth range of the tile's lit samples:
 
-								if (y01 <= yLong)
-								{
-									for (int fillingY = y01; fillingY <= yLong; fillingY++)
-									{
-										pixel(x01, fillingY, color);
-									}
-								}
-								else
-								{
-									for (int fillingY = y01; fillingY >= yLong; fillingY--)
+									float minZ = FLT_MAX;
+									float maxZ = 0;
+
+									for (size_t y = startY; y < endY; y++)
 									{
-										pixel(x01, fillingY, color);
+										for (size_t x = startX; x < endX; x++)
+										{
+											if (!normalBuffer_[y * windowWidth_ + x]) continue;
+
+											for (size_t sample = 0; sample < sampleCount; sample++)
+											{
+												float z = depths[(y * windowWidth_ + x) * sampleCount + sample];
+												if (z == FLT_MAX) continue;
+
+												minZ = std::min(minZ, z);
+												maxZ = std::max(maxZ, z);
+											}
+										}
 									}
-								}
-							}
-						}
-						else
-						{
-							if (y0 <= y1) for (int y = y0; y <= y1; y++) pixel(x0, y, color);
-							else		  for (int y = y0; y >= y1; y--) pixel(x0, y, color);
-						}
 
-					// Second triangle half
+									if (minZ == FLT_MAX) continue;
 
-						dX = x2 - x1;
-						dX2 = dX << 1;
+								// Box around the tile's points, the pixel rays are scaled by both ends of the depth range:
 
-						error2dX = 0;
-						deltaError = -(y2 - y1) << 1;
+									double rayMinX = (startX + 0.5 - shift_.x()) / parallax_, rayMaxX = (endX - 0.5 - shift_.x()) / parallax_;
+									double rayMinY = (startY + 0.5 - shift_.y()) / parallax_, rayMaxY = (endY - 0.5 - shift_.y()) / parallax_;
 
-						if (x1 != x2)
-						{
-							for (int x12 = x1, y12 = y1; x12 <= x2; x12++, error2dX += deltaError, error2dXLong += deltaErrorLong)
-							{
-								for (; error2dX < -dX; error2dX += dX2, y12++) pixel(x12, y12, color);
-								for (; error2dX >  dX; error2dX -= dX2, y12--) pixel(x12, y12, color);
+									double boxMinX = std::min(rayMinX * minZ, rayMinX * maxZ), boxMaxX = std::max(rayMaxX * minZ, rayMaxX * maxZ);
+									double boxMinY = std::min(rayMinY * minZ, rayMinY * maxZ), boxMaxY = std::max(rayMaxY * minZ, rayMaxY * maxZ);
 
-								for (; error2dXLong < -dXLong; error2dXLong += dX2Long, yLong++) pixel(x12, yLong, color);
-								for (; error2dXLong >  dXLong; error2dXLong -= dX2Long, yLong--) pixel(x12, yLong, color);
+									tileLights.clear();
 
-								if (y12 <= yLong)
-								{
-									for (int fillingY = y12; fillingY <= yLong; fillingY++)
+									for (size_t i = 0; i < lights.size(); i++)
 									{
-										pixel(x12, fillingY, color);
+										const ViewLight& light = lights[i];
+
+										double dx = std::max(std::max(boxMinX - light.x, light.x - boxMaxX), 0.0);
+										double dy = std::max(std::max(boxMinY - light.y, light.y - boxMaxY), 0.0);
+										double dz = std::max(std::max(minZ	  - light.z, light.z - maxZ),	 0.0);
+
+										if (dx * dx + dy * dy + dz * dz < light.squaredRadius) tileLights.push_back(&light);
 									}
-								}
-								else
+
+								for (size_t y = startY; y < endY; y++)
 								{
-									for (int fillingY = y12; fillingY >= yLong; fillingY--)
+									double rayY = (y + 0.5 - shift_.y()) / parallax_;
+
+									for (size_t x = startX; x < endX; x++)
 									{
-										pixel(x12, fillingY, color);
+										unsigned int packed = normalBuffer_[y * windowWidth_ + x];
+										if (!packed) continue;
+
+										float normal[3] = {};
+										unpackNormal(packed, normal);
+
+										double rayX = (x + 0.5 - shift_.x()) / parallax_;
+
+										for (size_t sample = 0; sample < sampleCount; sample++)
+										{
+											size_t index = (y * windowWidth_ + x) * sampleCount + sample;
+
+											float z = depths[index];
+											if (z == FLT_MAX) continue;
+
+											double red = ambientLight_, green = ambientLight_, blue = ambientLight_;
+
+											for (size_t i = 0; i < tileLights.size(); i++)
+											{
+												const ViewLight& light = *tileLights[i];
+
+												double toLightX = light.x - rayX * z;
+												double toLightY = light.y - rayY * z;
+												double toLightZ = light.z - z;
+
+												double squaredDistance = toLightX * toLightX + toLightY * toLightY + toLightZ * toLightZ;
+												if (squaredDistance >= light.squaredRadius) continue;
+
+												double facing = normal[0] * toLightX + normal[1] * toLightY + normal[2] * toLightZ;
+												if (facing <= 0) continue;
+
+												// Lambert times a falloff reaching zero at the radius:
+
+													double falloff = 1 - squaredDistance / light.squaredRadius;
+
+													double intensity = facing / sqrt(squaredDistance) * falloff * falloff;
+
+													red	  += light.red	 * intensity;
+													green += light.green * intensity;
+													blue  += light.blue	 * intensity;
+											}
+
+											// The drawn color is the albedo:
+
+												unsigned int albedo = colors[index];
+
+												unsigned int shadedRed	 = static_cast<unsigned int>(std::min(255.0, (albedo >> 16 & 0xFF) * red));
+												unsigned int shadedGreen = static_cast<unsigned int>(std::min(255.0, (albedo >> 8  & 0xFF) * green));
+												unsigned int shadedBlue	 = static_cast<unsigned int>(std::min(255.0, (albedo	   & 0xFF) * blue));
+
+												colors[index] = shadedRed << 16 | shadedGreen << 8 | shadedBlue;
+										}
 									}
 								}
 							}
 						}
-						else
+					});
+				}
+
+			// Hierarchical depth:
+
+				unsigned int Renderer::hiZVisibleTiles(int minX, int minY, int maxX, int maxY, float nearZ) const
+				{
+					unsigned int visibleTiles = 0;
+
+					for (int tileY = minY >> HIZ_TILE_SHIFT; tileY <= (maxY >> HIZ_TILE_SHIFT); tileY++)
+					{
+						for (int tileX = minX >> HIZ_TILE_SHIFT; tileX <= (maxX >> HIZ_TILE_SHIFT); tileX++)
+						{
+							if (nearZ < tileMaxDepth_[tileY * tileCountX_ + tileX]) visibleTiles++;
+							else hiZStats_.tilesRejected++;
+						}
+					}
+
+					return visibleTiles;
+				}
+
+				void Renderer::updateHiZ() const
+				{
+					for (size_t i = 0; i < dirtyTileCount_; i++)
+					{
+						unsigned int tile = dirtyTiles_[i];
+						tileDirty_[tile] = false;
+
+						unsigned int startX = (tile % tileCountX_) << HIZ_TILE_SHIFT;
+						unsigned int startY = (tile / tileCountX_) << HIZ_TILE_SHIFT;
+
+						unsigned int endX = std::min(startX + (1 << HIZ_TILE_SHIFT), windowWidth_);
+						unsigned int endY = std::min(startY + (1 << HIZ_TILE_SHIFT), windowHeight_);
+
+						float maxDepth = 0;
+
+						for (unsigned int y = startY; y < endY; y++)
 						{
-							if (y1 <= y2) for (int y = y1; y <= y2; y++) pixel(x1, y, color);
-							else		  for (int y = y1; y >= y2; y--) pixel(x1, y, color);
+							const float* row = depthBuffer_ + static_cast<size_t>(y) * windowWidth_;
+
+							for (unsigned int x = startX; x < endX; x++)
+							{
+								if (row[x] > maxDepth) maxDepth = row[x];
+							}
 						}
+
+						tileMaxDepth_[tile] = maxDepth;
+					}
+
+					dirtyTileCount_ = 0;
 				}
 
 		//}
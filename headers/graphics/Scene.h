@@ -0,0 +1,585 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Frustum
+//----------------------------------------------------------------------------
+
+	// World space planes of the renderer's window (n * point + d >= 0 inside):
+	struct Frustum
+	{
+		public:
+
+			static const unsigned int PLANE_COUNT = 5;
+			static const unsigned int ALL_PLANES  = (1 << PLANE_COUNT) - 1;
+
+			// Constructor:
+
+				Frustum(const Renderer* renderer);
+
+			// Functions:
+
+				// false if the box is outside, clears the bits of planes the box is entirely inside of:
+				bool test(const float* boundsMin, const float* boundsMax, unsigned int* planeMask) const;
+
+			double planes[PLANE_COUNT][4];
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		Frustum::Frustum(const Renderer* renderer)
+		{
+			assert(renderer);
+			assert(renderer->ok());
+			assert(renderer->getParallax() > 0);
+
+			double parallax = renderer->getParallax();
+
+			double shiftX = renderer->getShift().x();
+			double shiftY = renderer->getShift().y();
+
+			double width  = renderer->getWindowWidth();
+			double height = renderer->getWindowHeight();
+
+			// Camera space planes, from 0 <= parallax * x / z + shift < size and z >= 0:
+
+				double viewPlanes[PLANE_COUNT][4] =
+				{
+					{  parallax,		 0,		   shiftX, 0 },
+					{ -parallax,		 0, width - shiftX, 0 },
+					{		  0,  parallax,		   shiftY, 0 },
+					{		  0, -parallax, height - shiftY, 0 },
+					{		  0,		 0,				1, 0 }
+				};
+
+			// Moving them to the world space (the camera is an affine transformation):
+
+				const Matrix& camera = renderer->getCamera();
+
+				for (unsigned int plane = 0; plane < PLANE_COUNT; plane++)
+				{
+					for (size_t column = 0; column < 4; column++)
+					{
+						planes[plane][column] = (column == 3) ? viewPlanes[plane][3] : 0;
+
+						for (size_t row = 0; row < 3; row++)
+						{
+							planes[plane][column] += viewPlanes[plane][row] * camera[column][row];
+						}
+					}
+				}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool Frustum::test(const float* boundsMin, const float* boundsMax, unsigned int* planeMask) const
+		{
+			assert(planeMask);
+
+			for (unsigned int plane = 0; plane < PLANE_COUNT; plane++)
+			{
+				if (!(*planeMask & (1 << plane))) continue;
+
+				const double* normal = planes[plane];
+
+				// The box corners farthest along and against the normal:
+
+					double farthest = normal[3];
+					double nearest  = normal[3];
+
+					for (size_t axis = 0; axis < 3; axis++)
+					{
+						if (normal[axis] >= 0)
+						{
+							farthest += normal[axis] * boundsMax[axis];
+							nearest  += normal[axis] * boundsMin[axis];
+						}
+						else
+						{
+							farthest += normal[axis] * boundsMin[axis];
+							nearest  += normal[axis] * boundsMax[axis];
+						}
+					}
+
+				if (farthest < 0) return false;
+
+				if (nearest >= 0) *planeMask &= ~(1 << plane);
+			}
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Scene
+//----------------------------------------------------------------------------
+
+	struct SceneObject
+	{
+		const Model* model;
+
+		Matrix transformation;
+	};
+
+	struct SceneStats
+	{
+		unsigned long long nodesVisited;
+		unsigned long long objectsVisible;
+
+		unsigned long long rebuilds;
+		unsigned long long refits;
+	};
+
+	/*
+		Models with their world transformations, kept in a bounding volume hierarchy
+		for frustum culling and ray queries:
+
+			Scene scene;
+
+			size_t chair = scene.add(&chairModel, chairTransformation);
+			...
+			scene.move(chair, newChairTransformation);
+			scene.render(&renderer);
+
+		The hierarchy is built lazily by the first query after objects were added,
+		moved objects only refit their leaf's ancestors until too many of them moved.
+	*/
+	class Scene
+	{
+		public:
+
+			static const size_t NOTHING = static_cast<size_t>(-1);
+
+			// Constructor:
+
+				Scene(double rebuildFraction = 0.25);
+
+			// Getters:
+
+				size_t getObjectCount() const;
+				const SceneObject& getObject(size_t object) const;
+
+				// World space bounding box:
+				const BoundingBox& getBounds(size_t object) const;
+
+				const SceneStats& getStats() const;
+
+			// Functions:
+
+				bool ok() const;
+
+				Scene& resetStats();
+
+				// Objects:
+
+					size_t add(const Model* model, const Matrix& transformation);
+					Scene& move(size_t object, const Matrix& transformation);
+
+					// Full binned SAH rebuild:
+					Scene& rebuild();
+
+				// Queries:
+
+					size_t cull(const Renderer* renderer, std::vector<size_t>* visible) const;
+
+					void render(const Renderer* renderer, const OcclusionCuller* culler = NULL) const;
+
+					// Nearest object whose bounding box is hit, NOTHING if there is none:
+					size_t raycast(const Vector& origin, const Vector& direction, double* distance = NULL) const;
+
+					// Calls visitor(object, boxDistance) for every object with a box hit nearer than maxDistance,
+					// nearer boxes first; visitor returns the new maxDistance:
+					template <typename Visitor>
+					void traverseRay(const Vector& origin, const Vector& direction, double maxDistance, Visitor& visitor) const;
+
+		private:
+
+			// Leaf visitor of BoundingHierarchy::traverseRay() testing every object's box:
+			template <typename Visitor>
+			struct ObjectsRayVisitor
+			{
+				const Scene* scene;
+
+				const double* origin;
+				const double* inverseDirection;
+
+				double maxDistance;
+				Visitor* visitor;
+
+				double operator()(const BoundingHierarchy::Node& leaf, double leafDistance);
+			};
+
+			void update() const;
+
+			std::vector<SceneObject> objects_;
+			std::vector<BoundingBox> bounds_;
+
+			double rebuildFraction_;
+
+			// Hierarchy:
+
+				mutable BoundingHierarchy hierarchy_;
+
+				mutable bool needsRebuild_;
+				mutable size_t movedSinceRebuild_;
+
+			mutable SceneStats stats_;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		Scene::Scene(double rebuildFraction /*= 0.25*/) :
+			objects_			(),
+			bounds_				(),
+			rebuildFraction_	(rebuildFraction),
+			hierarchy_			(),
+			needsRebuild_		(false),
+			movedSinceRebuild_	(0),
+			stats_				()
+		{
+			assert(rebuildFraction >= 0);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		size_t Scene::getObjectCount() const
+		{
+			return objects_.size();
+		}
+
+		const SceneObject& Scene::getObject(size_t object) const
+		{
+			assert(object < objects_.size());
+
+			return objects_[object];
+		}
+
+		const BoundingBox& Scene::getBounds(size_t object) const
+		{
+			assert(object < bounds_.size());
+
+			return bounds_[object];
+		}
+
+		const SceneStats& Scene::getStats() const
+		{
+			return stats_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool Scene::ok() const
+		{
+			bool everythingOk = true;
+
+			if (objects_.size() != bounds_.size())
+			{
+				puts("Scene::ok(): objects_ and bounds_ have different sizes");
+				everythingOk = false;
+			}
+
+			return everythingOk;
+		}
+
+		Scene& Scene::resetStats()
+		{
+			stats_ = SceneStats();
+
+			return *this;
+		}
+
+		//----------------------------------------------------------------------------
+		//{ Objects
+		//----------------------------------------------------------------------------
+
+			size_t Scene::add(const Model* model, const Matrix& transformation)
+			{
+				assert(model);
+				assert(model->ok());
+
+				SceneObject object = { model, transformation };
+				objects_.push_back(object);
+
+				BoundingBox bounds = {};
+				bounds_.push_back(bounds);
+
+				needsRebuild_ = true;
+
+				size_t index = objects_.size() - 1;
+				move(index, transformation);
+
+				return index;
+			}
+
+			Scene& Scene::move(size_t object, const Matrix& transformation)
+			{
+				assert(object < objects_.size());
+				assert(transformation.ok());
+
+				SceneObject& moved = objects_[object];
+
+				moved.transformation = transformation;
+
+				double boundsMin[3] = {}, boundsMax[3] = {};
+				Transform(transformation).applyBounds(moved.model->getBoundsMin(), moved.model->getBoundsMax(), boundsMin, boundsMax);
+
+				for (size_t axis = 0; axis < 3; axis++)
+				{
+					bounds_[object].min[axis] = static_cast<float>(boundsMin[axis]);
+					bounds_[object].max[axis] = static_cast<float>(boundsMax[axis]);
+				}
+
+				if (needsRebuild_) return *this;
+
+				// Too many refits make the hierarchy loose, it's cheaper to rebuild it:
+
+					movedSinceRebuild_++;
+
+					if (movedSinceRebuild_ > rebuildFraction_ * objects_.size())
+					{
+						needsRebuild_ = true;
+						return *this;
+					}
+
+				stats_.refits++;
+
+				hierarchy_.refit(bounds_.data(), object);
+
+				return *this;
+			}
+
+			Scene& Scene::rebuild()
+			{
+				needsRebuild_ = true;
+				update();
+
+				return *this;
+			}
+
+			void Scene::update() const
+			{
+				assert(ok());
+
+				if (!needsRebuild_) return;
+
+				stats_.rebuilds++;
+
+				hierarchy_.build(bounds_.data(), bounds_.size());
+
+				needsRebuild_ = false;
+				movedSinceRebuild_ = 0;
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Queries
+		//----------------------------------------------------------------------------
+
+			size_t Scene::cull(const Renderer* renderer, std::vector<size_t>* visible) const
+			{
+				assert(renderer);
+				assert(visible);
+
+				update();
+
+				visible->clear();
+				visible->reserve(objects_.size());
+
+				if (hierarchy_.empty()) return 0;
+
+				Frustum frustum = Frustum(renderer);
+
+				// Nodes are visited with the planes their parent wasn't entirely inside of:
+
+					unsigned int stack[BoundingHierarchy::STACK_SIZE];
+					unsigned int masks[BoundingHierarchy::STACK_SIZE];
+					size_t stackSize = 0;
+
+					stack[stackSize] = 0;
+					masks[stackSize] = Frustum::ALL_PLANES;
+					stackSize++;
+
+					while (stackSize > 0)
+					{
+						stackSize--;
+
+						const BoundingHierarchy::Node& node = hierarchy_.getNode(stack[stackSize]);
+						unsigned int mask = masks[stackSize];
+
+						stats_.nodesVisited++;
+
+						if (mask && !frustum.test(node.boundsMin, node.boundsMax, &mask)) continue;
+
+						// Subtrees entirely inside are taken at once, leaves' objects are tested on their own:
+
+							if (mask == 0 || node.child == 0)
+							{
+								for (unsigned int i = node.objectFirst; i < node.objectFirst + node.objectCount; i++)
+								{
+									unsigned int object = hierarchy_.getObject(i);
+									unsigned int objectMask = mask;
+
+									if (objectMask && !frustum.test(bounds_[object].min, bounds_[object].max, &objectMask)) continue;
+
+									visible->push_back(object);
+								}
+
+								continue;
+							}
+
+						assert(stackSize + 2 <= BoundingHierarchy::STACK_SIZE);
+
+						stack[stackSize] = node.child;
+						masks[stackSize] = mask;
+						stackSize++;
+
+						stack[stackSize] = node.child + 1;
+						masks[stackSize] = mask;
+						stackSize++;
+					}
+
+				stats_.objectsVisible += visible->size();
+
+				return visible->size();
+			}
+
+			void Scene::render(const Renderer* renderer, const OcclusionCuller* culler /*= NULL*/) const
+			{
+				ALLOCATION_STAGE(ALLOCATION_SCENE);
+				TRACE_SCOPE("Scene::render");
+
+				assert(renderer);
+
+				// The camera's frustum doesn't bound what casts shadows into it:
+
+					if (renderer->inShadowPass())
+					{
+						for (size_t i = 0; i < objects_.size(); i++) objects_[i].model->render(renderer, objects_[i].transformation);
+
+						return;
+					}
+
+				std::vector<size_t> visible;
+				cull(renderer, &visible);
+
+				for (size_t i = 0; i < visible.size(); i++)
+				{
+					const SceneObject& object = objects_[visible[i]];
+
+					if (culler && !culler->visible(*object.model, object.transformation)) continue;
+
+					object.model->render(renderer, object.transformation);
+				}
+			}
+
+			template <typename Visitor>
+			double Scene::ObjectsRayVisitor<Visitor>::operator()(const BoundingHierarchy::Node& leaf, double /*leafDistance*/)
+			{
+				scene->stats_.nodesVisited++;
+
+				for (unsigned int i = leaf.objectFirst; i < leaf.objectFirst + leaf.objectCount; i++)
+				{
+					unsigned int object = scene->hierarchy_.getObject(i);
+					const BoundingBox& bounds = scene->bounds_[object];
+
+					double distance = 0;
+
+					if (BoundingHierarchy::rayBox(origin, inverseDirection, bounds.min, bounds.max, maxDistance, &distance))
+					{
+						maxDistance = (*visitor)(static_cast<size_t>(object), distance);
+					}
+				}
+
+				return maxDistance;
+			}
+
+			template <typename Visitor>
+			void Scene::traverseRay(const Vector& origin, const Vector& direction, double maxDistance, Visitor& visitor) const
+			{
+				assert(origin.ok());
+				assert(direction.ok());
+
+				update();
+
+				double rayOrigin[3] = { origin.x(), origin.y(), origin.z() };
+				double inverseDirection[3] = { 1 / direction.x(), 1 / direction.y(), 1 / direction.z() };
+
+				ObjectsRayVisitor<Visitor> objectsVisitor = { this, rayOrigin, inverseDirection, maxDistance, &visitor };
+
+				hierarchy_.traverseRay(rayOrigin, inverseDirection, maxDistance, objectsVisitor);
+			}
+
+			// Closest bounding box hit:
+
+				struct NearestBoxVisitor
+				{
+					size_t object;
+					double distance;
+
+					double operator()(size_t hitObject, double hitDistance)
+					{
+						if (hitDistance < distance)
+						{
+							object   = hitObject;
+							distance = hitDistance;
+						}
+
+						return distance;
+					}
+				};
+
+			size_t Scene::raycast(const Vector& origin, const Vector& direction, double* distance /*= NULL*/) const
+			{
+				NearestBoxVisitor visitor = { NOTHING, DBL_MAX };
+
+				traverseRay(origin, direction, DBL_MAX, visitor);
+
+				if (distance) *distance = visitor.distance;
+
+				return visitor.object;
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,421 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Scene graph
+//----------------------------------------------------------------------------
+
+	struct SceneGraphStats
+	{
+		unsigned long long updates;
+		unsigned long long nodesUpdated;
+		unsigned long long objectsMoved;
+		unsigned long long reorders;
+	};
+
+	/*
+		Hierarchy of local transformations over a Scene, nodes with a model are
+		the scene's objects at their world transformations:
+
+			SceneGraph graph = SceneGraph(&scene);
+
+			size_t car   = graph.add(SceneGraph::NOTHING, carTransformation, &carModel);
+			size_t wheel = graph.add(car, wheelTransformation, &wheelModel);
+			...
+			graph.setLocal(car, newCarTransformation);
+			graph.render(&renderer);
+
+		Nodes are kept in one array in depth-first order, so every subtree is a
+		range of it. Changed nodes are only marked, update() recomputes the world
+		transformations of their subtrees and nothing else.
+	*/
+	class SceneGraph
+	{
+		public:
+
+			static const size_t NOTHING = static_cast<size_t>(-1);
+
+			// Constructor:
+
+				SceneGraph(Scene* scene);
+
+			// Getters:
+
+				size_t getNodeCount() const;
+
+				size_t getParent(size_t node) const;
+				const Model* getModel(size_t node) const;
+
+				const Transform& getLocal(size_t node) const;
+
+				// Brought up to date first:
+				const Transform& getWorld(size_t node);
+
+				// Scene object of the node's model, Scene::NOTHING before the first update:
+				size_t getObject(size_t node) const;
+
+				const SceneGraphStats& getStats() const;
+
+			// Setters:
+
+				SceneGraph& setLocal(size_t node, const Matrix& local);
+
+			// Functions:
+
+				bool ok() const;
+
+				SceneGraph& resetStats();
+
+				// Node with its transformation relative to the parent (NOTHING for a root):
+				size_t add(size_t parent, const Matrix& local, const Model* model = NULL);
+
+				// Moves the scene's objects of changed subtrees:
+				void update();
+
+				void render(const Renderer* renderer, const OcclusionCuller* culler = NULL);
+
+		private:
+
+			struct Node
+			{
+				Transform local;
+				Transform world;
+
+				// Node numbers given by add(), the array index of the parent is kept for updates:
+				size_t id;
+				size_t parent;
+				size_t parentIndex;
+
+				// The node and its descendants:
+				size_t subtreeSize;
+
+				const Model* model;
+				size_t object;
+
+				bool dirty;
+			};
+
+			// Depth-first order of the nodes added since the last one:
+			void reorder();
+
+			void updateSubtree(size_t first);
+
+			Scene* scene_;
+
+			std::vector<Node> nodes_;
+
+			// Array index of every node number:
+			std::vector<size_t> indices_;
+
+			std::vector<size_t> dirtyNodes_;
+			bool needsReorder_;
+
+			SceneGraphStats stats_;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		SceneGraph::SceneGraph(Scene* scene) :
+			scene_		  (scene),
+			nodes_		  (),
+			indices_	  (),
+			dirtyNodes_	  (),
+			needsReorder_ (false),
+			stats_		  ()
+		{
+			assert(scene);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		size_t SceneGraph::getNodeCount() const
+		{
+			return indices_.size();
+		}
+
+		size_t SceneGraph::getParent(size_t node) const
+		{
+			assert(node < indices_.size());
+
+			return nodes_[indices_[node]].parent;
+		}
+
+		const Model* SceneGraph::getModel(size_t node) const
+		{
+			assert(node < indices_.size());
+
+			return nodes_[indices_[node]].model;
+		}
+
+		const Transform& SceneGraph::getLocal(size_t node) const
+		{
+			assert(node < indices_.size());
+
+			return nodes_[indices_[node]].local;
+		}
+
+		const Transform& SceneGraph::getWorld(size_t node)
+		{
+			assert(node < indices_.size());
+
+			update();
+
+			return nodes_[indices_[node]].world;
+		}
+
+		size_t SceneGraph::getObject(size_t node) const
+		{
+			assert(node < indices_.size());
+
+			return nodes_[indices_[node]].object;
+		}
+
+		const SceneGraphStats& SceneGraph::getStats() const
+		{
+			return stats_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Setters
+	//----------------------------------------------------------------------------
+
+		SceneGraph& SceneGraph::setLocal(size_t node, const Matrix& local)
+		{
+			assert(node < indices_.size());
+
+			Node& changed = nodes_[indices_[node]];
+
+			changed.local = Transform(local);
+
+			if (!changed.dirty)
+			{
+				changed.dirty = true;
+				dirtyNodes_.push_back(node);
+			}
+
+			return *this;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool SceneGraph::ok() const
+		{
+			bool everythingOk = true;
+
+			if (nodes_.size() != indices_.size())
+			{
+				puts("SceneGraph::ok(): nodes_ and indices_ have different sizes");
+				everythingOk = false;
+			}
+
+			if (!needsReorder_)
+			{
+				for (size_t i = 0; i < nodes_.size(); i++)
+				{
+					if (indices_[nodes_[i].id] != i || (nodes_[i].parentIndex != NOTHING && nodes_[i].parentIndex >= i))
+					{
+						puts("SceneGraph::ok(): nodes_ are not in depth-first order");
+						everythingOk = false;
+
+						break;
+					}
+				}
+			}
+
+			return everythingOk;
+		}
+
+		SceneGraph& SceneGraph::resetStats()
+		{
+			stats_ = SceneGraphStats();
+
+			return *this;
+		}
+
+		size_t SceneGraph::add(size_t parent, const Matrix& local, const Model* model /*= NULL*/)
+		{
+			assert(parent == NOTHING || parent < indices_.size());
+			assert(model == NULL || model->ok());
+
+			Node node = { Transform(local), Transform(local), indices_.size(), parent, NOTHING, 1, model, Scene::NOTHING, true };
+
+			// Appended for now, reorder() moves it after its parent's subtree:
+
+				indices_.push_back(nodes_.size());
+				nodes_.push_back(node);
+
+				dirtyNodes_.push_back(node.id);
+				needsReorder_ = true;
+
+			return node.id;
+		}
+
+		void SceneGraph::reorder()
+		{
+			stats_.reorders++;
+
+			// Children of every node in the order they were added:
+
+				std::vector<size_t> childCounts = std::vector<size_t>(indices_.size() + 1);
+
+				for (size_t i = 0; i < nodes_.size(); i++)
+				{
+					size_t parent = nodes_[i].parent;
+					childCounts[parent == NOTHING ? indices_.size() : parent]++;
+				}
+
+				// Children of node n are children[childStarts[n], childStarts[n + 1]), roots are the last group:
+
+					std::vector<size_t> childStarts = std::vector<size_t>(indices_.size() + 2);
+
+					for (size_t i = 0; i <= indices_.size(); i++) childStarts[i + 1] = childStarts[i] + childCounts[i];
+
+					std::vector<size_t> children = std::vector<size_t>(nodes_.size());
+					std::vector<size_t> filled	 = std::vector<size_t>(childStarts.begin(), childStarts.end() - 1);
+
+					std::vector<size_t> byId = std::vector<size_t>(indices_.size());
+
+					for (size_t i = 0; i < nodes_.size(); i++) byId[nodes_[i].id] = i;
+
+					for (size_t id = 0; id < byId.size(); id++)
+					{
+						size_t parent = nodes_[byId[id]].parent;
+						children[filled[parent == NOTHING ? indices_.size() : parent]++] = id;
+					}
+
+			// Depth-first walk with an explicit stack, subtree sizes are summed on the way back:
+
+				std::vector<Node> ordered;
+				ordered.reserve(nodes_.size());
+
+				std::vector<size_t> stack;
+
+				for (size_t root = childStarts[indices_.size()]; root < childStarts[indices_.size() + 1]; root++)
+				{
+					stack.push_back(children[root]);
+
+					while (!stack.empty())
+					{
+						size_t id = stack.back();
+						stack.pop_back();
+
+						Node node = nodes_[byId[id]];
+
+						node.parentIndex = (node.parent == NOTHING) ? NOTHING : indices_[node.parent];
+						node.subtreeSize = 1;
+
+						indices_[id] = ordered.size();
+						ordered.push_back(node);
+
+						// Pushed backwards, so the first child is visited first:
+						for (size_t child = childStarts[id + 1]; child > childStarts[id]; child--) stack.push_back(children[child - 1]);
+					}
+				}
+
+				for (size_t i = ordered.size(); i-- > 0; )
+				{
+					if (ordered[i].parentIndex != NOTHING) ordered[ordered[i].parentIndex].subtreeSize += ordered[i].subtreeSize;
+				}
+
+			nodes_.swap(ordered);
+
+			needsReorder_ = false;
+
+			assert(ok());
+		}
+
+		void SceneGraph::update()
+		{
+			if (dirtyNodes_.empty()) return;
+
+			ALLOCATION_STAGE(ALLOCATION_SCENE);
+
+			stats_.updates++;
+
+			if (needsReorder_) reorder();
+
+			// Subtrees in array order, so the ones inside an updated subtree are skipped:
+
+				std::vector<size_t> firsts = std::vector<size_t>(dirtyNodes_.size());
+
+				for (size_t i = 0; i < dirtyNodes_.size(); i++) firsts[i] = indices_[dirtyNodes_[i]];
+
+				std::sort(firsts.begin(), firsts.end());
+
+				size_t updatedEnd = 0;
+
+				for (size_t i = 0; i < firsts.size(); i++)
+				{
+					if (firsts[i] < updatedEnd) continue;
+
+					updateSubtree(firsts[i]);
+
+					updatedEnd = firsts[i] + nodes_[firsts[i]].subtreeSize;
+				}
+
+			dirtyNodes_.clear();
+		}
+
+		void SceneGraph::updateSubtree(size_t first)
+		{
+			size_t end = first + nodes_[first].subtreeSize;
+
+			// Parents come before their children, so their world transformations are already new:
+
+				for (size_t i = first; i < end; i++)
+				{
+					Node& node = nodes_[i];
+
+					node.world = (node.parentIndex == NOTHING) ? node.local : nodes_[node.parentIndex].world * node.local;
+					node.dirty = false;
+
+					if (node.model)
+					{
+						Matrix world = node.world.toMatrix();
+
+						if (node.object == Scene::NOTHING) node.object = scene_->add(node.model, world);
+						else							   scene_->move(node.object, world);
+
+						stats_.objectsMoved++;
+					}
+				}
+
+			stats_.nodesUpdated += end - first;
+		}
+
+		void SceneGraph::render(const Renderer* renderer, const OcclusionCuller* culler /*= NULL*/)
+		{
+			update();
+
+			scene_->render(renderer, culler);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,516 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <vector>
+	#include <algorithm>
+	#include <float.h>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Bounding box
+//----------------------------------------------------------------------------
+
+	struct BoundingBox
+	{
+		float min[3];
+		float max[3];
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Bounding hierarchy
+//----------------------------------------------------------------------------
+
+	/*
+		Binned SAH bounding volume hierarchy over an array of boxes. Nodes are
+		stored flat with both children adjacent, children always after their parent,
+		and every subtree's objects contiguous in the order array.
+	*/
+	class BoundingHierarchy
+	{
+		public:
+
+			struct Node
+			{
+				float boundsMin[3];
+				float boundsMax[3];
+
+				// First of two adjacent children, 0 for leaves:
+				unsigned int child;
+				unsigned int parent;
+
+				// Subtree's objects are getOrder()[objectFirst, objectFirst + objectCount):
+				unsigned int objectFirst;
+				unsigned int objectCount;
+			};
+
+			// Deeper nodes are halved without SAH, which keeps traversal stacks bounded:
+			static const unsigned int MAX_SAH_DEPTH = 48;
+			static const unsigned int STACK_SIZE	= 2 * 96;
+
+			// Constructor:
+
+				BoundingHierarchy(unsigned int maxLeafSize = 8);
+
+			// Getters:
+
+				bool empty() const;
+
+				size_t getNodeCount() const;
+				const Node& getNode(size_t node) const;
+
+				unsigned int getObject(size_t orderIndex) const;
+				unsigned int getLeaf(size_t object) const;
+
+			// Functions:
+
+				void build(const BoundingBox* boxes, size_t count);
+
+				// Fits the ancestors of the object's leaf to its new box:
+				void refit(const BoundingBox* boxes, size_t object);
+
+				// Calls visitor(leaf, boxDistance) for every leaf hit nearer than maxDistance,
+				// nearer leaves first; visitor returns the new maxDistance:
+				template <typename Visitor>
+				void traverseRay(const double* origin, const double* inverseDirection, double maxDistance, Visitor& visitor) const;
+
+				static bool rayBox(const double* origin, const double* inverseDirection, const float* boundsMin, const float* boundsMax, double maxDistance, double* distance);
+
+		private:
+
+			static const unsigned int BIN_COUNT = 16;
+
+			void buildNode(const BoundingBox* boxes, unsigned int node, unsigned int first, unsigned int count, unsigned int depth);
+
+			static float halfArea(const float* boundsMin, const float* boundsMax);
+
+			unsigned int maxLeafSize_;
+
+			std::vector<Node> nodes_;
+			std::vector<unsigned int> order_;
+			std::vector<unsigned int> leaves_;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		BoundingHierarchy::BoundingHierarchy(unsigned int maxLeafSize /*= 8*/) :
+			maxLeafSize_ (maxLeafSize),
+			nodes_		 (),
+			order_		 (),
+			leaves_		 ()
+		{
+			assert(maxLeafSize > 0);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		bool BoundingHierarchy::empty() const
+		{
+			return nodes_.empty();
+		}
+
+		size_t BoundingHierarchy::getNodeCount() const
+		{
+			return nodes_.size();
+		}
+
+		const BoundingHierarchy::Node& BoundingHierarchy::getNode(size_t node) const
+		{
+			assert(node < nodes_.size());
+
+			return nodes_[node];
+		}
+
+		unsigned int BoundingHierarchy::getObject(size_t orderIndex) const
+		{
+			assert(orderIndex < order_.size());
+
+			return order_[orderIndex];
+		}
+
+		unsigned int BoundingHierarchy::getLeaf(size_t object) const
+		{
+			assert(object < leaves_.size());
+
+			return leaves_[object];
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		// Building:
+
+			void BoundingHierarchy::build(const BoundingBox* boxes, size_t count)
+			{
+				assert(boxes || count == 0);
+
+				nodes_.clear();
+				order_.resize(count);
+				leaves_.resize(count);
+
+				for (unsigned int i = 0; i < count; i++)
+				{
+					order_[i] = i;
+				}
+
+				if (count == 0) return;
+
+				nodes_.reserve(2 * count);
+
+				Node root = {};
+				nodes_.push_back(root);
+
+				buildNode(boxes, 0, 0, static_cast<unsigned int>(count), 0);
+			}
+
+			float BoundingHierarchy::halfArea(const float* boundsMin, const float* boundsMax)
+			{
+				float sizeX = boundsMax[0] - boundsMin[0];
+				float sizeY = boundsMax[1] - boundsMin[1];
+				float sizeZ = boundsMax[2] - boundsMin[2];
+
+				return sizeX * sizeY + sizeY * sizeZ + sizeZ * sizeX;
+			}
+
+			void BoundingHierarchy::buildNode(const BoundingBox* boxes, unsigned int node, unsigned int first, unsigned int count, unsigned int depth)
+			{
+				// Node bounds && centroid bounds:
+
+					float boundsMin[3]   = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+					float boundsMax[3]   = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+					float centroidMin[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+					float centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+					for (unsigned int i = first; i < first + count; i++)
+					{
+						const BoundingBox& box = boxes[order_[i]];
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							float centroid = (box.min[axis] + box.max[axis]) / 2;
+
+							boundsMin[axis] = std::min(boundsMin[axis], box.min[axis]);
+							boundsMax[axis] = std::max(boundsMax[axis], box.max[axis]);
+
+							centroidMin[axis] = std::min(centroidMin[axis], centroid);
+							centroidMax[axis] = std::max(centroidMax[axis], centroid);
+						}
+					}
+
+					for (size_t axis = 0; axis < 3; axis++)
+					{
+						nodes_[node].boundsMin[axis] = boundsMin[axis];
+						nodes_[node].boundsMax[axis] = boundsMax[axis];
+					}
+
+					nodes_[node].child		 = 0;
+					nodes_[node].objectFirst = first;
+					nodes_[node].objectCount = count;
+
+				// Choosing the cheapest split among binned planes of every axis, costs are in box tests of one object:
+
+					// Entering a node tests both child boxes:
+					const double TRAVERSAL_COST = 2;
+
+					double nodeArea = static_cast<double>(halfArea(boundsMin, boundsMax));
+
+					double leafCost = count;
+					double bestCost = DBL_MAX;
+					int bestAxis = -1;
+					unsigned int bestSplit = 0;
+
+					for (int axis = 0; axis < 3 && count > 1 && depth < MAX_SAH_DEPTH && nodeArea > 0; axis++)
+					{
+						float extent = centroidMax[axis] - centroidMin[axis];
+						if (extent <= 0) continue;
+
+						unsigned int binCounts[BIN_COUNT] = {};
+						float binMin[BIN_COUNT][3], binMax[BIN_COUNT][3];
+
+						for (unsigned int bin = 0; bin < BIN_COUNT; bin++)
+						{
+							for (size_t i = 0; i < 3; i++)
+							{
+								binMin[bin][i] =  FLT_MAX;
+								binMax[bin][i] = -FLT_MAX;
+							}
+						}
+
+						for (unsigned int i = first; i < first + count; i++)
+						{
+							const BoundingBox& box = boxes[order_[i]];
+
+							float centroid = (box.min[axis] + box.max[axis]) / 2;
+							unsigned int bin = std::min(static_cast<unsigned int>((centroid - centroidMin[axis]) * BIN_COUNT / extent), BIN_COUNT - 1);
+
+							binCounts[bin]++;
+
+							for (size_t j = 0; j < 3; j++)
+							{
+								binMin[bin][j] = std::min(binMin[bin][j], box.min[j]);
+								binMax[bin][j] = std::max(binMax[bin][j], box.max[j]);
+							}
+						}
+
+						// Sweeping from the right, then from the left:
+
+							double rightCosts[BIN_COUNT] = {};
+
+							float sweepMin[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+							float sweepMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+							unsigned int sweepCount = 0;
+
+							for (unsigned int bin = BIN_COUNT - 1; bin > 0; bin--)
+							{
+								sweepCount += binCounts[bin];
+
+								for (size_t j = 0; j < 3; j++)
+								{
+									sweepMin[j] = std::min(sweepMin[j], binMin[bin][j]);
+									sweepMax[j] = std::max(sweepMax[j], binMax[bin][j]);
+								}
+
+								rightCosts[bin] = sweepCount ? static_cast<double>(halfArea(sweepMin, sweepMax)) * sweepCount : 0;
+							}
+
+							for (size_t j = 0; j < 3; j++)
+							{
+								sweepMin[j] =  FLT_MAX;
+								sweepMax[j] = -FLT_MAX;
+							}
+							sweepCount = 0;
+
+							for (unsigned int bin = 0; bin < BIN_COUNT - 1; bin++)
+							{
+								sweepCount += binCounts[bin];
+
+								for (size_t j = 0; j < 3; j++)
+								{
+									sweepMin[j] = std::min(sweepMin[j], binMin[bin][j]);
+									sweepMax[j] = std::max(sweepMax[j], binMax[bin][j]);
+								}
+
+								if (sweepCount == 0 || sweepCount == count) continue;
+
+								double cost = TRAVERSAL_COST + (static_cast<double>(halfArea(sweepMin, sweepMax)) * sweepCount + rightCosts[bin + 1]) / nodeArea;
+
+								if (cost < bestCost)
+								{
+									bestCost  = cost;
+									bestAxis  = axis;
+									bestSplit = bin + 1;
+								}
+							}
+					}
+
+				// Leaf, when testing its objects is cheaper than the best split:
+
+					if (count <= maxLeafSize_ && (bestAxis < 0 || leafCost <= bestCost))
+					{
+						for (unsigned int i = first; i < first + count; i++)
+						{
+							leaves_[order_[i]] = node;
+						}
+
+						return;
+					}
+
+				// Partitioning objects (large nodes without a good split are halved):
+
+					unsigned int leftCount = 0;
+
+					if (bestAxis >= 0)
+					{
+						float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+
+						unsigned int* middle = std::partition(&order_[first], &order_[first] + count, [&](unsigned int object)
+						{
+							float centroid = (boxes[object].min[bestAxis] + boxes[object].max[bestAxis]) / 2;
+							unsigned int bin = std::min(static_cast<unsigned int>((centroid - centroidMin[bestAxis]) * BIN_COUNT / extent), BIN_COUNT - 1);
+
+							return bin < bestSplit;
+						});
+
+						leftCount = static_cast<unsigned int>(middle - &order_[first]);
+					}
+					else leftCount = count / 2;
+
+				// Children:
+
+					unsigned int left = static_cast<unsigned int>(nodes_.size());
+
+					Node child = {};
+					child.parent = node;
+
+					nodes_.push_back(child);
+					nodes_.push_back(child);
+
+					nodes_[node].child = left;
+
+					buildNode(boxes, left,	   first,			  leftCount,		 depth + 1);
+					buildNode(boxes, left + 1, first + leftCount, count - leftCount, depth + 1);
+			}
+
+		// Refitting:
+
+			void BoundingHierarchy::refit(const BoundingBox* boxes, size_t object)
+			{
+				assert(boxes);
+
+				unsigned int node = getLeaf(object);
+
+				// Leaf:
+
+					Node& leaf = nodes_[node];
+
+					for (size_t axis = 0; axis < 3; axis++)
+					{
+						leaf.boundsMin[axis] =  FLT_MAX;
+						leaf.boundsMax[axis] = -FLT_MAX;
+					}
+
+					for (unsigned int i = leaf.objectFirst; i < leaf.objectFirst + leaf.objectCount; i++)
+					{
+						const BoundingBox& box = boxes[order_[i]];
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							leaf.boundsMin[axis] = std::min(leaf.boundsMin[axis], box.min[axis]);
+							leaf.boundsMax[axis] = std::max(leaf.boundsMax[axis], box.max[axis]);
+						}
+					}
+
+				// Ancestors, until their bounds stop changing:
+
+					while (node != 0)
+					{
+						node = nodes_[node].parent;
+
+						Node& parent = nodes_[node];
+						const Node& left  = nodes_[parent.child];
+						const Node& right = nodes_[parent.child + 1];
+
+						bool changed = false;
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							float boundsMin = std::min(left.boundsMin[axis], right.boundsMin[axis]);
+							float boundsMax = std::max(left.boundsMax[axis], right.boundsMax[axis]);
+
+							changed = changed || boundsMin != parent.boundsMin[axis] || boundsMax != parent.boundsMax[axis];
+
+							parent.boundsMin[axis] = boundsMin;
+							parent.boundsMax[axis] = boundsMax;
+						}
+
+						if (!changed) break;
+					}
+			}
+
+		// Ray traversal:
+
+			bool BoundingHierarchy::rayBox(const double* origin, const double* inverseDirection, const float* boundsMin, const float* boundsMax, double maxDistance, double* distance)
+			{
+				double entry = 0;
+				double exit  = maxDistance;
+
+				for (size_t axis = 0; axis < 3; axis++)
+				{
+					double near = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+					double far  = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+
+					if (near > far) std::swap(near, far);
+
+					entry = std::max(entry, near);
+					exit  = std::min(exit,  far);
+				}
+
+				*distance = entry;
+
+				return entry <= exit;
+			}
+
+			template <typename Visitor>
+			void BoundingHierarchy::traverseRay(const double* origin, const double* inverseDirection, double maxDistance, Visitor& visitor) const
+			{
+				assert(origin);
+				assert(inverseDirection);
+
+				if (nodes_.empty()) return;
+
+				double distance = 0;
+				if (!rayBox(origin, inverseDirection, nodes_[0].boundsMin, nodes_[0].boundsMax, maxDistance, &distance)) return;
+
+				unsigned int stack[STACK_SIZE];
+				double distances[STACK_SIZE];
+				size_t stackSize = 0;
+
+				stack[stackSize] = 0;
+				distances[stackSize] = distance;
+				stackSize++;
+
+				while (stackSize > 0)
+				{
+					stackSize--;
+
+					// Hits found meanwhile may have put the node out of reach:
+					if (distances[stackSize] > maxDistance) continue;
+
+					const Node& node = nodes_[stack[stackSize]];
+
+					if (node.child == 0)
+					{
+						maxDistance = visitor(node, distances[stackSize]);
+						continue;
+					}
+
+					// The nearer child is pushed last to be visited first:
+
+						double leftDistance = 0, rightDistance = 0;
+
+						const Node& left  = nodes_[node.child];
+						const Node& right = nodes_[node.child + 1];
+
+						bool leftHit  = rayBox(origin, inverseDirection, left.boundsMin,  left.boundsMax,  maxDistance, &leftDistance);
+						bool rightHit = rayBox(origin, inverseDirection, right.boundsMin, right.boundsMax, maxDistance, &rightDistance);
+
+						assert(stackSize + 2 <= STACK_SIZE);
+
+						if (leftHit && rightHit && leftDistance < rightDistance)
+						{
+							stack[stackSize] = node.child + 1; distances[stackSize] = rightDistance; stackSize++;
+							stack[stackSize] = node.child;	  distances[stackSize] = leftDistance;  stackSize++;
+						}
+						else
+						{
+							if (leftHit)  { stack[stackSize] = node.child;	 distances[stackSize] = leftDistance;  stackSize++; }
+							if (rightHit) { stack[stackSize] = node.child + 1; distances[stackSize] = rightDistance; stackSize++; }
+						}
+				}
+			}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
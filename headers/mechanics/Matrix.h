@@ -4,6 +4,11 @@
 //{ Matrix
 //----------------------------------------------------------------------------
 
+	// Called with the number of blocks every matrix allocates, programs counting them define it before the include:
+	#ifndef MATRIX_ALLOCATED
+		#define MATRIX_ALLOCATED(blocks)
+	#endif
+
 	/*!
 	@brief ,  .       
 
@@ -133,14 +138,16 @@
             sizeY_      (sizeY),
             components_ (NULL)
         {
-            components_ = (double**) calloc(sizeX_, sizeof(*components_));
+            components_ = (double**) trackedCalloc(sizeX_, sizeof(*components_));
             assert(components_);
 
+            MATRIX_ALLOCATED(sizeX_ + 1);
+
             for (size_t x = 0; x < sizeX_; x++)
             {
                 assert(x < sizeX_);
 
-                components_[x] = (double*) calloc(sizeY_, sizeof(*components_[x]));
+                components_[x] = (double*) trackedCalloc(sizeY_, sizeof(*components_[x]));
                 assert(components_[x]);
             }
 
@@ -173,14 +180,16 @@
             sizeY_ (matrix.getSizeY()),
             components_ (NULL)
         {
-            components_ = (double**) calloc(sizeX_, sizeof(*components_));
+            components_ = (double**) trackedCalloc(sizeX_, sizeof(*components_));
             assert(components_);
 
+            MATRIX_ALLOCATED(sizeX_ + 1);
+
             for (size_t x = 0; x < sizeX_; x++)
             {
                 assert(x < sizeX_);
 
-                components_[x] = (double*) calloc(sizeY_, sizeof(*components_[x]));
+                components_[x] = (double*) trackedCalloc(sizeY_, sizeof(*components_[x]));
                 assert(components_[x]);
             }
 
@@ -205,10 +214,10 @@
             {
                 assert(x < sizeX_);
 
-                free(components_[x]);
+                trackedFree(components_[x]);
             }
 
-            free(components_);
+            trackedFree(components_);
         }
 
     //}
@@ -335,22 +344,24 @@
                 {
                     assert(x < sizeX_);
 
-                    free(components_[x]);
+                    trackedFree(components_[x]);
                 }
 
-                free(components_);
+                trackedFree(components_);
 
                 sizeX_ = matrix.getSizeX();
                 sizeY_ = matrix.getSizeY();
 
-                components_ = (double**) calloc(sizeX_, sizeof(*components_));
+                components_ = (double**) trackedCalloc(sizeX_, sizeof(*components_));
                 assert(components_);
 
+                MATRIX_ALLOCATED(sizeX_ + 1);
+
                 for (size_t x = 0; x < sizeX_; x++)
                 {
                     assert(x < sizeX_);
 
-                    components_[x] = (double*) calloc(sizeY_, sizeof(*components_[x]));
+                    components_[x] = (double*) trackedCalloc(sizeY_, sizeof(*components_[x]));
                     assert(components_[x]);
                 }
 
@@ -610,11 +621,16 @@
 									 0,			  0, 1);
 	}
 
+	// rotationMatrixX(angleX) * rotationMatrixY(angleY) * rotationMatrixZ(angleZ) multiplied out:
 	Matrix rotationMatrix(double angleX, double angleY, double angleZ)
 	{
-		return rotationMatrixX(angleX) *
-			   rotationMatrixY(angleY) *
-			   rotationMatrixZ(angleZ);
+		double sinX = sin(angleX), cosX = cos(angleX);
+		double sinY = sin(angleY), cosY = cos(angleY);
+		double sinZ = sin(angleZ), cosZ = cos(angleZ);
+
+		return Matrix(3, 3,						 cosY * cosZ,						 -cosY * sinZ,		 -sinY,
+							cosX * sinZ - sinX * sinY * cosZ,  cosX * cosZ + sinX * sinY * sinZ, -sinX * cosY,
+							sinX * sinZ + cosX * sinY * cosZ,  sinX * cosZ - cosX * sinY * sinZ,  cosX * cosY);
 	}
 
 //}
@@ -0,0 +1,288 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <vector>
+	#include <xmmintrin.h>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Ray hit
+//----------------------------------------------------------------------------
+
+	// Hit point is (1 - u - v) * point0 + u * point1 + v * point2 of the triangle:
+	struct RayHit
+	{
+		size_t triangle;
+
+		double distance;
+
+		double u, v;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Mesh hierarchy
+//----------------------------------------------------------------------------
+
+	/*
+		Bounding volume hierarchy over a triangle mesh for ray queries. Every leaf
+		holds at most four triangles, stored as one packet intersected at once
+		by a four wide SSE Moller-Trumbore test.
+	*/
+	class MeshHierarchy
+	{
+		public:
+
+			// Constructor:
+
+				MeshHierarchy(const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount);
+
+			// Functions:
+
+				// Nearest hit of origin + t * direction with t in (0, maxDistance), false if there is none:
+				bool intersect(const double* origin, const double* direction, double maxDistance, RayHit* hit) const;
+
+		private:
+
+			static const unsigned int PACKET_SIZE = 4;
+
+			// Structure of arrays for PACKET_SIZE triangles, unused lanes are degenerate:
+			struct TrianglePacket
+			{
+				float point0[3][PACKET_SIZE];
+				float edge1 [3][PACKET_SIZE];
+				float edge2 [3][PACKET_SIZE];
+
+				unsigned int triangles[PACKET_SIZE];
+			};
+
+			// Leaf visitor of BoundingHierarchy::traverseRay():
+			struct PacketVisitor
+			{
+				const MeshHierarchy* mesh;
+
+				__m128 origin[3];
+				__m128 direction[3];
+
+				RayHit* hit;
+				bool found;
+
+				double operator()(const BoundingHierarchy::Node& leaf, double leafDistance);
+			};
+
+			BoundingHierarchy hierarchy_;
+
+			std::vector<TrianglePacket> packets_;
+
+			// Packet of every leaf node:
+			std::vector<unsigned int> nodePackets_;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		MeshHierarchy::MeshHierarchy(const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount) :
+			hierarchy_	 (PACKET_SIZE),
+			packets_	 (),
+			nodePackets_ ()
+		{
+			assert(points	 || pointCount	  == 0);
+			assert(triangles || triangleCount == 0);
+
+			// Only the asserts read it:
+			(void) pointCount;
+
+			// Triangle boxes:
+
+				std::vector<BoundingBox> boxes = std::vector<BoundingBox>(triangleCount);
+
+				for (size_t i = 0; i < triangleCount; i++)
+				{
+					const Vector* corners[3] = { &points[triangles[i].point0], &points[triangles[i].point1], &points[triangles[i].point2] };
+
+					for (size_t axis = 0; axis < 3; axis++)
+					{
+						boxes[i].min[axis] =  FLT_MAX;
+						boxes[i].max[axis] = -FLT_MAX;
+					}
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						float coordinates[3] = { static_cast<float>(corners[corner]->x()),
+												 static_cast<float>(corners[corner]->y()),
+												 static_cast<float>(corners[corner]->z()) };
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							boxes[i].min[axis] = std::min(boxes[i].min[axis], coordinates[axis]);
+							boxes[i].max[axis] = std::max(boxes[i].max[axis], coordinates[axis]);
+						}
+					}
+				}
+
+				hierarchy_.build(boxes.data(), boxes.size());
+
+			// Packing leaves:
+
+				nodePackets_.resize(hierarchy_.getNodeCount());
+
+				for (size_t node = 0; node < hierarchy_.getNodeCount(); node++)
+				{
+					const BoundingHierarchy::Node& leaf = hierarchy_.getNode(node);
+					if (leaf.child != 0) continue;
+
+					assert(leaf.objectCount <= PACKET_SIZE);
+
+					TrianglePacket packet = {};
+
+					for (unsigned int lane = 0; lane < leaf.objectCount; lane++)
+					{
+						unsigned int index = hierarchy_.getObject(leaf.objectFirst + lane);
+						const Triangle& triangle = triangles[index];
+
+						const Vector& point0 = points[triangle.point0];
+						const Vector& point1 = points[triangle.point1];
+						const Vector& point2 = points[triangle.point2];
+
+						double coordinates0[3] = { point0.x(), point0.y(), point0.z() };
+						double coordinates1[3] = { point1.x(), point1.y(), point1.z() };
+						double coordinates2[3] = { point2.x(), point2.y(), point2.z() };
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							packet.point0[axis][lane] = static_cast<float>(coordinates0[axis]);
+							packet.edge1 [axis][lane] = static_cast<float>(coordinates1[axis] - coordinates0[axis]);
+							packet.edge2 [axis][lane] = static_cast<float>(coordinates2[axis] - coordinates0[axis]);
+						}
+
+						packet.triangles[lane] = index;
+					}
+
+					nodePackets_[node] = static_cast<unsigned int>(packets_.size());
+					packets_.push_back(packet);
+				}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool MeshHierarchy::intersect(const double* origin, const double* direction, double maxDistance, RayHit* hit) const
+		{
+			assert(origin);
+			assert(direction);
+			assert(hit);
+
+			double inverseDirection[3] = { 1 / direction[0], 1 / direction[1], 1 / direction[2] };
+
+			PacketVisitor visitor = {};
+			visitor.mesh  = this;
+			visitor.hit	  = hit;
+			visitor.found = false;
+
+			hit->distance = maxDistance;
+
+			for (size_t axis = 0; axis < 3; axis++)
+			{
+				visitor.origin[axis]	= _mm_set1_ps(static_cast<float>(origin[axis]));
+				visitor.direction[axis] = _mm_set1_ps(static_cast<float>(direction[axis]));
+			}
+
+			hierarchy_.traverseRay(origin, inverseDirection, maxDistance, visitor);
+
+			return visitor.found;
+		}
+
+		double MeshHierarchy::PacketVisitor::operator()(const BoundingHierarchy::Node& leaf, double /*leafDistance*/)
+		{
+			// Nodes are stored flat, so the leaf's index is its offset from the root:
+			const TrianglePacket& packet = mesh->packets_[mesh->nodePackets_[&leaf - &mesh->hierarchy_.getNode(0)]];
+
+			#define LOAD(array, axis) _mm_loadu_ps(packet.array[axis])
+			#define CROSS(result, a, b) result[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1])); \
+										result[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2])); \
+										result[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]))
+			#define DOT(a, b) _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]))
+
+			__m128 edge1[3] = { LOAD(edge1, 0), LOAD(edge1, 1), LOAD(edge1, 2) };
+			__m128 edge2[3] = { LOAD(edge2, 0), LOAD(edge2, 1), LOAD(edge2, 2) };
+
+			__m128 fromPoint0[3] = { _mm_sub_ps(origin[0], LOAD(point0, 0)),
+									 _mm_sub_ps(origin[1], LOAD(point0, 1)),
+									 _mm_sub_ps(origin[2], LOAD(point0, 2)) };
+
+			// Moller-Trumbore:
+
+				__m128 p[3];
+				CROSS(p, direction, edge2);
+
+				__m128 determinant = DOT(edge1, p);
+				__m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1), determinant);
+
+				__m128 u = _mm_mul_ps(DOT(fromPoint0, p), inverseDeterminant);
+
+				__m128 q[3];
+				CROSS(q, fromPoint0, edge1);
+
+				__m128 v = _mm_mul_ps(DOT(direction, q), inverseDeterminant);
+				__m128 t = _mm_mul_ps(DOT(edge2, q), inverseDeterminant);
+
+			#undef LOAD
+			#undef CROSS
+			#undef DOT
+
+			// Lanes hit nearer than the best hit so far (degenerate lanes fail the determinant test):
+
+				__m128 zero = _mm_setzero_ps();
+				__m128 one  = _mm_set1_ps(1);
+
+				__m128 nonDegenerate = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), determinant), _mm_set1_ps(1e-12f));
+
+				__m128 mask = _mm_and_ps(nonDegenerate, _mm_cmpge_ps(u, zero));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(static_cast<float>(std::min(hit->distance, (double) FLT_MAX)))));
+
+				int lanes = _mm_movemask_ps(mask);
+				if (lanes == 0) return hit->distance;
+
+			float distances[PACKET_SIZE], us[PACKET_SIZE], vs[PACKET_SIZE];
+
+			_mm_storeu_ps(distances, t);
+			_mm_storeu_ps(us, u);
+			_mm_storeu_ps(vs, v);
+
+			for (unsigned int lane = 0; lane < PACKET_SIZE; lane++)
+			{
+				if (!(lanes & (1 << lane)) || distances[lane] >= hit->distance) continue;
+
+				hit->triangle = packet.triangles[lane];
+				hit->distance = distances[lane];
+				hit->u		  = us[lane];
+				hit->v		  = vs[lane];
+
+				found = true;
+			}
+
+			return hit->distance;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
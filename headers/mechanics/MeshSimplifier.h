@@ -0,0 +1,543 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <queue>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Mesh simplifier
+//----------------------------------------------------------------------------
+
+	/*
+		Quadric error metric edge collapse (Garland, Heckbert). Every point
+		keeps the sum of the squared distance quadrics of its planes, edges are
+		collapsed cheapest first to the point minimizing that sum. Open borders
+		get extra perpendicular planes so they don't shrink, and collapses that
+		would flip a triangle are skipped.
+
+		simplify() can be called with smaller and smaller targets to get a chain
+		of levels from one run.
+	*/
+	class MeshSimplifier
+	{
+		public:
+
+			// Constructor:
+
+				MeshSimplifier(const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount);
+
+			// Getters:
+
+				size_t getTriangleCount() const;
+
+			// Functions:
+
+				// Collapses edges until at most targetTriangleCount triangles are left or nothing can be collapsed:
+				void simplify(size_t targetTriangleCount);
+
+				// Current mesh with unused points dropped, the arrays are calloc'd and owned by the caller:
+				void extract(Vector** points, size_t* pointCount, Triangle** triangles, size_t* triangleCount) const;
+
+		private:
+
+			// Upper triangle of a symmetric 4x4 matrix: aa ab ac ad bb bc bd cc cd dd:
+			struct Quadric
+			{
+				double values[10];
+
+				void addPlane(double a, double b, double c, double d, double weight);
+				void add(const Quadric& quadric);
+
+				double error(const double* point) const;
+
+				// Point with the smallest error, false if the matrix is singular:
+				bool minimum(double* point) const;
+			};
+
+			struct Collapse
+			{
+				double cost;
+
+				unsigned int kept, removed;
+				unsigned int keptVersion, removedVersion;
+
+				double target[3];
+
+				bool operator<(const Collapse& collapse) const;
+			};
+
+			static const unsigned int REMOVED = ~0u;
+
+			// Weight of border planes relative to face planes:
+			static const unsigned int BORDER_WEIGHT = 1000;
+
+			std::vector<double> positions_;
+			std::vector<Quadric> quadrics_;
+			std::vector<unsigned int> versions_;
+
+			// Triangles around every point, removed ones are dropped lazily:
+			std::vector<std::vector<unsigned int> > pointTriangles_;
+
+			// Three points per triangle, REMOVED for removed triangles:
+			std::vector<unsigned int> corners_;
+			std::vector<COLORREF> colors_;
+
+			size_t triangleCount_;
+
+			std::priority_queue<Collapse> collapses_;
+
+			void planeOf(unsigned int triangle, double* plane) const;
+
+			void pushCollapse(unsigned int kept, unsigned int removed);
+
+			// False if moving the kept and removed points to target flips a triangle:
+			bool keepsOrientation(const Collapse& collapse) const;
+
+			void collapse(const Collapse& collapse);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		MeshSimplifier::MeshSimplifier(const Vector* points, size_t pointCount, const Triangle* triangles, size_t triangleCount) :
+			positions_		(3 * pointCount),
+			quadrics_		(pointCount),
+			versions_		(pointCount),
+			pointTriangles_ (pointCount),
+			corners_		(3 * triangleCount),
+			colors_			(triangleCount),
+			triangleCount_	(triangleCount),
+			collapses_		()
+		{
+			assert(points	 || pointCount	  == 0);
+			assert(triangles || triangleCount == 0);
+
+			for (size_t i = 0; i < pointCount; i++)
+			{
+				positions_[3 * i]	  = points[i].x();
+				positions_[3 * i + 1] = points[i].y();
+				positions_[3 * i + 2] = points[i].z();
+
+				memset(quadrics_[i].values, 0, sizeof(quadrics_[i].values));
+			}
+
+			for (size_t i = 0; i < triangleCount; i++)
+			{
+				corners_[3 * i]		= triangles[i].point0;
+				corners_[3 * i + 1] = triangles[i].point1;
+				corners_[3 * i + 2] = triangles[i].point2;
+
+				colors_[i] = triangles[i].color;
+
+				for (size_t corner = 0; corner < 3; corner++)
+				{
+					pointTriangles_[corners_[3 * i + corner]].push_back(static_cast<unsigned int>(i));
+				}
+			}
+
+			// Face planes weighted by area, the plane normal's length is twice the area:
+
+				for (size_t i = 0; i < triangleCount; i++)
+				{
+					double plane[4] = {};
+					planeOf(static_cast<unsigned int>(i), plane);
+
+					double area = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]) / 2;
+					if (area == 0) continue;
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						quadrics_[corners_[3 * i + corner]].addPlane(plane[0], plane[1], plane[2], plane[3], area);
+					}
+				}
+
+			// Border edges belong to one triangle only, sorting the edges counts them:
+
+				std::vector<std::pair<unsigned long long, unsigned int> > edges;
+				edges.reserve(3 * triangleCount);
+
+				for (size_t i = 0; i < triangleCount; i++)
+				{
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						unsigned long long from = corners_[3 * i + corner], to = corners_[3 * i + (corner + 1) % 3];
+
+						edges.push_back(std::make_pair(std::min(from, to) << 32 | std::max(from, to), static_cast<unsigned int>(3 * i + corner)));
+					}
+				}
+
+				std::sort(edges.begin(), edges.end());
+
+				for (size_t i = 0; i < edges.size(); i++)
+				{
+					bool border = (i == 0 || edges[i - 1].first != edges[i].first) && (i + 1 == edges.size() || edges[i + 1].first != edges[i].first);
+					if (!border) continue;
+
+					unsigned int triangle = edges[i].second / 3, corner = edges[i].second % 3;
+
+					unsigned int from = corners_[3 * triangle + corner], to = corners_[3 * triangle + (corner + 1) % 3];
+
+					double plane[4] = {};
+					planeOf(triangle, plane);
+
+					// Through the edge, perpendicular to its triangle:
+
+						const double* a = &positions_[3 * from];
+						const double* b = &positions_[3 * to];
+
+						double edge[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+
+						double normal[3] = { edge[1] * plane[2] - edge[2] * plane[1],
+											 edge[2] * plane[0] - edge[0] * plane[2],
+											 edge[0] * plane[1] - edge[1] * plane[0] };
+
+						double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+						if (length == 0) continue;
+
+						for (size_t axis = 0; axis < 3; axis++) normal[axis] /= length;
+
+						double distance = -(normal[0] * a[0] + normal[1] * a[1] + normal[2] * a[2]);
+						double weight = BORDER_WEIGHT * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+
+						quadrics_[from].addPlane(normal[0], normal[1], normal[2], distance, weight);
+						quadrics_[to]  .addPlane(normal[0], normal[1], normal[2], distance, weight);
+				}
+
+			// Every edge once, from its lower point:
+
+				for (size_t i = 0; i < edges.size(); i++)
+				{
+					if (i > 0 && edges[i - 1].first == edges[i].first) continue;
+
+					pushCollapse(static_cast<unsigned int>(edges[i].first >> 32), static_cast<unsigned int>(edges[i].first & 0xFFFFFFFF));
+				}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		size_t MeshSimplifier::getTriangleCount() const
+		{
+			return triangleCount_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Quadric && collapse
+	//----------------------------------------------------------------------------
+
+		void MeshSimplifier::Quadric::addPlane(double a, double b, double c, double d, double weight)
+		{
+			// Normalizing the plane, so its quadric is the weighted squared distance:
+			double scale = weight / std::max(a * a + b * b + c * c, DBL_MIN);
+
+			values[0] += scale * a * a; values[1] += scale * a * b; values[2] += scale * a * c; values[3] += scale * a * d;
+			values[4] += scale * b * b; values[5] += scale * b * c; values[6] += scale * b * d;
+			values[7] += scale * c * c; values[8] += scale * c * d;
+			values[9] += scale * d * d;
+		}
+
+		void MeshSimplifier::Quadric::add(const Quadric& quadric)
+		{
+			for (size_t i = 0; i < 10; i++) values[i] += quadric.values[i];
+		}
+
+		double MeshSimplifier::Quadric::error(const double* point) const
+		{
+			double x = point[0], y = point[1], z = point[2];
+
+			return values[0] * x * x + 2 * values[1] * x * y + 2 * values[2] * x * z + 2 * values[3] * x +
+				   values[4] * y * y + 2 * values[5] * y * z + 2 * values[6] * y +
+				   values[7] * z * z + 2 * values[8] * z +
+				   values[9];
+		}
+
+		bool MeshSimplifier::Quadric::minimum(double* point) const
+		{
+			// Solving the 3x3 system by Cramer's rule:
+
+				double a = values[0], b = values[1], c = values[2];
+				double d = values[4], e = values[5], f = values[7];
+
+				double determinant = a * (d * f - e * e) - b * (b * f - e * c) + c * (b * e - d * c);
+
+				double scale = fabs(a) + fabs(d) + fabs(f);
+				if (fabs(determinant) <= 1e-12 * scale * scale * scale) return false;
+
+				double rhs[3] = { -values[3], -values[6], -values[8] };
+
+				point[0] = (rhs[0] * (d * f - e * e) - b * (rhs[1] * f - e * rhs[2]) + c * (rhs[1] * e - d * rhs[2])) / determinant;
+				point[1] = (a * (rhs[1] * f - e * rhs[2]) - rhs[0] * (b * f - e * c) + c * (b * rhs[2] - rhs[1] * c)) / determinant;
+				point[2] = (a * (d * rhs[2] - rhs[1] * e) - b * (b * rhs[2] - rhs[1] * c) + rhs[0] * (b * e - d * c)) / determinant;
+
+			return true;
+		}
+
+		bool MeshSimplifier::Collapse::operator<(const Collapse& collapse) const
+		{
+			// The queue pops its largest element, so cheaper collapses are "larger":
+			return cost > collapse.cost;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		void MeshSimplifier::planeOf(unsigned int triangle, double* plane) const
+		{
+			const double* a = &positions_[3 * corners_[3 * triangle]];
+			const double* b = &positions_[3 * corners_[3 * triangle + 1]];
+			const double* c = &positions_[3 * corners_[3 * triangle + 2]];
+
+			double edge1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			double edge2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+			plane[0] = edge1[1] * edge2[2] - edge1[2] * edge2[1];
+			plane[1] = edge1[2] * edge2[0] - edge1[0] * edge2[2];
+			plane[2] = edge1[0] * edge2[1] - edge1[1] * edge2[0];
+			plane[3] = -(plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2]);
+		}
+
+		void MeshSimplifier::pushCollapse(unsigned int kept, unsigned int removed)
+		{
+			Quadric quadric = quadrics_[kept];
+			quadric.add(quadrics_[removed]);
+
+			Collapse collapse = {};
+			collapse.kept			= kept;
+			collapse.removed		= removed;
+			collapse.keptVersion	= versions_[kept];
+			collapse.removedVersion = versions_[removed];
+
+			// The optimal point, or the best of the ends and the middle when there is none:
+
+				if (!quadric.minimum(collapse.target))
+				{
+					const double* a = &positions_[3 * kept];
+					const double* b = &positions_[3 * removed];
+
+					double middle[3] = { (a[0] + b[0]) / 2, (a[1] + b[1]) / 2, (a[2] + b[2]) / 2 };
+					const double* candidates[3] = { a, b, middle };
+
+					double best = DBL_MAX;
+
+					for (size_t i = 0; i < 3; i++)
+					{
+						double error = quadric.error(candidates[i]);
+						if (error >= best) continue;
+
+						best = error;
+						memcpy(collapse.target, candidates[i], sizeof(collapse.target));
+					}
+				}
+
+			collapse.cost = std::max(quadric.error(collapse.target), 0.0);
+
+			collapses_.push(collapse);
+		}
+
+		bool MeshSimplifier::keepsOrientation(const Collapse& collapse) const
+		{
+			unsigned int ends[2] = { collapse.kept, collapse.removed };
+
+			for (size_t end = 0; end < 2; end++)
+			{
+				const std::vector<unsigned int>& around = pointTriangles_[ends[end]];
+
+				for (size_t i = 0; i < around.size(); i++)
+				{
+					const unsigned int* corners = &corners_[3 * around[i]];
+					if (corners[0] == REMOVED) continue;
+
+					// Triangles on the edge disappear:
+
+						bool hasKept	= corners[0] == collapse.kept	 || corners[1] == collapse.kept	   || corners[2] == collapse.kept;
+						bool hasRemoved = corners[0] == collapse.removed || corners[1] == collapse.removed || corners[2] == collapse.removed;
+
+						if (hasKept && hasRemoved) continue;
+
+					double before[3][3], after[3][3];
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						const double* position = &positions_[3 * corners[corner]];
+						bool moved = corners[corner] == ends[end];
+
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							before[corner][axis] = position[axis];
+							after [corner][axis] = moved ? collapse.target[axis] : position[axis];
+						}
+					}
+
+					double normals[2][3] = {};
+					double (*shapes[2])[3] = { before, after };
+
+					for (size_t shape = 0; shape < 2; shape++)
+					{
+						double (*p)[3] = shapes[shape];
+
+						double edge1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+						double edge2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+
+						normals[shape][0] = edge1[1] * edge2[2] - edge1[2] * edge2[1];
+						normals[shape][1] = edge1[2] * edge2[0] - edge1[0] * edge2[2];
+						normals[shape][2] = edge1[0] * edge2[1] - edge1[1] * edge2[0];
+					}
+
+					double dot = normals[0][0] * normals[1][0] + normals[0][1] * normals[1][1] + normals[0][2] * normals[1][2];
+
+					if (dot <= 0) return false;
+				}
+			}
+
+			return true;
+		}
+
+		void MeshSimplifier::collapse(const Collapse& collapse)
+		{
+			unsigned int kept = collapse.kept, removed = collapse.removed;
+
+			memcpy(&positions_[3 * kept], collapse.target, sizeof(collapse.target));
+			quadrics_[kept].add(quadrics_[removed]);
+
+			versions_[kept]++;
+			versions_[removed]++;
+
+			// Moving the removed point's triangles to the kept one, dropping those on the edge:
+
+				std::vector<unsigned int>& keptTriangles = pointTriangles_[kept];
+				std::vector<unsigned int>& removedTriangles = pointTriangles_[removed];
+
+				for (size_t i = 0; i < removedTriangles.size(); i++)
+				{
+					unsigned int* corners = &corners_[3 * removedTriangles[i]];
+					if (corners[0] == REMOVED) continue;
+
+					if (corners[0] == kept || corners[1] == kept || corners[2] == kept)
+					{
+						corners[0] = corners[1] = corners[2] = REMOVED;
+						triangleCount_--;
+
+						continue;
+					}
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						if (corners[corner] == removed) corners[corner] = kept;
+					}
+
+					keptTriangles.push_back(removedTriangles[i]);
+				}
+
+				std::vector<unsigned int>().swap(removedTriangles);
+
+			// New costs of the edges around the kept point:
+
+				size_t live = 0;
+
+				for (size_t i = 0; i < keptTriangles.size(); i++)
+				{
+					const unsigned int* corners = &corners_[3 * keptTriangles[i]];
+					if (corners[0] == REMOVED) continue;
+
+					keptTriangles[live++] = keptTriangles[i];
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						if (corners[corner] != kept) pushCollapse(kept, corners[corner]);
+					}
+				}
+
+				keptTriangles.resize(live);
+		}
+
+		void MeshSimplifier::simplify(size_t targetTriangleCount)
+		{
+			while (triangleCount_ > targetTriangleCount && !collapses_.empty())
+			{
+				Collapse collapse = collapses_.top();
+				collapses_.pop();
+
+				// Entries of points changed since they were pushed are stale:
+				if (versions_[collapse.kept] != collapse.keptVersion || versions_[collapse.removed] != collapse.removedVersion) continue;
+
+				if (!keepsOrientation(collapse)) continue;
+
+				this->collapse(collapse);
+			}
+		}
+
+		void MeshSimplifier::extract(Vector** points, size_t* pointCount, Triangle** triangles, size_t* triangleCount) const
+		{
+			assert(points && pointCount);
+			assert(triangles && triangleCount);
+
+			// Numbering used points:
+
+				std::vector<unsigned int> newIndices = std::vector<unsigned int>(versions_.size(), REMOVED);
+
+				size_t usedPoints = 0;
+
+				for (size_t i = 0; i < corners_.size(); i++)
+				{
+					if (corners_[i] != REMOVED && newIndices[corners_[i]] == REMOVED) newIndices[corners_[i]] = static_cast<unsigned int>(usedPoints++);
+				}
+
+			*points = (Vector*) trackedCalloc(std::max<size_t>(usedPoints, 1), sizeof(**points));
+			assert(*points);
+
+			*triangles = (Triangle*) trackedCalloc(std::max<size_t>(triangleCount_, 1), sizeof(**triangles));
+			assert(*triangles);
+
+			for (size_t i = 0; i < newIndices.size(); i++)
+			{
+				if (newIndices[i] != REMOVED) (*points)[newIndices[i]] = Vector(positions_[3 * i], positions_[3 * i + 1], positions_[3 * i + 2]);
+			}
+
+			size_t written = 0;
+
+			for (size_t i = 0; i < colors_.size(); i++)
+			{
+				if (corners_[3 * i] == REMOVED) continue;
+
+				double plane[4] = {};
+				planeOf(static_cast<unsigned int>(i), plane);
+
+				double length = std::max(sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]), DBL_MIN);
+
+				Triangle& triangle = (*triangles)[written++];
+
+				triangle.point0 = newIndices[corners_[3 * i]];
+				triangle.point1 = newIndices[corners_[3 * i + 1]];
+				triangle.point2 = newIndices[corners_[3 * i + 2]];
+				triangle.color	= colors_[i];
+				triangle.normal = Vector(plane[0] / length, plane[1] / length, plane[2] / length);
+			}
+
+			*pointCount	   = usedPoints;
+			*triangleCount = written;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
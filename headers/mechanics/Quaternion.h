@@ -0,0 +1,217 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Quaternion
+//----------------------------------------------------------------------------
+
+	/*
+		Rotation as a unit quaternion. Orientations kept as quaternions and
+		turned into a Matrix only for drawing don't drift out of orthonormality
+		the way a matrix multiplied by small rotations every frame does, and
+		renormalize() costs a few multiplications:
+
+			Quaternion orientation;
+			...
+			orientation = Quaternion::fromAngles(0.01, 0.01, 0.03) * orientation;
+			orientation.renormalize();
+
+			model.render(&renderer, orientation.toMatrix(position));
+	*/
+	struct Quaternion
+	{
+		public:
+
+			// Constructors:
+
+				// No rotation:
+				Quaternion();
+
+				Quaternion(double w, double x, double y, double z);
+
+			// Functions:
+
+				// Same rotation as rotationMatrix(angleX, angleY, angleZ):
+				static Quaternion fromAngles(double angleX, double angleY, double angleZ);
+
+				static Quaternion fromAxisAngle(double axisX, double axisY, double axisZ, double angle);
+
+				// Turns from start to end at a constant speed along the shorter way, t goes from 0 to 1:
+				static Quaternion slerp(const Quaternion& start, const Quaternion& end, double t);
+
+				double squaredLength() const;
+
+				// Inverse rotation of a unit quaternion:
+				Quaternion conjugated() const;
+
+				// Back to unit length, a single Newton step while the error is as small as rounding leaves it:
+				Quaternion& renormalize();
+
+				void rotate(double x, double y, double z, double* output) const;
+
+				// 4x4 transformation rotating, then shifting:
+				Matrix toMatrix(const Vector& shift = Vector(0, 0, 0)) const;
+
+			// Operators:
+
+				// Applies inner first, like Matrix products do:
+				Quaternion  operator* (const Quaternion& inner) const;
+				Quaternion& operator*=(const Quaternion& inner);
+
+			double w, x, y, z;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructors
+	//----------------------------------------------------------------------------
+
+		Quaternion::Quaternion() :
+			w (1),
+			x (0),
+			y (0),
+			z (0)
+		{}
+
+		Quaternion::Quaternion(double w, double x, double y, double z) :
+			w (w),
+			x (x),
+			y (y),
+			z (z)
+		{}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		Quaternion Quaternion::fromAngles(double angleX, double angleY, double angleZ)
+		{
+			// rotationMatrixY() turns the other way than the right-hand rule:
+
+				return fromAxisAngle(1, 0, 0,  angleX) *
+					   fromAxisAngle(0, 1, 0, -angleY) *
+					   fromAxisAngle(0, 0, 1,  angleZ);
+		}
+
+		Quaternion Quaternion::fromAxisAngle(double axisX, double axisY, double axisZ, double angle)
+		{
+			double length = sqrt(axisX * axisX + axisY * axisY + axisZ * axisZ);
+			assert(length > 0);
+
+			double factor = sin(angle / 2) / length;
+
+			return Quaternion(cos(angle / 2), axisX * factor, axisY * factor, axisZ * factor);
+		}
+
+		Quaternion Quaternion::slerp(const Quaternion& start, const Quaternion& end, double t)
+		{
+			double cosine = start.w * end.w + start.x * end.x + start.y * end.y + start.z * end.z;
+
+			// q and -q are the same rotation, the one nearer to start is the shorter way:
+			double sign = (cosine < 0) ? -1 : 1;
+			cosine *= sign;
+
+			double startWeight = 1 - t;
+			double endWeight   = t;
+
+			// Nearly equal rotations are interpolated linearly, the sine below would lose all precision:
+			if (cosine < 0.9995)
+			{
+				double angle = acos(cosine);
+				double sine	 = sin(angle);
+
+				startWeight = sin((1 - t) * angle) / sine;
+				endWeight	= sin(t * angle) / sine;
+			}
+
+			endWeight *= sign;
+
+			Quaternion result = Quaternion(startWeight * start.w + endWeight * end.w,
+										   startWeight * start.x + endWeight * end.x,
+										   startWeight * start.y + endWeight * end.y,
+										   startWeight * start.z + endWeight * end.z);
+
+			return result.renormalize();
+		}
+
+		double Quaternion::squaredLength() const
+		{
+			return w * w + x * x + y * y + z * z;
+		}
+
+		Quaternion Quaternion::conjugated() const
+		{
+			return Quaternion(w, -x, -y, -z);
+		}
+
+		Quaternion& Quaternion::renormalize()
+		{
+			double squared = squaredLength();
+			assert(squared > 0);
+
+			// 1 / sqrt(squared) to the first order around 1:
+			double factor = (fabs(squared - 1) < 1e-3) ? (3 - squared) / 2 : 1 / sqrt(squared);
+
+			w *= factor;
+			x *= factor;
+			y *= factor;
+			z *= factor;
+
+			return *this;
+		}
+
+		void Quaternion::rotate(double pointX, double pointY, double pointZ, double* output) const
+		{
+			assert(output);
+
+			// v + 2w (q x v) + 2 q x (q x v):
+
+				double crossX = 2 * (y * pointZ - z * pointY);
+				double crossY = 2 * (z * pointX - x * pointZ);
+				double crossZ = 2 * (x * pointY - y * pointX);
+
+				output[0] = pointX + w * crossX + (y * crossZ - z * crossY);
+				output[1] = pointY + w * crossY + (z * crossX - x * crossZ);
+				output[2] = pointZ + w * crossZ + (x * crossY - y * crossX);
+		}
+
+		Matrix Quaternion::toMatrix(const Vector& shift /*= Vector(0, 0, 0)*/) const
+		{
+			double xx = x * x, yy = y * y, zz = z * z;
+			double xy = x * y, xz = x * z, yz = y * z;
+			double wx = w * x, wy = w * y, wz = w * z;
+
+			return Matrix(4, 4, 1 - 2 * (yy + zz),	   2 * (xy - wz),	  2 * (xz + wy), shift.x(),
+									2 * (xy + wz), 1 - 2 * (xx + zz),	  2 * (yz - wx), shift.y(),
+									2 * (xz - wy),	   2 * (yz + wx), 1 - 2 * (xx + yy), shift.z(),
+												0,				   0,				  0,		 1.0);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Operators
+	//----------------------------------------------------------------------------
+
+		Quaternion Quaternion::operator*(const Quaternion& inner) const
+		{
+			return Quaternion(w * inner.w - x * inner.x - y * inner.y - z * inner.z,
+							  w * inner.x + x * inner.w + y * inner.z - z * inner.y,
+							  w * inner.y - x * inner.z + y * inner.w + z * inner.x,
+							  w * inner.z + x * inner.y - y * inner.x + z * inner.w);
+		}
+
+		Quaternion& Quaternion::operator*=(const Quaternion& inner)
+		{
+			*this = *this * inner;
+
+			return *this;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,209 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Transform
+//----------------------------------------------------------------------------
+
+	// Flat copy of a 4x4 transformation matrix for per-vertex loops,
+	// which can't afford a Matrix allocation for every transformed point.
+	struct Transform
+	{
+		public:
+
+			// Constructor:
+
+				Transform(const Matrix& matrix);
+
+			// Functions:
+
+				void apply(double x, double y, double z, double* output) const;
+				void apply(const Vector& point, double* output) const;
+
+				// Without the translation:
+				void applyDirection(double x, double y, double z, double* output) const;
+
+				// Axis-aligned box around the transformed box [boundsMin, boundsMax]:
+				void applyBounds(const Vector& boundsMin, const Vector& boundsMax, double* outputMin, double* outputMax) const;
+
+				// Inverse of an affine transformation:
+				Transform inverted() const;
+
+				// Applies inner first, like Matrix products do:
+				Transform operator*(const Transform& inner) const;
+
+				Matrix toMatrix() const;
+
+			// Same layout as Matrix: components[column][row]
+			double components[4][4];
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		Transform::Transform(const Matrix& matrix)
+		{
+			assert(matrix.ok());
+			assert(matrix.getSizeX() == 4 && matrix.getSizeY() == 4);
+
+			for (size_t x = 0; x < 4; x++)
+			{
+				for (size_t y = 0; y < 4; y++)
+				{
+					components[x][y] = matrix[x][y];
+				}
+			}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		void Transform::apply(double x, double y, double z, double* output) const
+		{
+			assert(output);
+
+			for (size_t row = 0; row < 3; row++)
+			{
+				output[row] = components[0][row] * x +
+							  components[1][row] * y +
+							  components[2][row] * z +
+							  components[3][row];
+			}
+		}
+
+		void Transform::apply(const Vector& point, double* output) const
+		{
+			apply(point.x(), point.y(), point.z(), output);
+		}
+
+		void Transform::applyDirection(double x, double y, double z, double* output) const
+		{
+			assert(output);
+
+			for (size_t row = 0; row < 3; row++)
+			{
+				output[row] = components[0][row] * x +
+							  components[1][row] * y +
+							  components[2][row] * z;
+			}
+		}
+
+		void Transform::applyBounds(const Vector& boundsMin, const Vector& boundsMax, double* outputMin, double* outputMax) const
+		{
+			assert(outputMin);
+			assert(outputMax);
+
+			double inputMin[3] = { boundsMin.x(), boundsMin.y(), boundsMin.z() };
+			double inputMax[3] = { boundsMax.x(), boundsMax.y(), boundsMax.z() };
+
+			// Every column contributes its smaller and its larger product independently:
+
+				for (size_t row = 0; row < 3; row++)
+				{
+					outputMin[row] = components[3][row];
+					outputMax[row] = components[3][row];
+
+					for (size_t column = 0; column < 3; column++)
+					{
+						double fromMin = components[column][row] * inputMin[column];
+						double fromMax = components[column][row] * inputMax[column];
+
+						outputMin[row] += std::min(fromMin, fromMax);
+						outputMax[row] += std::max(fromMin, fromMax);
+					}
+				}
+		}
+
+		Transform Transform::inverted() const
+		{
+			Transform toReturn = *this;
+
+			// Linear part by cofactors (in row-major a[row][column] for readability):
+
+				double a[3][3] = {};
+
+				for (size_t row = 0; row < 3; row++)
+				{
+					for (size_t column = 0; column < 3; column++)
+					{
+						a[row][column] = components[column][row];
+					}
+				}
+
+				double cofactors[3][3] = {};
+
+				for (size_t i = 0; i < 3; i++)
+				{
+					for (size_t j = 0; j < 3; j++)
+					{
+						cofactors[i][j] = a[(i + 1) % 3][(j + 1) % 3] * a[(i + 2) % 3][(j + 2) % 3] -
+										  a[(i + 1) % 3][(j + 2) % 3] * a[(i + 2) % 3][(j + 1) % 3];
+					}
+				}
+
+				double determinant = a[0][0] * cofactors[0][0] + a[0][1] * cofactors[0][1] + a[0][2] * cofactors[0][2];
+				assert(determinant != 0);
+
+				// inverse[row][column] = cofactors[column][row] / determinant, stored as [column][row]:
+				for (size_t column = 0; column < 3; column++)
+				{
+					for (size_t row = 0; row < 3; row++)
+					{
+						toReturn.components[column][row] = cofactors[column][row] / determinant;
+					}
+				}
+
+			// Translation:
+
+				for (size_t row = 0; row < 3; row++)
+				{
+					toReturn.components[3][row] = -(toReturn.components[0][row] * components[3][0] +
+													toReturn.components[1][row] * components[3][1] +
+													toReturn.components[2][row] * components[3][2]);
+				}
+
+			return toReturn;
+		}
+
+		Transform Transform::operator*(const Transform& inner) const
+		{
+			Transform toReturn = *this;
+
+			for (size_t column = 0; column < 4; column++)
+			{
+				for (size_t row = 0; row < 3; row++)
+				{
+					toReturn.components[column][row] = components[0][row] * inner.components[column][0] +
+													   components[1][row] * inner.components[column][1] +
+													   components[2][row] * inner.components[column][2] +
+													   (column == 3 ? components[3][row] : 0);
+				}
+			}
+
+			return toReturn;
+		}
+
+		Matrix Transform::toMatrix() const
+		{
+			Matrix toReturn = Matrix(4, 4);
+
+			for (size_t x = 0; x < 4; x++)
+			{
+				for (size_t y = 0; y < 4; y++)
+				{
+					toReturn[x][y] = components[x][y];
+				}
+			}
+
+			return toReturn;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -1 +1,20 @@
 #pragma once
+
+//----------------------------------------------------------------------------
+//{ Triangle
+//----------------------------------------------------------------------------
+
+	struct Triangle
+	{
+		public:
+			
+			// These are just numbers of points in vertecies array
+			unsigned int point0, point1, point2;
+
+			COLORREF color;
+
+			Vector normal;
+	};
+
+//}
+//----------------------------------------------------------------------------
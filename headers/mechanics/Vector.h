@@ -480,25 +480,13 @@
 								Vector shift	 /*= Vector(0, 0, 0)*/,
 								Vector extension /*= Vector(1, 1, 1)*/)
 	{
-		Matrix toReturn = identityMatrix(4);
-
 		Matrix rotation = rotationMatrix(angleX, angleY, angleZ);
 
-		for (size_t x = 0; x < 3; x++)
-		{
-			for (size_t y = 0; y < 3; y++)
-			{
-				toReturn[x][y] = rotation[x][y];
-			}
-		}
-
-		toReturn[3][0] = shift.x();
-		toReturn[3][1] = shift.y();
-		toReturn[3][2] = shift.z();
-
-		toReturn[0][0] *= extension.x();
-		toReturn[1][1] *= extension.y();
-		toReturn[2][2] *= extension.z();
+		// The extension scales the diagonal only:
+		Matrix toReturn = Matrix(4, 4, rotation[0][0] * extension.x(), rotation[1][0],				   rotation[2][0],				   shift.x(),
+									  rotation[0][1],				   rotation[1][1] * extension.y(), rotation[2][1],				   shift.y(),
+									  rotation[0][2],				   rotation[1][2],				   rotation[2][2] * extension.z(), shift.z(),
+									  0.0,							   0.0,							   0.0,							   1.0);
 
 		assert(toReturn.ok());
 
@@ -0,0 +1,440 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <atomic>
+	#include <xmmintrin.h>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Allocation tracker
+//----------------------------------------------------------------------------
+
+	/*
+		Matrix, Model and Renderer allocate through the tracked*() functions.
+		They are plain calloc(), realloc(), free() and _mm_malloc() unless
+		TRACK_ALLOCATIONS is defined before Includes.h, then every block gets
+		a small header with its size and stage, and allocations, bytes and
+		the peak of live bytes are counted per pipeline stage and per frame:
+
+			#define TRACK_ALLOCATIONS
+			#include "Includes.h"
+			...
+			renderer.startRendering();
+			scene.render(&renderer);
+			renderer.finishRendering();
+
+			AllocationTracker::print();
+
+		The stage belongs to the thread, and ThreadPool jobs run in the stage
+		of the thread that submitted them, so workers count toward the stage
+		the frame is in. Stages are set by ALLOCATION_STAGE() and read by
+		CURRENT_ALLOCATION_STAGE(), which compile to nothing and to
+		ALLOCATION_OTHER without tracking.
+	*/
+
+	enum AllocationStage
+	{
+		ALLOCATION_OTHER,
+		ALLOCATION_LOADING,
+		ALLOCATION_SCENE,
+		ALLOCATION_MODEL,
+		ALLOCATION_TRIANGLES,
+		ALLOCATION_FINISH,
+
+		ALLOCATION_STAGE_COUNT
+	};
+
+	struct AllocationStats
+	{
+		unsigned long long allocations;
+		unsigned long long frees;
+
+		// Allocated, frees don't subtract:
+		unsigned long long bytes;
+
+		// Most bytes allocated by the stage and not freed yet at once:
+		unsigned long long peakBytes;
+	};
+
+	#ifdef TRACK_ALLOCATIONS
+
+		class AllocationTracker
+		{
+			public:
+
+				// Getters:
+
+					static AllocationStage getStage();
+
+					// The previous stage is returned, so it can be restored:
+					static AllocationStage setStage(AllocationStage stage);
+
+					// Since the program started:
+					static AllocationStats getTotal(AllocationStage stage);
+
+					// Between the last startFrame() and finishFrame():
+					static AllocationStats getLastFrame(AllocationStage stage);
+
+					static unsigned long long getLiveBytes(AllocationStage stage);
+
+				// Functions:
+
+					// Called by Renderer::startRendering() and finishRendering():
+					static void startFrame();
+					static void finishFrame();
+
+					// The last frame's counters, a line per stage:
+					static void print(FILE* file = stdout);
+
+					static void* allocate(size_t size, size_t alignment, bool zeroed);
+					static void* reallocate(void* block, size_t size);
+					static void  release(void* block, bool aligned);
+
+			private:
+
+				// Kept in front of every block, as large as the alignments asked for so the block stays aligned:
+				struct Header
+				{
+					size_t size;
+					AllocationStage stage;
+				};
+
+				static const size_t HEADER_SIZE = 16;
+
+				struct Counters
+				{
+					std::atomic<unsigned long long> allocations;
+					std::atomic<unsigned long long> frees;
+					std::atomic<unsigned long long> bytes;
+					std::atomic<unsigned long long> peakBytes;
+				};
+
+				struct State
+				{
+					std::atomic<unsigned long long> liveBytes[ALLOCATION_STAGE_COUNT];
+
+					Counters total[ALLOCATION_STAGE_COUNT];
+					Counters frame[ALLOCATION_STAGE_COUNT];
+
+					AllocationStats lastFrame[ALLOCATION_STAGE_COUNT];
+				};
+
+				// A function static, so the state exists before any other static object allocates:
+				static State& state();
+
+				// Of the calling thread:
+				static AllocationStage& threadStage();
+
+				static void counted(AllocationStage stage, size_t size);
+				static void uncounted(AllocationStage stage, size_t size);
+
+				static void raise(std::atomic<unsigned long long>* peak, unsigned long long value);
+				static AllocationStats read(const Counters& counters);
+		};
+
+		// Restores the previous stage when the scope ends:
+		class AllocationStageScope
+		{
+			public:
+
+				AllocationStageScope(AllocationStage stage) :
+					previous_ (AllocationTracker::setStage(stage))
+				{}
+
+				~AllocationStageScope()
+				{
+					AllocationTracker::setStage(previous_);
+				}
+
+			private:
+
+				AllocationStage previous_;
+		};
+
+		#define ALLOCATION_STAGE(stage) AllocationStageScope allocationStageScope(stage)
+
+		#define CURRENT_ALLOCATION_STAGE() AllocationTracker::getStage()
+
+		//----------------------------------------------------------------------------
+		//{ Getters
+		//----------------------------------------------------------------------------
+
+			AllocationStage AllocationTracker::getStage()
+			{
+				return threadStage();
+			}
+
+			AllocationStage AllocationTracker::setStage(AllocationStage stage)
+			{
+				assert(stage < ALLOCATION_STAGE_COUNT);
+
+				AllocationStage previous = threadStage();
+				threadStage() = stage;
+
+				return previous;
+			}
+
+			AllocationStats AllocationTracker::getTotal(AllocationStage stage)
+			{
+				assert(stage < ALLOCATION_STAGE_COUNT);
+
+				return read(state().total[stage]);
+			}
+
+			AllocationStats AllocationTracker::getLastFrame(AllocationStage stage)
+			{
+				assert(stage < ALLOCATION_STAGE_COUNT);
+
+				return state().lastFrame[stage];
+			}
+
+			unsigned long long AllocationTracker::getLiveBytes(AllocationStage stage)
+			{
+				assert(stage < ALLOCATION_STAGE_COUNT);
+
+				return state().liveBytes[stage].load(std::memory_order_relaxed);
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Functions
+		//----------------------------------------------------------------------------
+
+			AllocationTracker::State& AllocationTracker::state()
+			{
+				static State state;
+
+				return state;
+			}
+
+			AllocationStage& AllocationTracker::threadStage()
+			{
+				static thread_local AllocationStage stage = ALLOCATION_OTHER;
+
+				return stage;
+			}
+
+			void AllocationTracker::startFrame()
+			{
+				State& current = state();
+
+				// The frame's peaks start from what is already live:
+
+					for (size_t i = 0; i < ALLOCATION_STAGE_COUNT; i++)
+					{
+						current.frame[i].allocations = 0;
+						current.frame[i].frees		 = 0;
+						current.frame[i].bytes		 = 0;
+						current.frame[i].peakBytes	 = current.liveBytes[i].load(std::memory_order_relaxed);
+					}
+			}
+
+			void AllocationTracker::finishFrame()
+			{
+				State& current = state();
+
+				for (size_t i = 0; i < ALLOCATION_STAGE_COUNT; i++) current.lastFrame[i] = read(current.frame[i]);
+			}
+
+			void AllocationTracker::print(FILE* file /*= stdout*/)
+			{
+				assert(file);
+
+				static const char* const NAMES[ALLOCATION_STAGE_COUNT] = { "other", "loading", "scene", "model", "triangles", "finish" };
+
+				for (size_t i = 0; i < ALLOCATION_STAGE_COUNT; i++)
+				{
+					const AllocationStats& stats = state().lastFrame[i];
+
+					fprintf(file, "%-10s %10llu allocations %10llu frees %12llu bytes %12llu peak bytes\n",
+							NAMES[i], stats.allocations, stats.frees, stats.bytes, stats.peakBytes);
+				}
+			}
+
+			void* AllocationTracker::allocate(size_t size, size_t alignment, bool zeroed)
+			{
+				assert(alignment <= HEADER_SIZE);
+
+				char* base = (char*) (alignment ? _mm_malloc(size + HEADER_SIZE, HEADER_SIZE) : malloc(size + HEADER_SIZE));
+				if (!base) return NULL;
+
+				if (zeroed) memset(base + HEADER_SIZE, 0, size);
+
+				Header header = { size, getStage() };
+				memcpy(base, &header, sizeof(header));
+
+				counted(header.stage, size);
+
+				return base + HEADER_SIZE;
+			}
+
+			void* AllocationTracker::reallocate(void* block, size_t size)
+			{
+				if (!block) return allocate(size, 0, false);
+
+				char* base = (char*) block - HEADER_SIZE;
+
+				Header header = {};
+				memcpy(&header, base, sizeof(header));
+
+				base = (char*) realloc(base, size + HEADER_SIZE);
+				if (!base) return NULL;
+
+				// Counted as freeing the old block and allocating the new one in the current stage:
+
+					uncounted(header.stage, header.size);
+
+					header.size	 = size;
+					header.stage = getStage();
+
+					memcpy(base, &header, sizeof(header));
+
+					counted(header.stage, size);
+
+				return base + HEADER_SIZE;
+			}
+
+			void AllocationTracker::release(void* block, bool aligned)
+			{
+				if (!block) return;
+
+				char* base = (char*) block - HEADER_SIZE;
+
+				Header header = {};
+				memcpy(&header, base, sizeof(header));
+
+				uncounted(header.stage, header.size);
+
+				if (aligned) _mm_free(base);
+				else		 free(base);
+			}
+
+			void AllocationTracker::counted(AllocationStage stage, size_t size)
+			{
+				State& current = state();
+
+				unsigned long long live = current.liveBytes[stage].fetch_add(size, std::memory_order_relaxed) + size;
+
+				Counters* counters[2] = { &current.total[stage], &current.frame[stage] };
+
+				for (size_t i = 0; i < 2; i++)
+				{
+					counters[i]->allocations.fetch_add(1,	 std::memory_order_relaxed);
+					counters[i]->bytes		.fetch_add(size, std::memory_order_relaxed);
+
+					raise(&counters[i]->peakBytes, live);
+				}
+			}
+
+			void AllocationTracker::uncounted(AllocationStage stage, size_t size)
+			{
+				State& current = state();
+
+				current.liveBytes[stage].fetch_sub(size, std::memory_order_relaxed);
+
+				current.total[stage].frees.fetch_add(1, std::memory_order_relaxed);
+				current.frame[stage].frees.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void AllocationTracker::raise(std::atomic<unsigned long long>* peak, unsigned long long value)
+			{
+				unsigned long long old = peak->load(std::memory_order_relaxed);
+
+				while (value > old && !peak->compare_exchange_weak(old, value, std::memory_order_relaxed));
+			}
+
+			AllocationStats AllocationTracker::read(const Counters& counters)
+			{
+				AllocationStats stats = { counters.allocations.load(std::memory_order_relaxed),
+										  counters.frees	  .load(std::memory_order_relaxed),
+										  counters.bytes	  .load(std::memory_order_relaxed),
+										  counters.peakBytes  .load(std::memory_order_relaxed) };
+
+				return stats;
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Allocation functions
+		//----------------------------------------------------------------------------
+
+			void* trackedCalloc(size_t count, size_t size)
+			{
+				return AllocationTracker::allocate(count * size, 0, true);
+			}
+
+			void* trackedRealloc(void* block, size_t size)
+			{
+				return AllocationTracker::reallocate(block, size);
+			}
+
+			void trackedFree(void* block)
+			{
+				AllocationTracker::release(block, false);
+			}
+
+			void* trackedAlignedMalloc(size_t size, size_t alignment)
+			{
+				return AllocationTracker::allocate(size, alignment, false);
+			}
+
+			void trackedAlignedFree(void* block)
+			{
+				AllocationTracker::release(block, true);
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+	#else
+
+		#define ALLOCATION_STAGE(stage)
+
+		#define CURRENT_ALLOCATION_STAGE() ALLOCATION_OTHER
+
+		//----------------------------------------------------------------------------
+		//{ Allocation functions
+		//----------------------------------------------------------------------------
+
+			inline void* trackedCalloc(size_t count, size_t size)
+			{
+				return calloc(count, size);
+			}
+
+			inline void* trackedRealloc(void* block, size_t size)
+			{
+				return realloc(block, size);
+			}
+
+			inline void trackedFree(void* block)
+			{
+				free(block);
+			}
+
+			inline void* trackedAlignedMalloc(size_t size, size_t alignment)
+			{
+				return _mm_malloc(size, alignment);
+			}
+
+			inline void trackedAlignedFree(void* block)
+			{
+				_mm_free(block);
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+	#endif
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,315 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <algorithm>
+	#include <atomic>
+	#include <mutex>
+	#include <string>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Asset cache
+//----------------------------------------------------------------------------
+
+	/*
+		Directory of processed assets under 64 bit keys, so what is derived
+		from a source file is computed once per content, not at every start:
+
+			AssetCacheSettings settings = { "cache", 4ull << 30 };
+			AssetCache cache(settings);
+
+			Model model = Model("model.obj", &threadPool, &cache);
+
+		Keys are hashes of the source bytes chained with the options the asset
+		was processed with, hash() takes the previous hash as its seed.
+
+		Entries are written to a temporary file and renamed into place, so
+		processes sharing the directory never open a partial one. Opening an
+		entry marks it used, and while the entries take more than maxBytes the
+		least recently used ones are removed, skipping those mapped somewhere.
+	*/
+	struct AssetCacheSettings
+	{
+		const char* directory;
+
+		unsigned long long maxBytes;
+	};
+
+	class AssetCache
+	{
+		public:
+
+			static const unsigned long long HASH_SEED = 0xCBF29CE484222325ull;
+
+			// Constructor && destructor:
+
+				// Creates the directory if there is none and evicts down to the size limit:
+				AssetCache(const AssetCacheSettings& settings);
+
+			// Getters:
+
+				const char* getDirectory() const;
+				unsigned long long getMaxBytes() const;
+
+				// Bytes in entries after the last eviction:
+				unsigned long long getSize() const;
+
+			// Functions:
+
+				// Not cryptographic, keys only have to differ when sources or options do:
+				static unsigned long long hash(const void* data, size_t size, unsigned long long seed = HASH_SEED);
+
+				// The entry mapped read-only, NULL if there is none, the caller deletes it:
+				MappedFile* open(unsigned long long key);
+
+				// write(FILE*) fills a new entry, which is kept only if it returns true:
+				template <typename Writer>
+				bool store(unsigned long long key, const Writer& write);
+
+				void evict();
+
+		private:
+
+			std::string directory_;
+			unsigned long long maxBytes_;
+
+			// Guarded by mutex_:
+			unsigned long long size_;
+
+			mutable std::mutex mutex_;
+
+			std::atomic<unsigned int> temporaryCount_;
+
+			std::string entryPath(unsigned long long key) const;
+
+			AssetCache(const AssetCache&);
+			AssetCache& operator=(const AssetCache&);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		AssetCache::AssetCache(const AssetCacheSettings& settings) :
+			directory_		(),
+			maxBytes_		(settings.maxBytes),
+			size_			(0),
+			mutex_			(),
+			temporaryCount_ (0)
+		{
+			assert(settings.directory);
+
+			directory_ = settings.directory;
+
+			if (!directory_.empty() && directory_.find_last_of("/\\") != directory_.size() - 1) directory_ += '\\';
+
+			if (!CreateDirectoryA(directory_.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+			{
+				printf("AssetCache::AssetCache(): cannot create %s, error %u\n", directory_.c_str(), (unsigned int) GetLastError());
+			}
+
+			evict();
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		const char* AssetCache::getDirectory() const
+		{
+			return directory_.c_str();
+		}
+
+		unsigned long long AssetCache::getMaxBytes() const
+		{
+			return maxBytes_;
+		}
+
+		unsigned long long AssetCache::getSize() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			return size_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		// FNV-1a a word at a time, with a final mix so every input bit reaches every output bit:
+
+			unsigned long long AssetCache::hash(const void* data, size_t size, unsigned long long seed /*= HASH_SEED*/)
+			{
+				assert(data || size == 0);
+
+				const unsigned long long PRIME = 0x100000001B3ull;
+
+				const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+				unsigned long long result = seed ^ size;
+
+				size_t i = 0;
+
+				for (; i + 8 <= size; i += 8)
+				{
+					unsigned long long word = 0;
+					memcpy(&word, bytes + i, sizeof(word));
+
+					result = (result ^ word) * PRIME;
+				}
+
+				for (; i < size; i++) result = (result ^ bytes[i]) * PRIME;
+
+				result ^= result >> 33;
+				result *= 0xFF51AFD7ED558CCDull;
+				result ^= result >> 33;
+				result *= 0xC4CEB9FE1A85EC53ull;
+				result ^= result >> 33;
+
+				return result;
+			}
+
+		MappedFile* AssetCache::open(unsigned long long key)
+		{
+			std::string path = entryPath(key);
+
+			// Used now, which is what eviction orders entries by:
+
+				HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+										  NULL, OPEN_EXISTING, 0, NULL);
+
+				if (file == INVALID_HANDLE_VALUE) return NULL;
+
+				FILETIME now = {};
+				GetSystemTimeAsFileTime(&now);
+
+				SetFileTime(file, NULL, NULL, &now);
+				CloseHandle(file);
+
+			MappedFile* entry = new MappedFile(path.c_str());
+
+			if (!entry->ok() || entry->getSize() == 0)
+			{
+				delete entry;
+				return NULL;
+			}
+
+			return entry;
+		}
+
+		template <typename Writer>
+		bool AssetCache::store(unsigned long long key, const Writer& write)
+		{
+			std::string path = entryPath(key);
+
+			char suffix[64] = "";
+			snprintf(suffix, sizeof(suffix), ".%u-%u.tmp", (unsigned int) GetCurrentProcessId(), temporaryCount_.fetch_add(1));
+
+			std::string temporaryPath = path + suffix;
+
+			FILE* file = fopen(temporaryPath.c_str(), "wb");
+
+			if (!file)
+			{
+				printf("AssetCache::store(): cannot create %s\n", temporaryPath.c_str());
+				return false;
+			}
+
+			bool written = write(file);
+
+			if (fclose(file) != 0) written = false;
+
+			// Another process may have stored the same entry and have it mapped, then its entry stays:
+
+				if (!written || !MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+				{
+					DeleteFileA(temporaryPath.c_str());
+					return false;
+				}
+
+			evict();
+
+			return true;
+		}
+
+		void AssetCache::evict()
+		{
+			struct Entry
+			{
+				std::string name;
+
+				unsigned long long size;
+				unsigned long long used;
+
+				static bool earlier(const Entry& entry0, const Entry& entry1)
+				{
+					return entry0.used < entry1.used;
+				}
+			};
+
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			// Entries with their sizes and times used:
+
+				std::vector<Entry> entries;
+				unsigned long long size = 0;
+
+				WIN32_FIND_DATAA found = {};
+				HANDLE search = FindFirstFileA((directory_ + "*.asset").c_str(), &found);
+
+				if (search != INVALID_HANDLE_VALUE)
+				{
+					do
+					{
+						if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+
+						Entry entry = { found.cFileName,
+										((unsigned long long) found.nFileSizeHigh << 32) | found.nFileSizeLow,
+										((unsigned long long) found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime };
+
+						entries.push_back(entry);
+						size += entry.size;
+					}
+					while (FindNextFileA(search, &found));
+
+					FindClose(search);
+				}
+
+			// The oldest first until the rest fits:
+
+				std::sort(entries.begin(), entries.end(), Entry::earlier);
+
+				for (size_t i = 0; i < entries.size() && size > maxBytes_; i++)
+				{
+					if (DeleteFileA((directory_ + entries[i].name).c_str())) size -= entries[i].size;
+				}
+
+			size_ = size;
+		}
+
+		std::string AssetCache::entryPath(unsigned long long key) const
+		{
+			char name[32] = "";
+			snprintf(name, sizeof(name), "%016llx.asset", key);
+
+			return directory_ + name;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
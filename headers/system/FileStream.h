@@ -0,0 +1,205 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ File stream
+//----------------------------------------------------------------------------
+
+	/*
+		Sequential reader with a fixed buffer, so files of any size are read in
+		bounded memory. Lines and binary data can be mixed, the buffer only
+		grows to hold a line longer than it.
+	*/
+	class FileStream
+	{
+		public:
+
+			// Constructor && destructor:
+
+				FileStream(const char* filename, size_t bufferSize = 1 << 20);
+				~FileStream();
+
+			// Getters:
+
+				// Line number of the last line read:
+				size_t getLine() const;
+
+				// Size of the whole file:
+				unsigned long long getSize() const;
+
+			// Functions:
+
+				bool ok() const;
+
+				// Next line without its end, valid until the next read, false at the end of the file:
+				bool readLine(const char** begin, const char** end);
+
+				// Exactly size bytes, false if the file ends before:
+				bool read(void* destination, size_t size);
+
+		private:
+
+			HANDLE file_;
+
+			char* buffer_;
+			size_t capacity_;
+
+			// Unread bytes are [begin_, end_):
+			size_t begin_;
+			size_t end_;
+
+			bool endOfFile_;
+			size_t line_;
+
+			// Reads until at least size bytes are unread or the file ends:
+			bool fill(size_t size);
+
+			FileStream(const FileStream&);
+			FileStream& operator=(const FileStream&);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		FileStream::FileStream(const char* filename, size_t bufferSize /*= 1 << 20*/) :
+			file_	   (INVALID_HANDLE_VALUE),
+			buffer_	   (NULL),
+			capacity_  (bufferSize),
+			begin_	   (0),
+			end_	   (0),
+			endOfFile_ (false),
+			line_	   (0)
+		{
+			assert(filename);
+			assert(bufferSize > 0);
+
+			file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+			buffer_ = (char*) calloc(capacity_, sizeof(*buffer_));
+			assert(buffer_);
+		}
+
+		FileStream::~FileStream()
+		{
+			if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+
+			free(buffer_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		size_t FileStream::getLine() const
+		{
+			return line_;
+		}
+
+		unsigned long long FileStream::getSize() const
+		{
+			LARGE_INTEGER size = {};
+			if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) return 0;
+
+			return static_cast<unsigned long long>(size.QuadPart);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool FileStream::ok() const
+		{
+			return file_ != INVALID_HANDLE_VALUE && buffer_ != NULL && begin_ <= end_ && end_ <= capacity_;
+		}
+
+		bool FileStream::fill(size_t size)
+		{
+			assert(ok());
+
+			if (end_ - begin_ >= size) return true;
+
+			// Moving unread bytes to the front, growing only for requests larger than the buffer:
+
+				memmove(buffer_, buffer_ + begin_, end_ - begin_);
+
+				end_  -= begin_;
+				begin_ = 0;
+
+				if (size > capacity_)
+				{
+					capacity_ = std::max(size, 2 * capacity_);
+
+					buffer_ = (char*) realloc(buffer_, capacity_);
+					assert(buffer_);
+				}
+
+			while (end_ < size && !endOfFile_)
+			{
+				DWORD bytesRead = 0;
+				DWORD toRead = static_cast<DWORD>(std::min<size_t>(capacity_ - end_, 1u << 30));
+
+				if (!ReadFile(file_, buffer_ + end_, toRead, &bytesRead, NULL) || bytesRead == 0) endOfFile_ = true;
+
+				end_ += bytesRead;
+			}
+
+			return end_ >= size;
+		}
+
+		bool FileStream::readLine(const char** begin, const char** end)
+		{
+			assert(begin);
+			assert(end);
+
+			if (file_ == INVALID_HANDLE_VALUE) return false;
+
+			size_t searched = 0;
+
+			for (;;)
+			{
+				const char* unread = buffer_ + begin_;
+				const char* lineEnd = static_cast<const char*>(memchr(unread + searched, '\n', end_ - begin_ - searched));
+
+				if (lineEnd || (endOfFile_ && end_ > begin_))
+				{
+					if (lineEnd == NULL) lineEnd = buffer_ + end_;
+
+					*begin = unread;
+					*end   = lineEnd;
+
+					begin_ = std::min<size_t>(lineEnd + 1 - buffer_, end_);
+					line_++;
+
+					return true;
+				}
+
+				if (endOfFile_) return false;
+
+				searched = end_ - begin_;
+				fill(end_ - begin_ + (end_ - begin_ == capacity_ ? capacity_ : 1));
+			}
+		}
+
+		bool FileStream::read(void* destination, size_t size)
+		{
+			assert(destination || size == 0);
+
+			if (file_ == INVALID_HANDLE_VALUE || !fill(size)) return false;
+
+			memcpy(destination, buffer_ + begin_, size);
+			begin_ += size;
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
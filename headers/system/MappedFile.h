@@ -0,0 +1,119 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Mapped file
+//----------------------------------------------------------------------------
+
+	/*
+		Read-only view of a whole file. Empty files have no view, ok() is false
+		when the file could not be opened or mapped.
+	*/
+	class MappedFile
+	{
+		public:
+
+			// Constructor && destructor:
+
+				MappedFile(const char* filename);
+				~MappedFile();
+
+			// Getters:
+
+				const char* getData() const;
+				size_t getSize() const;
+
+			// Functions:
+
+				bool ok() const;
+
+		private:
+
+			HANDLE file_;
+			HANDLE mapping_;
+
+			const char* data_;
+			size_t size_;
+
+			MappedFile(const MappedFile&);
+			MappedFile& operator=(const MappedFile&);
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		MappedFile::MappedFile(const char* filename) :
+			file_	 (INVALID_HANDLE_VALUE),
+			mapping_ (NULL),
+			data_	 (NULL),
+			size_	 (0)
+		{
+			assert(filename);
+
+			file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file_ == INVALID_HANDLE_VALUE) return;
+
+			LARGE_INTEGER size = {};
+
+			if (!GetFileSizeEx(file_, &size))
+			{
+				CloseHandle(file_);
+				file_ = INVALID_HANDLE_VALUE;
+
+				return;
+			}
+
+			size_ = static_cast<size_t>(size.QuadPart);
+
+			// Mapping an empty file fails, so it is only done for non-empty ones:
+
+				if (size_ == 0) return;
+
+				mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (mapping_ == NULL) return;
+
+				data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		}
+
+		MappedFile::~MappedFile()
+		{
+			if (data_) UnmapViewOfFile(data_);
+
+			if (mapping_)					 CloseHandle(mapping_);
+			if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		const char* MappedFile::getData() const
+		{
+			return data_;
+		}
+
+		size_t MappedFile::getSize() const
+		{
+			return size_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool MappedFile::ok() const
+		{
+			return file_ != INVALID_HANDLE_VALUE && (size_ == 0 || data_ != NULL);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
@@ -0,0 +1,249 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Text reader
+//----------------------------------------------------------------------------
+
+	/*
+		Cursor over a text buffer that parses numbers without the C library,
+		so the decimal point is always '.' whatever the locale, and counts lines
+		for error messages. Readers skip blanks before the value but never cross
+		a line end, nextLine() does that.
+	*/
+	class TextReader
+	{
+		public:
+
+			// Constructor:
+
+				TextReader(const char* begin, const char* end, size_t line = 1);
+
+			// Getters:
+
+				const char* getPosition() const;
+				size_t getLine() const;
+
+			// Functions:
+
+				bool atEnd() const;
+
+				// True at a line end, the end of the text or a '#' comment:
+				bool atLineEnd();
+
+				// Skips the rest of the line including its end:
+				void nextLine();
+
+				// Reading values, false (with the position unchanged) if there is none:
+
+					bool readDouble(double* value);
+
+					// Base 16 accepts an optional 0x prefix:
+					bool readUnsigned(unsigned long long* value, unsigned int base = 10);
+
+					// Characters up to the next blank, not null-terminated:
+					bool readWord(const char** word, size_t* length);
+
+		private:
+
+			const char* position_;
+			const char* end_;
+
+			size_t line_;
+
+			void skipBlanks();
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		TextReader::TextReader(const char* begin, const char* end, size_t line /*= 1*/) :
+			position_ (begin),
+			end_	  (end),
+			line_	  (line)
+		{
+			assert(begin <= end);
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		const char* TextReader::getPosition() const
+		{
+			return position_;
+		}
+
+		size_t TextReader::getLine() const
+		{
+			return line_;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool TextReader::atEnd() const
+		{
+			return position_ == end_;
+		}
+
+		bool TextReader::atLineEnd()
+		{
+			skipBlanks();
+
+			return position_ == end_ || *position_ == '\n' || *position_ == '#';
+		}
+
+		void TextReader::nextLine()
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(position_, '\n', end_ - position_));
+
+			if (lineEnd == NULL) position_ = end_;
+			else
+			{
+				position_ = lineEnd + 1;
+				line_++;
+			}
+		}
+
+		void TextReader::skipBlanks()
+		{
+			while (position_ != end_ && (*position_ == ' ' || *position_ == '\t' || *position_ == '\r')) position_++;
+		}
+
+		bool TextReader::readDouble(double* value)
+		{
+			assert(value);
+
+			skipBlanks();
+
+			const char* current = position_;
+
+			bool negative = false;
+			if (current != end_ && (*current == '-' || *current == '+')) negative = *current++ == '-';
+
+			// Up to 19 significant digits fit the mantissa, the rest only move the exponent:
+
+				unsigned long long mantissa = 0;
+				int exponent = 0, digits = 0, significant = 0;
+
+				for (; current != end_ && *current >= '0' && *current <= '9'; current++, digits++)
+				{
+					if (significant < 19) { mantissa = mantissa * 10 + (*current - '0'); if (mantissa) significant++; }
+					else exponent++;
+				}
+
+				if (current != end_ && *current == '.')
+				{
+					for (current++; current != end_ && *current >= '0' && *current <= '9'; current++, digits++)
+					{
+						if (significant < 19) { mantissa = mantissa * 10 + (*current - '0'); if (mantissa) significant++; exponent--; }
+					}
+				}
+
+				if (digits == 0) return false;
+
+			if (current != end_ && (*current == 'e' || *current == 'E'))
+			{
+				const char* exponentStart = current++;
+
+				bool negativeExponent = false;
+				if (current != end_ && (*current == '-' || *current == '+')) negativeExponent = *current++ == '-';
+
+				if (current == end_ || *current < '0' || *current > '9') current = exponentStart;
+				else
+				{
+					int written = 0;
+					for (; current != end_ && *current >= '0' && *current <= '9'; current++) written = std::min(written * 10 + (*current - '0'), 100000);
+
+					exponent += negativeExponent ? -written : written;
+				}
+			}
+
+			// Exact when both the mantissa and the power of ten are exact doubles:
+
+				static const double POWERS[23] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+												   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+				double result = 0;
+
+				if (mantissa == 0) result = 0;
+				else if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+				{
+					result = static_cast<double>(mantissa);
+					result = exponent < 0 ? result / POWERS[-exponent] : result * POWERS[exponent];
+				}
+				else result = static_cast<double>(static_cast<long double>(mantissa) * powl(10, exponent));
+
+			*value = negative ? -result : result;
+			position_ = current;
+
+			return true;
+		}
+
+		bool TextReader::readUnsigned(unsigned long long* value, unsigned int base /*= 10*/)
+		{
+			assert(value);
+			assert(base == 10 || base == 16);
+
+			skipBlanks();
+
+			const char* current = position_;
+
+			if (base == 16 && end_ - current > 2 && current[0] == '0' && (current[1] == 'x' || current[1] == 'X')) current += 2;
+
+			unsigned long long result = 0;
+			const char* digitsStart = current;
+
+			for (; current != end_; current++)
+			{
+				unsigned int digit = 0;
+
+				if		(*current >= '0' && *current <= '9')				 digit = *current - '0';
+				else if (base == 16 && *current >= 'a' && *current <= 'f') digit = *current - 'a' + 10;
+				else if (base == 16 && *current >= 'A' && *current <= 'F') digit = *current - 'A' + 10;
+				else break;
+
+				result = result * base + digit;
+			}
+
+			if (current == digitsStart) return false;
+
+			*value = result;
+			position_ = current;
+
+			return true;
+		}
+
+		bool TextReader::readWord(const char** word, size_t* length)
+		{
+			assert(word);
+			assert(length);
+
+			skipBlanks();
+
+			const char* current = position_;
+			while (current != end_ && *current != ' ' && *current != '\t' && *current != '\r' && *current != '\n') current++;
+
+			if (current == position_) return false;
+
+			*word	= position_;
+			*length = current - position_;
+
+			position_ = current;
+
+			return true;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
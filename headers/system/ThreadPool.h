@@ -0,0 +1,694 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <atomic>
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+	#include <deque>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Job
+//----------------------------------------------------------------------------
+
+	// Number of submitted jobs which haven't finished yet:
+	typedef std::atomic<unsigned int> JobCounter;
+
+	// Storage of a job belongs to the submitter and must outlive the job:
+	struct Job
+	{
+		void (*function)(void* argument);
+		void* argument;
+
+		JobCounter* counter;
+
+		// Of the submitting thread, set by submit() and restored around the job:
+		AllocationStage stage;
+	};
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Job deque
+//----------------------------------------------------------------------------
+
+	/*
+		Lock-free Chase-Lev work-stealing deque of a fixed capacity: its owner pushes
+		and pops at the bottom, any other thread steals from the top.
+	*/
+	class JobDeque
+	{
+		public:
+
+			static const long long CAPACITY = 1 << 12;
+
+			// Constructor:
+
+				JobDeque();
+
+			// Functions:
+
+				// Owner only, false if the deque is full:
+				bool push(Job* job);
+				Job* pop();
+
+				Job* steal();
+
+		private:
+
+			std::atomic<long long> top_;
+			std::atomic<long long> bottom_;
+
+			std::atomic<Job*> jobs_[CAPACITY];
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor
+	//----------------------------------------------------------------------------
+
+		JobDeque::JobDeque() :
+			top_	(0),
+			bottom_ (0)
+		{
+			for (long long i = 0; i < CAPACITY; i++)
+			{
+				jobs_[i].store(NULL, std::memory_order_relaxed);
+			}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		bool JobDeque::push(Job* job)
+		{
+			long long bottom = bottom_.load(std::memory_order_relaxed);
+			long long top	 = top_.load(std::memory_order_acquire);
+
+			if (bottom - top >= CAPACITY) return false;
+
+			jobs_[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom_.store(bottom + 1, std::memory_order_relaxed);
+
+			return true;
+		}
+
+		Job* JobDeque::pop()
+		{
+			long long bottom = bottom_.load(std::memory_order_relaxed) - 1;
+			bottom_.store(bottom, std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			long long top = top_.load(std::memory_order_relaxed);
+
+			if (top > bottom)
+			{
+				bottom_.store(bottom + 1, std::memory_order_relaxed);
+				return NULL;
+			}
+
+			Job* job = jobs_[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+			// The last job is raced for with the thieves:
+
+				if (top == bottom)
+				{
+					if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = NULL;
+
+					bottom_.store(bottom + 1, std::memory_order_relaxed);
+				}
+
+			return job;
+		}
+
+		Job* JobDeque::steal()
+		{
+			long long top = top_.load(std::memory_order_acquire);
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			long long bottom = bottom_.load(std::memory_order_acquire);
+
+			if (top >= bottom) return NULL;
+
+			Job* job = jobs_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+			if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return NULL;
+
+			return job;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Thread pool
+//----------------------------------------------------------------------------
+
+	struct ThreadPoolSettings
+	{
+		// Threads running jobs, the one calling wait() included (0 means one per physical core):
+		unsigned int threadCount;
+
+		// Pins every worker to its own physical core:
+		bool pinThreads;
+
+		// Empty job searches before an idle worker or a thread in wait() goes to sleep (0 sleeps at once):
+		unsigned int spinCount;
+	};
+
+	/*
+		Work-stealing job system. Jobs submitted by a worker go to its own deque,
+		jobs submitted by any other thread go to a shared queue, and idle workers
+		steal from the others:
+
+			ThreadPoolSettings settings = { 0, false, 1000 };
+			ThreadPool pool(settings);
+
+			pool.parallelFor(0, rowCount, 16, [&](size_t begin, size_t end) { ... });
+
+		wait() doesn't block while there are jobs to run, it runs them,
+		so jobs may fork and join jobs of their own. Only when there are
+		none left it spins, then sleeps until its jobs are done.
+	*/
+	class ThreadPool
+	{
+		public:
+
+			// Constructor && destructor:
+
+				ThreadPool(const ThreadPoolSettings& settings);
+				~ThreadPool();
+
+			// Getters:
+
+				unsigned int getThreadCount() const;
+
+				static unsigned int physicalCoreCount();
+
+			// Functions:
+
+				void submit(Job* job);
+				void wait(JobCounter* counter);
+
+				// Calls function(chunkBegin, chunkEnd) over [begin, end) split into grain sized chunks (0 picks the grain):
+				template <typename Function>
+				void parallelFor(size_t begin, size_t end, size_t grain, const Function& function);
+
+				// Runs both functions, possibly in parallel, and returns when both are done:
+				template <typename FirstFunction, typename SecondFunction>
+				void invoke(const FirstFunction& first, const SecondFunction& second);
+
+		private:
+
+			struct Worker
+			{
+				JobDeque deque;
+
+				std::thread thread;
+			};
+
+			template <typename Function>
+			struct ParallelForState
+			{
+				const Function* function;
+
+				size_t begin, end, grain;
+				std::atomic<size_t> nextChunk;
+
+				static void run(void* argument);
+			};
+
+			template <typename Function>
+			static void runFunction(void* argument);
+
+			// Pool and worker index of the calling thread:
+			struct ThreadRecord
+			{
+				const ThreadPool* pool;
+				int worker;
+			};
+
+			static ThreadRecord& threadRecord();
+
+			void workerLoop(unsigned int index, unsigned long long affinityMask);
+
+			// Worker index of the calling thread in this pool, -1 for other threads:
+			int currentWorker() const;
+
+			Job* findJob(int worker);
+			void execute(Job* job);
+
+			static std::vector<unsigned long long> physicalCoreMasks();
+
+			unsigned int spinCount_;
+
+			std::vector<Worker*> workers_;
+
+			// Jobs submitted from outside of the pool:
+
+				std::deque<Job*> sharedJobs_;
+				std::mutex sharedMutex_;
+
+			// Sleeping:
+
+				std::atomic<long long> pendingJobs_;
+				std::atomic<unsigned int> sleepingThreads_;
+
+				std::mutex sleepMutex_;
+				std::condition_variable wakeUp_;
+
+				std::atomic<bool> stopping_;
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Constructor && destructor
+	//----------------------------------------------------------------------------
+
+		ThreadPool::ThreadPool(const ThreadPoolSettings& settings) :
+			spinCount_		 (settings.spinCount),
+			workers_		 (),
+			sharedJobs_		 (),
+			sharedMutex_	 (),
+			pendingJobs_	 (0),
+			sleepingThreads_ (0),
+			sleepMutex_		 (),
+			wakeUp_			 (),
+			stopping_		 (false)
+		{
+			unsigned int threadCount = settings.threadCount ? settings.threadCount : physicalCoreCount();
+
+			std::vector<unsigned long long> coreMasks;
+			if (settings.pinThreads) coreMasks = physicalCoreMasks();
+
+			// The waiting thread is a worker too, so one thread less is started:
+
+				for (unsigned int i = 0; i + 1 < threadCount; i++)
+				{
+					workers_.push_back(new Worker());
+				}
+
+				for (unsigned int i = 0; i < workers_.size(); i++)
+				{
+					unsigned long long mask = coreMasks.empty() ? 0 : coreMasks[(i + 1) % coreMasks.size()];
+
+					workers_[i]->thread = std::thread(&ThreadPool::workerLoop, this, i, mask);
+				}
+		}
+
+		ThreadPool::~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex_);
+				stopping_.store(true);
+			}
+
+			wakeUp_.notify_all();
+
+			for (size_t i = 0; i < workers_.size(); i++)
+			{
+				workers_[i]->thread.join();
+				delete workers_[i];
+			}
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Getters
+	//----------------------------------------------------------------------------
+
+		unsigned int ThreadPool::getThreadCount() const
+		{
+			return static_cast<unsigned int>(workers_.size()) + 1;
+		}
+
+		std::vector<unsigned long long> ThreadPool::physicalCoreMasks()
+		{
+			std::vector<unsigned long long> masks;
+
+			// Looked up at run time, it's missing from the headers for WINVER < 0x0501:
+
+				typedef BOOL (WINAPI* GetInformationFunction)(PSYSTEM_LOGICAL_PROCESSOR_INFORMATION, PDWORD);
+
+				GetInformationFunction getInformation = (GetInformationFunction) GetProcAddress(GetModuleHandleA("kernel32"), "GetLogicalProcessorInformation");
+				if (getInformation == NULL) return masks;
+
+			DWORD length = 0;
+			getInformation(NULL, &length);
+
+			std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> information = std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION>(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION) + 1);
+			length = static_cast<DWORD>(information.size() * sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+			if (!getInformation(information.data(), &length)) return masks;
+
+			for (size_t i = 0; i < length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION); i++)
+			{
+				if (information[i].Relationship == RelationProcessorCore) masks.push_back(information[i].ProcessorMask);
+			}
+
+			return masks;
+		}
+
+		unsigned int ThreadPool::physicalCoreCount()
+		{
+			size_t cores = physicalCoreMasks().size();
+			if (cores == 0) cores = std::thread::hardware_concurrency();
+
+			return cores ? static_cast<unsigned int>(cores) : 1;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Functions
+	//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Submitting && waiting
+		//----------------------------------------------------------------------------
+
+			void ThreadPool::submit(Job* job)
+			{
+				assert(job);
+				assert(job->function);
+				assert(job->counter);
+
+				job->counter->fetch_add(1, std::memory_order_relaxed);
+				job->stage = CURRENT_ALLOCATION_STAGE();
+
+				// Without workers, or with a full deque, the job is run at once:
+
+					int worker = currentWorker();
+
+					if (workers_.empty() || (worker >= 0 && !workers_[worker]->deque.push(job)))
+					{
+						execute(job);
+						return;
+					}
+
+					if (worker < 0)
+					{
+						std::lock_guard<std::mutex> lock(sharedMutex_);
+						sharedJobs_.push_back(job);
+					}
+
+				// Waking a sleeper up:
+
+					pendingJobs_.fetch_add(1, std::memory_order_seq_cst);
+
+					if (sleepingThreads_.load(std::memory_order_seq_cst) > 0)
+					{
+						std::lock_guard<std::mutex> lock(sleepMutex_);
+						wakeUp_.notify_one();
+					}
+			}
+
+			void ThreadPool::wait(JobCounter* counter)
+			{
+				assert(counter);
+
+				// Helping with other jobs counts too, they show up nested:
+				TRACE_SCOPE("ThreadPool::wait");
+
+				int worker = currentWorker();
+
+				unsigned int spins = 0;
+
+				while (counter->load(std::memory_order_acquire) > 0)
+				{
+					Job* job = findJob(worker);
+
+					if (job)
+					{
+						execute(job);
+						spins = 0;
+
+						continue;
+					}
+
+					if (spins < spinCount_)
+					{
+						spins++;
+						YieldProcessor();
+
+						continue;
+					}
+
+					// Sleeping until the counter runs out or something is submitted:
+
+						std::unique_lock<std::mutex> lock(sleepMutex_);
+
+						sleepingThreads_.fetch_add(1, std::memory_order_seq_cst);
+
+						wakeUp_.wait(lock, [this, counter]()
+						{
+							return counter->load(std::memory_order_seq_cst) == 0 || pendingJobs_.load(std::memory_order_seq_cst) > 0 || stopping_.load();
+						});
+
+						sleepingThreads_.fetch_sub(1, std::memory_order_seq_cst);
+
+					spins = 0;
+				}
+			}
+
+			Job* ThreadPool::findJob(int worker)
+			{
+				Job* job = NULL;
+
+				// Own deque first, then the shared queue, then the others' deques:
+
+					if (worker >= 0) job = workers_[worker]->deque.pop();
+
+					if (job == NULL && pendingJobs_.load(std::memory_order_relaxed) > 0)
+					{
+						std::lock_guard<std::mutex> lock(sharedMutex_);
+
+						if (!sharedJobs_.empty())
+						{
+							job = sharedJobs_.front();
+							sharedJobs_.pop_front();
+						}
+					}
+
+					for (size_t i = 1; job == NULL && i <= workers_.size(); i++)
+					{
+						size_t victim = (worker + i) % workers_.size();
+
+						if (static_cast<int>(victim) != worker) job = workers_[victim]->deque.steal();
+					}
+
+				if (job) pendingJobs_.fetch_sub(1, std::memory_order_relaxed);
+
+				return job;
+			}
+
+			void ThreadPool::execute(Job* job)
+			{
+				TRACE_SCOPE("ThreadPool::execute");
+
+				{
+					ALLOCATION_STAGE(job->stage);
+
+					job->function(job->argument);
+				}
+
+				// The last job of a counter wakes whoever sleeps in wait() on it:
+
+					if (job->counter->fetch_sub(1, std::memory_order_seq_cst) == 1 && sleepingThreads_.load(std::memory_order_seq_cst) > 0)
+					{
+						std::lock_guard<std::mutex> lock(sleepMutex_);
+						wakeUp_.notify_all();
+					}
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Workers
+		//----------------------------------------------------------------------------
+
+			ThreadPool::ThreadRecord& ThreadPool::threadRecord()
+			{
+				static thread_local ThreadRecord record = { NULL, -1 };
+
+				return record;
+			}
+
+			int ThreadPool::currentWorker() const
+			{
+				const ThreadRecord& record = threadRecord();
+
+				return (record.pool == this) ? record.worker : -1;
+			}
+
+			void ThreadPool::workerLoop(unsigned int index, unsigned long long affinityMask)
+			{
+				ThreadRecord record = { this, static_cast<int>(index) };
+				threadRecord() = record;
+
+				if (affinityMask) SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(affinityMask));
+
+				unsigned int spins = 0;
+
+				while (!stopping_.load(std::memory_order_relaxed))
+				{
+					Job* job = findJob(static_cast<int>(index));
+
+					if (job)
+					{
+						execute(job);
+						spins = 0;
+
+						continue;
+					}
+
+					if (spins < spinCount_)
+					{
+						spins++;
+						YieldProcessor();
+
+						continue;
+					}
+
+					// Sleeping until something is submitted:
+
+						std::unique_lock<std::mutex> lock(sleepMutex_);
+
+						sleepingThreads_.fetch_add(1, std::memory_order_seq_cst);
+
+						wakeUp_.wait(lock, [this]()
+						{
+							return pendingJobs_.load(std::memory_order_seq_cst) > 0 || stopping_.load();
+						});
+
+						sleepingThreads_.fetch_sub(1, std::memory_order_seq_cst);
+
+					spins = 0;
+				}
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Fork && join helpers
+		//----------------------------------------------------------------------------
+
+			template <typename Function>
+			void ThreadPool::ParallelForState<Function>::run(void* argument)
+			{
+				ParallelForState* state = static_cast<ParallelForState*>(argument);
+
+				size_t chunkCount = (state->end - state->begin + state->grain - 1) / state->grain;
+
+				for (size_t chunk = state->nextChunk++; chunk < chunkCount; chunk = state->nextChunk++)
+				{
+					size_t chunkBegin = state->begin + chunk * state->grain;
+
+					(*state->function)(chunkBegin, std::min(chunkBegin + state->grain, state->end));
+				}
+			}
+
+			template <typename Function>
+			void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const Function& function)
+			{
+				if (begin >= end) return;
+
+				if (grain == 0) grain = std::max<size_t>((end - begin) / (4 * getThreadCount()), 1);
+
+				ParallelForState<Function> state;
+				state.function = &function;
+				state.begin	   = begin;
+				state.end	   = end;
+				state.grain	   = grain;
+				state.nextChunk.store(0);
+
+				// Chunks are claimed dynamically, so a job per thread is enough:
+
+					size_t chunkCount = (end - begin + grain - 1) / grain;
+					size_t jobCount = std::min<size_t>(chunkCount, getThreadCount()) - 1;
+
+					JobCounter counter(0);
+					std::vector<Job> jobs = std::vector<Job>(jobCount);
+
+					for (size_t i = 0; i < jobCount; i++)
+					{
+						Job job = { &ParallelForState<Function>::run, &state, &counter };
+						jobs[i] = job;
+
+						submit(&jobs[i]);
+					}
+
+				ParallelForState<Function>::run(&state);
+
+				wait(&counter);
+			}
+
+			template <typename Function>
+			void ThreadPool::runFunction(void* argument)
+			{
+				(*static_cast<const Function*>(argument))();
+			}
+
+			template <typename FirstFunction, typename SecondFunction>
+			void ThreadPool::invoke(const FirstFunction& first, const SecondFunction& second)
+			{
+				JobCounter counter(0);
+
+				Job job = { &runFunction<SecondFunction>, const_cast<SecondFunction*>(&second), &counter };
+				submit(&job);
+
+				first();
+
+				wait(&counter);
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Thread pool functions
+//----------------------------------------------------------------------------
+
+	// ThreadPool::parallelFor() running on the calling thread when there is no pool:
+
+		template <typename Function>
+		void parallelFor(ThreadPool* threadPool, size_t begin, size_t end, size_t grain, const Function& function)
+		{
+			if (threadPool)		 threadPool->parallelFor(begin, end, grain, function);
+			else if (begin < end) function(begin, end);
+		}
+
+//}
+//----------------------------------------------------------------------------
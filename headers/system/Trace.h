@@ -0,0 +1,264 @@
+#pragma once
+
+//----------------------------------------------------------------------------
+//{ Includes
+//----------------------------------------------------------------------------
+
+	#include <atomic>
+	#include <chrono>
+	#include <mutex>
+	#include <vector>
+
+//}
+//----------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------
+//{ Trace
+//----------------------------------------------------------------------------
+
+	/*
+		Timeline of scoped markers, written as a Chrome trace JSON file that
+		chrome://tracing and ui.perfetto.dev open. Markers are compiled in only
+		with TRACE_RENDERING defined before Includes.h, and record nothing until
+		Tracer::start():
+
+			#define TRACE_RENDERING
+			#include "Includes.h"
+			...
+			Tracer::start();
+			... frames ...
+			Tracer::stop();
+			Tracer::write("frames.json");
+
+		Every thread records into its own ring with no locking, a full ring
+		overwrites its oldest events, so the file has the most recent ones.
+		start(), stop() and write() are meant to be called between frames,
+		while no other thread records.
+	*/
+
+	// Complete event, times are nanoseconds since Tracer::start():
+	struct TraceEvent
+	{
+		const char* name;
+
+		unsigned long long start;
+		unsigned long long duration;
+	};
+
+	#ifdef TRACE_RENDERING
+
+		class Tracer
+		{
+			public:
+
+				// Getters:
+
+					static bool isRecording();
+
+					static unsigned long long now();
+
+				// Functions:
+
+					// Forgets what was recorded, a thread's ring gets its capacity when the thread records first:
+					static void start(size_t eventsPerThread = 1 << 18);
+					static void stop();
+
+					// Names have to outlive the trace, string literals do:
+					static void record(const char* name, unsigned long long start, unsigned long long end);
+
+					static bool write(const char* filename);
+
+			private:
+
+				struct Ring
+				{
+					std::vector<TraceEvent> events;
+
+					// Events ever recorded, the ring holds the last events.size() of them:
+					std::atomic<unsigned long long> recorded;
+
+					unsigned int thread;
+				};
+
+				struct State
+				{
+					std::atomic<bool> recording;
+
+					std::chrono::steady_clock::time_point epoch;
+					size_t eventsPerThread;
+
+					// Rings live as long as the program, so a thread that has exited can still be written:
+					std::mutex mutex;
+					std::vector<Ring*> rings;
+				};
+
+				static State& state();
+
+				// Ring of the calling thread, created on its first event:
+				static Ring* ring();
+		};
+
+		// Records the scope as one event if the tracer is recording when it starts:
+		class TraceScope
+		{
+			public:
+
+				TraceScope(const char* name) :
+					name_  (Tracer::isRecording() ? name : NULL),
+					start_ (name_ ? Tracer::now() : 0)
+				{}
+
+				~TraceScope()
+				{
+					if (name_) Tracer::record(name_, start_, Tracer::now());
+				}
+
+			private:
+
+				const char* name_;
+				unsigned long long start_;
+		};
+
+		#define TRACE_SCOPE(name) TraceScope traceScope(name)
+
+		//----------------------------------------------------------------------------
+		//{ Getters
+		//----------------------------------------------------------------------------
+
+			bool Tracer::isRecording()
+			{
+				return state().recording.load(std::memory_order_relaxed);
+			}
+
+			unsigned long long Tracer::now()
+			{
+				return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state().epoch).count());
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+		//----------------------------------------------------------------------------
+		//{ Functions
+		//----------------------------------------------------------------------------
+
+			Tracer::State& Tracer::state()
+			{
+				static State state;
+
+				return state;
+			}
+
+			Tracer::Ring* Tracer::ring()
+			{
+				static thread_local Ring* threadRing = NULL;
+
+				if (!threadRing)
+				{
+					State& current = state();
+
+					std::lock_guard<std::mutex> lock(current.mutex);
+
+					threadRing = new Ring();
+					threadRing->events.resize(std::max<size_t>(current.eventsPerThread, 1));
+					threadRing->recorded.store(0, std::memory_order_relaxed);
+					threadRing->thread = static_cast<unsigned int>(current.rings.size());
+
+					current.rings.push_back(threadRing);
+				}
+
+				return threadRing;
+			}
+
+			void Tracer::start(size_t eventsPerThread /*= 1 << 18*/)
+			{
+				State& current = state();
+
+				std::lock_guard<std::mutex> lock(current.mutex);
+
+				current.epoch			= std::chrono::steady_clock::now();
+				current.eventsPerThread = eventsPerThread;
+
+				for (size_t i = 0; i < current.rings.size(); i++) current.rings[i]->recorded.store(0, std::memory_order_relaxed);
+
+				current.recording.store(true, std::memory_order_release);
+			}
+
+			void Tracer::stop()
+			{
+				state().recording.store(false, std::memory_order_release);
+			}
+
+			void Tracer::record(const char* name, unsigned long long start, unsigned long long end)
+			{
+				assert(name);
+
+				Ring* threadRing = ring();
+
+				// Only this thread writes the ring, the count is published after the event:
+
+					unsigned long long index = threadRing->recorded.load(std::memory_order_relaxed);
+
+					TraceEvent event = { name, start, end - start };
+					threadRing->events[index % threadRing->events.size()] = event;
+
+					threadRing->recorded.store(index + 1, std::memory_order_release);
+			}
+
+			bool Tracer::write(const char* filename)
+			{
+				assert(filename);
+
+				FILE* file = fopen(filename, "wb");
+				if (!file) return false;
+
+				State& current = state();
+
+				std::lock_guard<std::mutex> lock(current.mutex);
+
+				fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+				bool first = true;
+
+				for (size_t i = 0; i < current.rings.size(); i++)
+				{
+					const Ring& threadRing = *current.rings[i];
+
+					unsigned long long recorded = threadRing.recorded.load(std::memory_order_acquire);
+					if (recorded == 0) continue;
+
+					fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+							first ? "" : ",\n", threadRing.thread, threadRing.thread);
+					first = false;
+
+					unsigned long long capacity = threadRing.events.size();
+
+					for (unsigned long long index = (recorded > capacity) ? recorded - capacity : 0; index < recorded; index++)
+					{
+						const TraceEvent& event = threadRing.events[index % capacity];
+
+						// Microseconds with the nanoseconds kept as decimals:
+						fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %llu.%03u, \"dur\": %llu.%03u}",
+								event.name, threadRing.thread,
+								event.start	   / 1000, static_cast<unsigned int>(event.start	% 1000),
+								event.duration / 1000, static_cast<unsigned int>(event.duration % 1000));
+					}
+				}
+
+				fprintf(file, "\n]}\n");
+
+				return fclose(file) == 0;
+			}
+
+		//}
+		//----------------------------------------------------------------------------
+
+	#else
+
+		#define TRACE_SCOPE(name)
+
+	#endif
+
+//}
+//----------------------------------------------------------------------------
@@ -18,10 +18,22 @@ bool Vector::check = true;
     {
 		Model cube = Model("resources/cube.txt");
 
-		Renderer renderer = Renderer(1000, 800, RGB(0, 0, 0), transformationMatrix(0, 0, 0, Vector(0, 0, 300)), Vector(500, 400), 200);
+		if (cube.getError()) printf("rasterizer: resources/cube.txt:%u: %s\n", (unsigned int) cube.getErrorLine(), cube.getError());
+
+		// Saving the model file shows it changed in the next frames:
+
+			ModelReloaderSettings reloaderSettings = { NULL, NULL, 100, 0 };
+			ModelReloader reloader(reloaderSettings);
+
+			reloader.watch(&cube, "resources/cube.txt");
+
+		Renderer renderer(1000, 800, RGB(0, 0, 0), transformationMatrix(0, 0, 0, Vector(0, 0, 300)), Vector(500, 400), 200);
 		
-		Matrix rotFront = transformationMatrix(+0.01, +0.01, +0.03);
-		Matrix rotBack  = transformationMatrix(-0.01, -0.01, -0.03);
+		Quaternion rotFront = Quaternion::fromAngles(+0.01, +0.01, +0.03);
+		Quaternion rotBack  = Quaternion::fromAngles(-0.01, -0.01, -0.03);
+
+		// The camera is rebuilt from it every frame instead of multiplied in place:
+		Quaternion orbit;
 
 		while (!GetAsyncKeyState(VK_ESCAPE))
 		{
@@ -29,8 +41,12 @@ bool Vector::check = true;
 			
 			if (GetAsyncKeyState(VK_RETURN))
 			{
-				if (GetAsyncKeyState(VK_LSHIFT)) renderer.moveCamera(rotBack);
-				else renderer.moveCamera(rotFront);
+				if (GetAsyncKeyState(VK_LSHIFT)) orbit *= rotBack;
+				else orbit *= rotFront;
+
+				orbit.renormalize();
+
+				renderer.setCamera(orbit.toMatrix(Vector(0, 0, 300)));
 			}
 
 			renderer.startRendering();
@@ -38,6 +54,11 @@ bool Vector::check = true;
 			cube.render(&renderer, transformationMatrix());
 
 			renderer.finishRendering();
+
+			std::vector<std::string> reloadErrors;
+			reloader.update(NULL, &reloadErrors);
+
+			for (size_t i = 0; i < reloadErrors.size(); i++) printf("%s\n", reloadErrors[i].c_str());
 		}
 		
 
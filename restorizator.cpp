@@ -39,13 +39,21 @@ bool Vector::check = true;
 
 		void render(const Renderer* renderer, const COLORREF color);
 
-		Cube& transform(const Matrix& transformationMatrix);
+		// Turns the orientation, the corners themselves are never changed, so nothing drifts:
+		Cube& rotate(const Quaternion& rotation);
+
+		Cube& zoom(double factor);
+
+		// Corner in world space:
+		Vector place(const Vector& corner) const;
 
         double radius_;
 
 		Vector coords_;
 
         Vector v000_, v001_, v010_, v011_, v100_, v101_, v110_, v111_;
+
+		Quaternion orientation_;
     };
 
 	Cube::Cube(double radius, Vector coords,
@@ -66,43 +74,56 @@ bool Vector::check = true;
 		v100_ (v100),
 		v101_ (v101),
 		v110_ (v110),
-		v111_ (v111)
+		v111_ (v111),
+		orientation_ ()
 	{}
 
     void Cube::render(const Renderer* renderer, const COLORREF color)
     {
-		renderer->line3d((v000_ * radius_) + coords_, (v001_ * radius_) + coords_, color);
-		renderer->line3d((v000_ * radius_) + coords_, (v010_ * radius_) + coords_, color);
-		renderer->line3d((v000_ * radius_) + coords_, (v100_ * radius_) + coords_, color);
+		Vector p000 = place(v000_), p001 = place(v001_), p010 = place(v010_), p011 = place(v011_);
+		Vector p100 = place(v100_), p101 = place(v101_), p110 = place(v110_), p111 = place(v111_);
+
+		renderer->line3d(p000, p001, color);
+		renderer->line3d(p000, p010, color);
+		renderer->line3d(p000, p100, color);
 
-		renderer->line3d((v001_ * radius_) + coords_, (v011_ * radius_) + coords_, color);
-		renderer->line3d((v001_ * radius_) + coords_, (v101_ * radius_) + coords_, color);
+		renderer->line3d(p001, p011, color);
+		renderer->line3d(p001, p101, color);
 
-		renderer->line3d((v010_ * radius_) + coords_, (v011_ * radius_) + coords_, color);
-		renderer->line3d((v010_ * radius_) + coords_, (v110_ * radius_) + coords_, color);
+		renderer->line3d(p010, p011, color);
+		renderer->line3d(p010, p110, color);
 
-		renderer->line3d((v100_ * radius_) + coords_, (v101_ * radius_) + coords_, color);
-		renderer->line3d((v100_ * radius_) + coords_, (v110_ * radius_) + coords_, color);
+		renderer->line3d(p100, p101, color);
+		renderer->line3d(p100, p110, color);
 
-		renderer->line3d((v111_ * radius_) + coords_, (v011_ * radius_) + coords_, color);
-		renderer->line3d((v111_ * radius_) + coords_, (v101_ * radius_) + coords_, color);
-		renderer->line3d((v111_ * radius_) + coords_, (v110_ * radius_) + coords_, color);
+		renderer->line3d(p111, p011, color);
+		renderer->line3d(p111, p101, color);
+		renderer->line3d(p111, p110, color);
     }
 
-	Cube& Cube::transform(const Matrix& transformationMatrix)
+	Cube& Cube::rotate(const Quaternion& rotation)
+	{
+		orientation_ = rotation * orientation_;
+		orientation_.renormalize();
+
+		return *this;
+	}
+
+	Cube& Cube::zoom(double factor)
 	{
-		v000_ *= transformationMatrix;
-		v001_ *= transformationMatrix;
-		v010_ *= transformationMatrix;
-		v011_ *= transformationMatrix;
-		v100_ *= transformationMatrix;
-		v101_ *= transformationMatrix;
-		v110_ *= transformationMatrix;
-		v111_ *= transformationMatrix;
+		radius_ *= factor;
 
 		return *this;
 	}
 
+	Vector Cube::place(const Vector& corner) const
+	{
+		double rotated[3] = {};
+		orientation_.rotate(corner.x() * radius_, corner.y() * radius_, corner.z() * radius_, rotated);
+
+		return Vector(rotated[0], rotated[1], rotated[2]) + coords_;
+	}
+
 //}
 //----------------------------------------------------------------------------
 
@@ -113,7 +134,7 @@ bool Vector::check = true;
 
     int main()
     {
-		Renderer renderer = Renderer(1000, 800, RGB(0, 0, 0), Vector(500, 400, 0), 400);
+		Renderer renderer(1000, 800, RGB(0, 0, 0), identityMatrix(4), Vector(500, 400), 400);
 
         Cube test =
         {   200, Vector(0, 0, 600),
@@ -127,23 +148,20 @@ bool Vector::check = true;
 			Vector( 1,  1,  1),
         };
 
-		Matrix rotFront = transformationMatrix(+0.01, +0.01, +0.03);
-		Matrix rotBack  = transformationMatrix(-0.01, -0.01, -0.03);
-
-		Matrix zoomPlus  = transformationMatrix(0, 0, 0, Vector(0, 0, 0), Vector(1.10, 1.10, 1.10));
-		Matrix zoomMinus = transformationMatrix(0, 0, 0, Vector(0, 0, 0), Vector(0.92, 0.92, 0.92));
+		Quaternion rotFront = Quaternion::fromAngles(+0.01, +0.01, +0.03);
+		Quaternion rotBack  = Quaternion::fromAngles(-0.01, -0.01, -0.03);
 
         while (!GetAsyncKeyState(VK_ESCAPE))
         {
 			if (!MLG)
 			{
-				if (GetAsyncKeyState('R')) test.transform(rotBack);
-				else test.transform(rotFront);
+				if (GetAsyncKeyState('R')) test.rotate(rotBack);
+				else test.rotate(rotFront);
 
 				if (GetAsyncKeyState('Z'))
 				{
-					if (GetAsyncKeyState(VK_SHIFT)) test.transform(zoomMinus);
-					else test.transform(zoomPlus);
+					if (GetAsyncKeyState(VK_SHIFT)) test.zoom(0.92);
+					else test.zoom(1.10);
 				}
 
 				renderer.clear();
@@ -157,12 +175,12 @@ bool Vector::check = true;
 			}
 			else
 			{
-				test.transform(rotFront);
+				test.rotate(rotFront);
 
 				if (rand() % 6 == 0)
 				{
-					test.transform(rotBack)
-						.transform(transformationMatrix(random(-0.1, 0.05),
+					test.rotate(rotBack)
+						.rotate(Quaternion::fromAngles(random(-0.1, 0.05),
 							random(-0.1, 0.05),
 							random(-0.1, 0.05)));
 
@@ -0,0 +1,120 @@
+#include "Includes.h"
+#include "headers/graphics/RenderServer.h"
+
+//----------------------------------------------------------------------------
+//{ Static class members initialization
+//----------------------------------------------------------------------------
+
+bool Matrix::check = false;
+bool Vector::check = false;
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Main
+//----------------------------------------------------------------------------
+
+	// Ctrl+C and closing the console stop the server, which then returns from run():
+	RenderServer* runningServer = NULL;
+
+	BOOL WINAPI stopServer(DWORD /*event*/)
+	{
+		if (runningServer) runningServer->stop();
+
+		return TRUE;
+	}
+
+	void printUsage()
+	{
+		puts("server model... [-pipe name] [-w width] [-h height] [-parallax value] [-slots count] [-threads count] [-msaa]\n"
+			 "\n"
+			 "Loads the models and renders frames of them for clients of the pipe (\\\\.\\pipe\\restorizer by default),\n"
+			 "see RenderServer.h for the protocol. Model ids are the order of the models here, from 0.");
+	}
+
+	int main(int argc, char* argv[])
+	{
+		// Arguments:
+
+			std::vector<const char*> modelFiles;
+
+			RenderServerSettings settings = { "\\\\.\\pipe\\restorizer", 1000, 800, 500, false, 4, 0 };
+
+			for (int i = 1; i < argc; i++)
+			{
+				bool hasValue = i + 1 < argc;
+
+				if		(strcmp(argv[i], "-pipe") == 0	   && hasValue) settings.pipeName	 = argv[++i];
+				else if (strcmp(argv[i], "-w") == 0		   && hasValue) settings.width		 = static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-h") == 0		   && hasValue) settings.height		 = static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-parallax") == 0 && hasValue) settings.parallax	 = atof(argv[++i]);
+				else if (strcmp(argv[i], "-slots") == 0	   && hasValue) settings.slotCount	 = static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-threads") == 0  && hasValue) settings.threadCount = static_cast<unsigned int>(atoi(argv[++i]));
+				else if (strcmp(argv[i], "-msaa") == 0)					settings.multisampling = true;
+				else if (argv[i][0] == '-')
+				{
+					printf("server: unknown option %s\n", argv[i]);
+					printUsage();
+
+					return 1;
+				}
+				else modelFiles.push_back(argv[i]);
+			}
+
+			if (modelFiles.empty())
+			{
+				printUsage();
+				return 1;
+			}
+
+			if (settings.width == 0 || settings.height == 0 || settings.parallax <= 0 || settings.slotCount == 0)
+			{
+				puts("server: the size, parallax and slot count have to be positive");
+				return 1;
+			}
+
+		// Models, loaded once for every client:
+
+			ThreadPoolSettings poolSettings = { 0, false, 1000 };
+			ThreadPool threadPool(poolSettings);
+
+			std::vector<Model*> models;
+			bool loaded = true;
+
+			for (size_t i = 0; i < modelFiles.size() && loaded; i++)
+			{
+				models.push_back(new Model(modelFiles[i], &threadPool));
+
+				if (models.back()->getError())
+				{
+					printf("server: %s:%u: %s\n", modelFiles[i], (unsigned int) models.back()->getErrorLine(), models.back()->getError());
+					loaded = false;
+				}
+				else printf("server: model %u is %s\n", static_cast<unsigned int>(i), modelFiles[i]);
+			}
+
+		bool served = false;
+
+		if (loaded)
+		{
+			RenderServer server(settings, std::vector<const Model*>(models.begin(), models.end()));
+
+			runningServer = &server;
+			SetConsoleCtrlHandler(stopServer, TRUE);
+
+			printf("server: listening on %s\n", settings.pipeName);
+
+			served = server.run();
+
+			SetConsoleCtrlHandler(stopServer, FALSE);
+			runningServer = NULL;
+		}
+
+		for (size_t i = 0; i < models.size(); i++) delete models[i];
+
+		return served ? 0 : 1;
+	}
+
+//}
+//----------------------------------------------------------------------------
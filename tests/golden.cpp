@@ -0,0 +1,362 @@
+#include "../Includes.h"
+
+//----------------------------------------------------------------------------
+//{ Static class members initialization
+//----------------------------------------------------------------------------
+
+bool Matrix::check = true;
+bool Vector::check = true;
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Scenes
+//----------------------------------------------------------------------------
+
+	/*
+		Rasterizer checks, run from the repository root:
+
+			golden
+
+		Fixed scenes are compared against the images in resources/golden, and
+		meshes drawn triangle by triangle must cover their pixels exactly once.
+		The exit code is the number of failed checks. To update a reference,
+		delete it and run once: the frame is written in its place and counted
+		as a failure, the next run checks against it.
+	*/
+
+	const unsigned int WIDTH  = 320;
+	const unsigned int HEIGHT = 240;
+
+	// Points and indices for checkCoverage():
+	struct Mesh
+	{
+		std::vector<int> points;
+		std::vector<unsigned int> indices;
+
+		size_t addPoint(int x, int y)
+		{
+			points.push_back(x);
+			points.push_back(y);
+
+			return points.size() / 2 - 1;
+		}
+
+		void addTriangle(size_t point0, size_t point1, size_t point2)
+		{
+			indices.push_back(static_cast<unsigned int>(point0));
+			indices.push_back(static_cast<unsigned int>(point1));
+			indices.push_back(static_cast<unsigned int>(point2));
+		}
+
+		size_t triangleCount() const
+		{
+			return indices.size() / 3;
+		}
+	};
+
+	//----------------------------------------------------------------------------
+	//{ Meshes
+	//----------------------------------------------------------------------------
+
+		// Cells split along alternating diagonals, inner points moved by up to jitter pixels.
+		// The generator is fixed here, rand() differs between runtimes:
+		Mesh gridMesh(int originX, int originY, int columns, int rows, int cellSize, int jitter)
+		{
+			Mesh mesh;
+
+			unsigned int state = 12345;
+
+			for (int row = 0; row <= rows; row++)
+			{
+				for (int column = 0; column <= columns; column++)
+				{
+					int x = originX + column * cellSize;
+					int y = originY + row * cellSize;
+
+					bool inner = row > 0 && row < rows && column > 0 && column < columns;
+
+					state = state * 1103515245 + 12345;
+					if (inner) x += static_cast<int>((state >> 16) % (2 * jitter + 1)) - jitter;
+
+					state = state * 1103515245 + 12345;
+					if (inner) y += static_cast<int>((state >> 16) % (2 * jitter + 1)) - jitter;
+
+					mesh.addPoint(x, y);
+				}
+			}
+
+			for (int row = 0; row < rows; row++)
+			{
+				for (int column = 0; column < columns; column++)
+				{
+					size_t topLeft	  = static_cast<size_t>(row * (columns + 1) + column);
+					size_t bottomLeft = topLeft + columns + 1;
+
+					if ((row + column) % 2)
+					{
+						mesh.addTriangle(topLeft, topLeft + 1, bottomLeft);
+						mesh.addTriangle(topLeft + 1, bottomLeft + 1, bottomLeft);
+					}
+					else
+					{
+						mesh.addTriangle(topLeft, topLeft + 1, bottomLeft + 1);
+						mesh.addTriangle(topLeft, bottomLeft + 1, bottomLeft);
+					}
+				}
+			}
+
+			return mesh;
+		}
+
+		// Thin triangles from the center to every step along the border of a rectangle:
+		Mesh sliverFan(int centerX, int centerY, int halfWidth, int halfHeight, int step)
+		{
+			Mesh mesh;
+
+			size_t center = mesh.addPoint(centerX, centerY);
+
+			int left = centerX - halfWidth, right  = centerX + halfWidth;
+			int top	 = centerY - halfHeight, bottom = centerY + halfHeight;
+
+			for (int x = left;	 x < right;	 x += step) mesh.addPoint(x, top);
+			for (int y = top;	 y < bottom; y += step) mesh.addPoint(right, y);
+			for (int x = right;	 x > left;	 x -= step) mesh.addPoint(x, bottom);
+			for (int y = bottom; y > top;	 y -= step) mesh.addPoint(left, y);
+
+			size_t borderCount = mesh.points.size() / 2 - 1;
+
+			for (size_t i = 0; i < borderCount; i++) mesh.addTriangle(center, 1 + i, 1 + (i + 1) % borderCount);
+
+			return mesh;
+		}
+
+		// Collinear points, repeated points and flat triangles, none of which has an inside:
+		Mesh degenerateMesh()
+		{
+			Mesh mesh;
+
+			const int points[][6] = { {  10,  10,  60,  35, 110,  60 },
+									  {   0,   0,  10,   3,  20,   6 },
+									  { 200,  20, 200,  20, 200,  20 },
+									  { 150, 100, 150, 100, 250, 180 },
+									  {  30, 200, 300, 200, 100, 200 },
+									  { 280,  10, 280, 230, 280, 120 },
+									  { -50, 120, 400, 120, 160, 120 } };
+
+			for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++)
+			{
+				size_t first = mesh.addPoint(points[i][0], points[i][1]);
+				mesh.addPoint(points[i][2], points[i][3]);
+				mesh.addPoint(points[i][4], points[i][5]);
+
+				mesh.addTriangle(first, first + 1, first + 2);
+			}
+
+			return mesh;
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+	//----------------------------------------------------------------------------
+	//{ Frames
+	//----------------------------------------------------------------------------
+
+		void drawCube(const Renderer& renderer, const Model& cube)
+		{
+			cube.render(&renderer, transformationMatrix(0.5, 0.7, 0.2));
+		}
+
+		// Every triangle in its own color, so the order they are drawn in shows too:
+		void drawMesh(const Renderer& renderer, const Mesh& mesh)
+		{
+			for (size_t i = 0; i < mesh.triangleCount(); i++)
+			{
+				const int* point0 = &mesh.points[2 * mesh.indices[3 * i]];
+				const int* point1 = &mesh.points[2 * mesh.indices[3 * i + 1]];
+				const int* point2 = &mesh.points[2 * mesh.indices[3 * i + 2]];
+
+				COLORREF color = RGB(64 + (i * 37) % 192, 64 + (i * 91) % 192, 64 + (i * 53) % 192);
+
+				renderer.triangle(point0[0], point0[1], point1[0], point1[1], point2[0], point2[1], color);
+			}
+		}
+
+		// Large triangles reaching past every side of the frame, and some ending exactly on its last row and column:
+		void drawEdgeCrossing(const Renderer& renderer)
+		{
+			int width  = static_cast<int>(WIDTH);
+			int height = static_cast<int>(HEIGHT);
+
+			renderer.triangle(-400, -300, 100, -50, -100, 150, RGB(200, 60, 60));
+			renderer.triangle(width + 300, -200, width - 80, 90, width + 50, 200, RGB(60, 200, 60));
+			renderer.triangle(-100, height + 200, 120, height - 60, 260, height + 500, RGB(60, 60, 200));
+			renderer.triangle(width / 2, height / 2, width, height / 2 - 40, width, height, RGB(200, 200, 60));
+			renderer.triangle(0, height, width / 2 - 30, height / 2 + 10, width / 2, height, RGB(60, 200, 200));
+			renderer.triangle(-1000, 100, 2000, 110, 160, 130, RGB(220, 220, 220));
+		}
+
+		// A triangle, a line and a pixel without a surface, drawn over the cube:
+		void drawOverlay(const Renderer& renderer)
+		{
+			renderer.triangle(130, 90, 200, 95, 160, 160, RGB(10, 200, 30));
+			renderer.line(110, 100, 220, 150, RGB(250, 40, 120));
+			renderer.pixel(165, 120, RGB(30, 60, 240));
+		}
+
+	//}
+	//----------------------------------------------------------------------------
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Checks
+//----------------------------------------------------------------------------
+
+	int failures = 0;
+	int checks	 = 0;
+
+	void checkFrame(const Renderer& renderer, const char* name)
+	{
+		std::string filename = std::string("resources/golden/") + name + ".ppm";
+
+		ImageDifference difference = {};
+		bool passed = checkReference(renderer, filename.c_str(), 0, &difference);
+
+		printf("%-24s %s\n", name, passed ? "ok" : "FAILED");
+
+		checks++;
+		if (!passed) failures++;
+	}
+
+	// Deferred shading lights the cube and leaves the overlay drawn over it in its exact colors:
+	void checkOverlay(const Model& cube)
+	{
+		Renderer plain(WIDTH, HEIGHT, RGB(0, 0, 0), transformationMatrix(0, 0, 0, Vector(0, 0, 500)), Vector(WIDTH / 2, HEIGHT / 2), 200, true);
+		Renderer deferred(WIDTH, HEIGHT, RGB(0, 0, 0), transformationMatrix(0, 0, 0, Vector(0, 0, 500)), Vector(WIDTH / 2, HEIGHT / 2), 200, true);
+
+		deferred.setDeferredShading(true);
+
+		plain.clear();
+		plain.startRendering();
+		drawOverlay(plain);
+		plain.finishRendering();
+
+		deferred.clear();
+		deferred.startRendering();
+		drawCube(deferred, cube);
+		drawOverlay(deferred);
+		deferred.finishRendering();
+
+		const unsigned int* expected = plain.getColorBuffer();
+		const unsigned int* colors	 = deferred.getColorBuffer();
+		unsigned int background		 = expected[0];
+
+		size_t overlayPixels = 0, changedPixels = 0;
+
+		for (size_t i = 0; i < WIDTH * HEIGHT; i++)
+		{
+			if (expected[i] == background) continue;
+
+			overlayPixels++;
+			if (colors[i] != expected[i]) changedPixels++;
+		}
+
+		bool passed = overlayPixels > 0 && changedPixels == 0;
+
+		printf("%-24s %s: %u overlay pixels, %u changed\n", "deferred overlay", passed ? "ok" : "FAILED",
+			   static_cast<unsigned int>(overlayPixels), static_cast<unsigned int>(changedPixels));
+
+		checks++;
+		if (!passed) failures++;
+	}
+
+	// Every pixel once and no holes, or no pixels at all for meshes without an inside:
+	void checkMesh(const Renderer& renderer, const char* name, const Mesh& mesh, bool empty)
+	{
+		CoverageStats stats = checkCoverage(renderer, mesh.points.data(), mesh.indices.data(), mesh.triangleCount());
+
+		bool passed = stats.overdrawnPixels == 0 && stats.holes == 0 && (stats.coveredPixels == 0) == empty;
+
+		printf("%-24s %s: %u covered, %u overdrawn, %u holes\n", name, passed ? "ok" : "FAILED", static_cast<unsigned int>(stats.coveredPixels),
+			   static_cast<unsigned int>(stats.overdrawnPixels), static_cast<unsigned int>(stats.holes));
+
+		checks++;
+		if (!passed) failures++;
+	}
+
+//}
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//{ Main
+//----------------------------------------------------------------------------
+
+	int main()
+	{
+		Model cube = Model("resources/cube.txt");
+
+		if (cube.getError())
+		{
+			printf("golden: resources/cube.txt:%u: %s, run it from the repository root\n", (unsigned int) cube.getErrorLine(), cube.getError());
+			return 1;
+		}
+
+		Renderer renderer(WIDTH, HEIGHT, RGB(0, 0, 0), transformationMatrix(0, 0, 0, Vector(0, 0, 500)), Vector(WIDTH / 2, HEIGHT / 2), 200, true);
+
+		Mesh grid		  = gridMesh(10, 10, 10, 7, 30, 9);
+		Mesh crossingGrid = gridMesh(-45, -35, 9, 7, 50, 15);
+		Mesh slivers	  = sliverFan(WIDTH / 2, HEIGHT / 2, 150, 110, 7);
+		Mesh degenerate	  = degenerateMesh();
+
+		// Against the reference images:
+
+			renderer.clear();
+			renderer.startRendering();
+			drawCube(renderer, cube);
+			renderer.finishRendering();
+
+			checkFrame(renderer, "cube");
+
+			renderer.clear();
+			renderer.startRendering();
+			drawMesh(renderer, slivers);
+			renderer.finishRendering();
+
+			checkFrame(renderer, "slivers");
+
+			renderer.clear();
+			renderer.startRendering();
+			drawEdgeCrossing(renderer);
+			renderer.finishRendering();
+
+			checkFrame(renderer, "edge_crossing");
+
+			renderer.clear();
+			renderer.startRendering();
+			drawMesh(renderer, grid);
+			renderer.finishRendering();
+
+			checkFrame(renderer, "grid");
+
+		// Triangle by triangle:
+
+			checkMesh(renderer, "grid coverage",		  grid,			false);
+			checkMesh(renderer, "crossing grid coverage", crossingGrid, false);
+			checkMesh(renderer, "slivers coverage",		  slivers,		false);
+			checkMesh(renderer, "degenerate coverage",	  degenerate,	true);
+
+		// Unlit colors under deferred shading:
+
+			checkOverlay(cube);
+
+		printf("golden: %d of %d checks failed\n", failures, checks);
+
+		return failures;
+	}
+
+//}
+//----------------------------------------------------------------------------